@@ -0,0 +1,331 @@
+/*
+  bombench.cpp - micro-benchmarks for the checksum, file list, tree and bom reading code
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "bomstorage.hpp"
+#include "bomutils.hpp"
+#include "writebom.hpp"
+#include "crc32.hpp"
+#include "synthetic.hpp"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+/* what one run of a benchmark processed. A benchmark prepares its input first and calls start()
+   and stop() around the measured loop, so the setup is not part of seconds. */
+struct BenchResult {
+    uint64_t                  items;
+    uint64_t                  bytes;
+    double                    seconds;
+    bench_clock_t::time_point started;
+
+    BenchResult()
+        : items(0)
+        , bytes(0)
+        , seconds(0) {}
+
+    void start() { started = bench_clock_t::now(); }
+    void stop() { seconds = std::chrono::duration<double>(bench_clock_t::now() - started).count(); }
+};
+
+typedef BenchResult (*bench_fn_t)(uint64_t iterations, uint32_t param);
+
+struct Benchmark {
+    const char* name;
+    uint32_t    param;
+    bench_fn_t  fn;
+};
+
+static volatile uint64_t sink; // keeps the compiler from dropping the measured work
+static std::string       out_dir("/tmp");
+static uint32_t          num_entries = 10000;
+
+static std::vector<uint8_t> random_buffer(std::size_t size) {
+    std::mt19937         rng(1);
+    std::vector<uint8_t> buffer(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        buffer[i] = rng();
+    }
+    return buffer;
+}
+
+static std::string const& manifest() {
+    static std::string result;
+    if (result.empty()) {
+        std::stringstream ss;
+        generate_manifest(ss, nullptr, num_entries, 64, 1);
+        result = ss.str();
+    }
+    return result;
+}
+
+static std::string temp_path(const char* name) {
+    std::stringstream ss;
+    ss << out_dir << "/bombench-" << ::getpid() << "-" << name;
+    return ss.str();
+}
+
+BenchResult bench_crc32_update(uint64_t iterations, uint32_t size) {
+    std::vector<uint8_t> buffer = random_buffer(size);
+    BenchResult          r;
+    uint32_t             crc = 0;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        crc = crc32_update(crc, buffer.data(), buffer.size());
+    }
+    r.stop();
+    sink    = crc;
+    r.items = iterations;
+    r.bytes = iterations * size;
+    return r;
+}
+
+BenchResult bench_calc_str_crc32(uint64_t iterations, uint32_t size) {
+    std::string str(size, 'x');
+    BenchResult r;
+    uint32_t    crc = 0;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        str[i % size] = 'a' + (i % 26);
+        crc ^= calc_str_crc32(str.c_str());
+    }
+    r.stop();
+    sink    = crc;
+    r.items = iterations;
+    r.bytes = iterations * size;
+    return r;
+}
+
+BenchResult bench_calc_crc32(uint64_t iterations, uint32_t size) {
+    std::string path = temp_path("crc32");
+    {
+        std::vector<uint8_t> buffer = random_buffer(size);
+        std::ofstream        f(path.c_str(), std::ios::binary | std::ios::out);
+        f.write((const char*)buffer.data(), buffer.size());
+    }
+    BenchResult r;
+    uint32_t    crc = 0;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        crc ^= calc_crc32(path.c_str());
+    }
+    r.stop();
+    std::remove(path.c_str());
+    sink    = crc;
+    r.items = iterations;
+    r.bytes = iterations * size;
+    return r;
+}
+
+BenchResult bench_parse_node(uint64_t iterations, uint32_t) {
+    std::vector<std::string> lines;
+    {
+        std::istringstream ss(manifest());
+        for (std::string line; std::getline(ss, line);) {
+            lines.push_back(line);
+        }
+    }
+    BenchResult r;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::string const& line = lines[i % lines.size()];
+        std::string        name;
+        Node               n;
+        parse_node(line, name, n);
+        sink = n.mode;
+        r.bytes += line.size() + 1;
+    }
+    r.stop();
+    r.items = iterations;
+    return r;
+}
+
+BenchResult bench_read_tree(uint64_t iterations, uint32_t) {
+    std::string const& list = manifest();
+    BenchResult        r;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::istringstream input(list);
+        NodeTree           tree;
+        r.items += read_tree(input, tree);
+        r.bytes += list.size();
+    }
+    r.stop();
+    return r;
+}
+
+BenchResult bench_add_block(uint64_t iterations, uint32_t size) {
+    std::vector<uint8_t> block = random_buffer(size);
+    BenchResult          r;
+    /* every iteration fills a new storage, so growth costs are part of the measurement */
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        BOMStorage bom;
+        for (uint32_t j = 0; j < num_entries; ++j) {
+            sink = bom.addBlock(block.data(), block.size());
+        }
+        r.items += num_entries;
+        r.bytes += (uint64_t)num_entries * size;
+    }
+    r.stop();
+    return r;
+}
+
+BenchResult bench_add_tree(uint64_t iterations, uint32_t) {
+    NodeTree tree;
+    {
+        std::istringstream input(manifest());
+        read_tree(input, tree);
+    }
+    BenchResult r;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        BOMStorage bom;
+        add_tree(bom, tree, BOMLayout());
+        r.items += tree.size();
+    }
+    r.stop();
+    return r;
+}
+
+/* the per-entry work of lsbom with its default parameters, through the BomReader it uses */
+BenchResult bench_lsbom_decode(uint64_t iterations, uint32_t) {
+    std::string path = temp_path("decode.bom");
+    {
+        std::istringstream input(manifest());
+        write_bom(input, path);
+    }
+    BomReader reader(path);
+    std::remove(path.c_str());
+
+    BenchResult r;
+    r.start();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::ostringstream out;
+        BomPathEntry       e;
+        reader.rewind();
+        while (reader.next(e)) {
+            out << e.path << '\t' << std::oct << e.mode() << '\t' << std::dec << e.uid() << '/' << e.gid();
+            if (e.type() == TYPE_FILE) {
+                out << '\t' << e.size() << '\t' << e.checksum();
+            }
+            out << '\n';
+            r.items++;
+        }
+        r.bytes += out.str().size();
+    }
+    r.stop();
+    return r;
+}
+
+static const Benchmark benchmarks[] = {
+    { "crc32_update", 64, bench_crc32_update },
+    { "crc32_update", 1024, bench_crc32_update },
+    { "crc32_update", 16 * 1024, bench_crc32_update },
+    { "crc32_update", 256 * 1024, bench_crc32_update },
+    { "crc32_update", 1024 * 1024, bench_crc32_update },
+    { "calc_str_crc32", 16, bench_calc_str_crc32 },
+    { "calc_str_crc32", 256, bench_calc_str_crc32 },
+    { "calc_crc32", 4 * 1024, bench_calc_crc32 },
+    { "calc_crc32", 4 * 1024 * 1024, bench_calc_crc32 },
+    { "parse_node", 0, bench_parse_node },
+    { "read_tree", 0, bench_read_tree },
+    { "add_block", 16, bench_add_block },
+    { "add_block", 256, bench_add_block },
+    { "add_tree", 0, bench_add_tree },
+    { "lsbom_decode", 0, bench_lsbom_decode },
+};
+
+void usage() {
+    std::cout << "Usage: bombench [-l] [-f filter] [-t seconds] [-n entries] [-o dir]" << std::endl << std::endl;
+    std::cout << "\t-l\tList the available benchmarks" << std::endl;
+    std::cout << "\t-f\tOnly run benchmarks whose name contains filter" << std::endl;
+    std::cout << "\t-t\tMinimum run time of each benchmark in seconds (default: 0.25)" << std::endl;
+    std::cout << "\t-n\tNumber of entries of the synthetic file lists and trees (default: 10000)" << std::endl;
+    std::cout << "\t-o\tDirectory for temporary files (default: /tmp)" << std::endl;
+    std::cout << std::endl << "Results are printed as one JSON object per line." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    double      min_time  = 0.25;
+    bool        list_only = false;
+
+    while (true) {
+        char c = ::getopt(argc, argv, "hlf:t:n:o:");
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'l': list_only = true; break;
+            case 'f': filter = optarg; break;
+            case 't': min_time = std::atof(optarg); break;
+            case 'n': num_entries = std::atol(optarg); break;
+            case 'o': out_dir = optarg; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
+        }
+    }
+
+    for (std::size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+        Benchmark const& b = benchmarks[i];
+        if ((filter.empty() == false) && (std::string(b.name).find(filter) == std::string::npos)) {
+            continue;
+        }
+        if (list_only) {
+            std::cout << b.name << "/" << b.param << std::endl;
+            continue;
+        }
+
+        /* double the iterations until a run takes long enough to be measured reliably */
+        uint64_t    iterations = 1;
+        double      seconds    = 0;
+        BenchResult result;
+        while (true) {
+            result  = b.fn(iterations, b.param);
+            seconds = result.seconds;
+            if (seconds >= min_time) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        std::cout << "{\"name\":\"" << b.name << "\",\"param\":" << b.param << ",\"entries\":" << num_entries
+                  << ",\"iterations\":" << iterations << ",\"items\":" << result.items
+                  << ",\"bytes\":" << result.bytes << ",\"seconds\":" << seconds
+                  << ",\"ns_per_item\":" << ((seconds * 1e9) / result.items)
+                  << ",\"mb_per_s\":" << (result.bytes / seconds / (1024. * 1024.)) << "}" << std::endl;
+    }
+    return 0;
+}
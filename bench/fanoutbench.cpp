@@ -0,0 +1,244 @@
+/*
+  fanoutbench.cpp - compare bom build time, size and lookup speed for different tree layouts
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+#include "bomreader.hpp"
+#include "writebom.hpp"
+#include "synthetic.hpp"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+/* smallest power of two block that holds a leaf, but never less than the default */
+static uint32_t block_size_for(uint32_t paths_per_leaf) {
+    uint32_t needed     = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (paths_per_leaf * sizeof(BOMPathIndices));
+    uint32_t block_size = BOMLayout().blockSize;
+    while (block_size < needed) {
+        block_size *= 2;
+    }
+    return block_size;
+}
+
+/* counts the accesses that do not continue on the same or the next page of the previous one */
+struct PageTracker {
+    uint64_t last_page;
+    uint64_t jumps;
+
+    PageTracker()
+        : last_page(0)
+        , jumps(0) {}
+
+    void touch(BOMReader const& reader, uint32_t id) {
+        uint64_t page = reader.blockAddress(id) / 4096;
+        if ((page != last_page) && (page != last_page + 1)) {
+            jumps++;
+        }
+        last_page = page;
+    }
+};
+
+/* the same work lsbom does for every entry: rebuild the full path from the parent chain */
+static uint64_t list_all(BOMReader const& reader, PageTracker* tracker) {
+    std::vector<std::string> names;
+    std::vector<uint32_t>    parents;
+    uint64_t                 total = 0;
+    for (const BOMPaths* leaf = reader.firstLeaf(reader.tree("Paths")); leaf; leaf = reader.nextLeaf(leaf)) {
+        for (unsigned int i = 0; i < ntohs(leaf->count); ++i) {
+            BOMEntry e = reader.entry(leaf, i);
+            if (tracker) {
+                const BOMPathInfo1* info1 = (const BOMPathInfo1*)reader.lookup(ntohl(leaf->indices[i].index0));
+                tracker->touch(reader, ntohl(leaf->indices[i].index1));
+                tracker->touch(reader, ntohl(leaf->indices[i].index0));
+                tracker->touch(reader, ntohl(info1->index));
+            }
+            if (e.id >= names.size()) {
+                names.resize(e.id + 1);
+                parents.resize(e.id + 1);
+            }
+            names[e.id]          = e.name;
+            parents[e.id]        = e.parent;
+            std::string filename = e.name;
+            for (uint32_t p = e.parent; p != 0 && p < names.size(); p = parents[p]) {
+                filename = names[p] + "/" + filename;
+            }
+            total += filename.size() + ntohl(e.info->size);
+        }
+        if (tracker && leaf->forward) {
+            tracker->touch(reader, ntohl(leaf->forward));
+        }
+    }
+    return total;
+}
+
+/* ask the kernel to drop the file from the page cache so the next listing reads it from disk */
+static void drop_cache(std::string const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+void usage() {
+    std::cout << "Usage: fanoutbench [-n entries] [-d dir-fanout] [-l lookups] [-o dir] [fanout ...]" << std::endl << std::endl;
+    std::cout << "\t-n\tNumber of entries in the synthetic file list (default: 100000)" << std::endl;
+    std::cout << "\t-d\tNumber of children per directory (default: 64)" << std::endl;
+    std::cout << "\t-l\tNumber of random path lookups per layout (default: 100000)" << std::endl;
+    std::cout << "\t-o\tDirectory for the generated bom files (default: /tmp)" << std::endl;
+    std::cout << std::endl << "Every fanout is measured with the default and the clustered (mkbom -c) block layout." << std::endl;
+    std::cout << "Results are printed as tab separated values, one layout per line. list_cold_s is measured" << std::endl;
+    std::cout << "after dropping the bom file from the page cache, page_jumps counts the block accesses" << std::endl;
+    std::cout << "of a listing that do not continue on the same or the following 4k page." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t    num_entries = 100000;
+    uint32_t    dir_fanout  = 64;
+    uint32_t    num_lookups = 100000;
+    std::string out_dir("/tmp");
+
+    while (true) {
+        char c = ::getopt(argc, argv, "hn:d:l:o:");
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'n': num_entries = std::atol(optarg); break;
+            case 'd': dir_fanout = std::atol(optarg); break;
+            case 'l': num_lookups = std::atol(optarg); break;
+            case 'o': out_dir = optarg; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
+        }
+    }
+
+    std::vector<uint32_t> fanouts;
+    for (int i = optind; i < argc; ++i) {
+        fanouts.push_back(std::atol(argv[i]));
+    }
+    if (fanouts.empty()) {
+        fanouts = { 32, 64, 128, 256, 510, 1024, 4096 };
+    }
+
+    std::vector<std::string> paths;
+    std::string              manifest;
+    {
+        std::stringstream ss;
+        generate_manifest(ss, &paths, num_entries, dir_fanout, 1);
+        manifest = ss.str();
+    }
+
+    std::mt19937             rng(2);
+    std::vector<std::string> queries;
+    for (uint32_t i = 0; i < num_lookups && paths.size() != 0; ++i) {
+        queries.push_back(paths[rng() % paths.size()]);
+    }
+
+    std::cout << "fanout\tblock_size\tclustered\tentries\tbuild_s\tbom_bytes\tlist_cold_s\tlist_s\tpage_jumps\tlookup_ns"
+              << std::endl;
+    for (std::size_t run = 0; run < fanouts.size() * 2; ++run) {
+        uint32_t  fanout = fanouts[run / 2];
+        BOMLayout layout;
+        layout.pathsPerLeaf = fanout;
+        layout.blockSize    = block_size_for(fanout);
+        layout.clustered    = (run % 2) != 0;
+        try {
+            validate_layout(layout);
+        } catch (std::exception const& e) {
+            std::cerr << "Skipping fanout " << fanout << ": " << e.what() << std::endl;
+            run++;
+            continue;
+        }
+
+        std::stringstream name;
+        name << out_dir << "/fanoutbench-" << ::getpid() << "-" << fanout << ".bom";
+        std::string bom_path = name.str();
+
+        bench_clock_t::time_point start = bench_clock_t::now();
+        {
+            std::istringstream input(manifest);
+            write_bom(input, bom_path, layout);
+        }
+        double build_s = seconds_since(start);
+
+        struct stat s;
+        ::stat(bom_path.c_str(), &s);
+
+        drop_cache(bom_path);
+        BOMReader reader;
+        reader.open(bom_path.c_str());
+
+        start                = bench_clock_t::now();
+        uint64_t checksum    = list_all(reader, nullptr);
+        double   list_cold_s = seconds_since(start);
+
+        start         = bench_clock_t::now();
+        checksum      = list_all(reader, nullptr);
+        double list_s = seconds_since(start);
+
+        PageTracker tracker;
+        list_all(reader, &tracker);
+
+        start          = bench_clock_t::now();
+        uint32_t found = 0;
+        for (std::vector<std::string>::const_iterator q = queries.begin(); q != queries.end(); ++q) {
+            found += reader.findPath(*q) ? 1 : 0;
+        }
+        double lookup_s = seconds_since(start);
+        if (found != queries.size()) {
+            std::cerr << "Lookup failed for " << (queries.size() - found) << " paths with fanout " << fanout
+                      << std::endl;
+            return 1;
+        }
+
+        std::cout << fanout << "\t" << layout.blockSize << "\t" << (layout.clustered ? 1 : 0) << "\t"
+                  << paths.size() << "\t" << build_s << "\t" << s.st_size << "\t" << list_cold_s << "\t"
+                  << list_s << "\t" << tracker.jumps << "\t"
+                  << (queries.empty() ? 0. : (lookup_s * 1e9) / queries.size()) << std::endl;
+        if (checksum == 0) {
+            std::cerr << "Listing returned no data" << std::endl;
+        }
+        reader.close();
+        std::remove(bom_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,375 @@
+/*
+  gentree.cpp - generate synthetic staging trees and the matching ls4mkbom file lists
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "crc32.hpp"
+
+struct SizeDistribution {
+    enum { kFixed, kUniform, kExponential } kind;
+    uint64_t a;
+    uint64_t b;
+};
+
+struct GenFile {
+    std::string path;
+    uint64_t    size;
+    uint32_t    checksum;
+};
+
+struct GenDir {
+    std::string path;
+    uint32_t    depth;
+    uint32_t    children;
+};
+
+static bool parse_size_distribution(std::string const& spec, SizeDistribution& dist) {
+    std::stringstream        ss(spec);
+    std::vector<std::string> parts;
+    for (std::string part; std::getline(ss, part, ':'); parts.push_back(part)) {}
+    if ((parts.size() == 2) && (parts[0] == "fixed")) {
+        dist.kind = SizeDistribution::kFixed;
+        dist.a    = std::strtoull(parts[1].c_str(), nullptr, 10);
+    } else if ((parts.size() == 3) && (parts[0] == "uniform")) {
+        dist.kind = SizeDistribution::kUniform;
+        dist.a    = std::strtoull(parts[1].c_str(), nullptr, 10);
+        dist.b    = std::strtoull(parts[2].c_str(), nullptr, 10);
+        if (dist.b < dist.a) {
+            return false;
+        }
+    } else if ((parts.size() == 2) && (parts[0] == "exp")) {
+        dist.kind = SizeDistribution::kExponential;
+        dist.a    = std::strtoull(parts[1].c_str(), nullptr, 10);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+class Generator {
+    private:
+        std::mt19937_64      rng;
+        SizeDistribution     sizes;
+        double               symlink_ratio;
+        double               hardlink_ratio;
+        uint32_t             uid;
+        uint32_t             gid;
+        std::string          base;     // root of the tree on disk, empty for list only
+        std::ostream*        manifest; // may be null
+        bool                 checksums;
+        std::vector<GenFile> recent;   // candidates for link targets
+        std::vector<uint8_t> buffer;
+
+        uint64_t file_size() {
+            switch (sizes.kind) {
+                case SizeDistribution::kFixed: return sizes.a;
+                case SizeDistribution::kUniform:
+                    return sizes.a + (rng() % (sizes.b - sizes.a + 1));
+                case SizeDistribution::kExponential:
+                    return (uint64_t)std::exponential_distribution<double>(1. / (sizes.a ? sizes.a : 1))(rng);
+            }
+            return 0;
+        }
+
+        void fail(std::string const& what, std::string const& path) {
+            std::cerr << what << ": " << path << " (" << std::strerror(errno) << ")" << std::endl;
+            std::exit(1);
+        }
+
+        std::string disk_path(std::string const& path) const { return base + "/" + path; }
+
+        /* file contents are derived from the index so that the same options produce the same tree */
+        uint32_t write_contents(std::string const& path, uint64_t size, uint64_t index) {
+            int fd = -1;
+            if (base.empty() == false) {
+                fd = ::open(disk_path(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    fail("Unable to create file", disk_path(path));
+                }
+            }
+            uint64_t state = (index + 1) * 0x9E3779B97F4A7C15ULL;
+            uint32_t crc   = 0;
+            for (uint64_t written = 0; written < size;) {
+                std::size_t chunk = (size - written) < buffer.size() ? (size - written) : buffer.size();
+                for (std::size_t i = 0; i < chunk; ++i) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    buffer[i] = (uint8_t)state;
+                }
+                if (checksums) {
+                    crc = crc32_update(crc, buffer.data(), chunk);
+                }
+                if ((fd >= 0) && (::write(fd, buffer.data(), chunk) != (ssize_t)chunk)) {
+                    fail("Unable to write file", disk_path(path));
+                }
+                written += chunk;
+            }
+            if (fd >= 0) {
+                ::fchmod(fd, 0644);
+                ::close(fd);
+            }
+            return checksums ? crc32_finish(crc, size) : 0;
+        }
+
+        void emit_line(std::string const& path, const char* mode, uint64_t size, uint32_t checksum,
+                       bool with_size, const char* link) {
+            if (manifest == nullptr) {
+                return;
+            }
+            *manifest << path << '\t' << mode << '\t' << uid << '/' << gid;
+            if (with_size) {
+                *manifest << '\t' << size << '\t' << checksum;
+            }
+            if (link) {
+                *manifest << '\t' << link;
+            }
+            *manifest << '\n';
+        }
+
+    public:
+        uint64_t files;
+        uint64_t dirs;
+        uint64_t symlinks;
+        uint64_t hardlinks;
+        uint64_t bytes;
+
+        Generator(uint32_t seed, SizeDistribution const& size_dist, double symlinks_, double hardlinks_,
+                  uint32_t uid_, uint32_t gid_, std::string const& base_, std::ostream* manifest_,
+                  bool checksums_)
+            : rng(seed)
+            , sizes(size_dist)
+            , symlink_ratio(symlinks_)
+            , hardlink_ratio(hardlinks_)
+            , uid(uid_)
+            , gid(gid_)
+            , base(base_)
+            , manifest(manifest_)
+            , checksums(checksums_)
+            , buffer(64 * 1024)
+            , files(0)
+            , dirs(0)
+            , symlinks(0)
+            , hardlinks(0)
+            , bytes(0) {}
+
+        void add_dir(std::string const& path) {
+            if (base.empty() == false) {
+                if ((path != ".") && (::mkdir(disk_path(path).c_str(), 0755) != 0)) {
+                    fail("Unable to create directory", disk_path(path));
+                }
+                ::chmod(disk_path(path).c_str(), 0755);
+            }
+            emit_line(path, "40755", 0, 0, false, nullptr);
+            dirs++;
+        }
+
+        void add_leaf(GenDir const& dir, uint32_t i, uint64_t index) {
+            std::uniform_real_distribution<double> ratio(0., 1.);
+            std::stringstream                      name;
+            double                                 r = ratio(rng);
+            if ((r < symlink_ratio) && (recent.empty() == false)) {
+                GenFile const& target = recent[rng() % recent.size()];
+                std::string    link;
+                for (uint32_t d = 0; d < dir.depth; ++d) {
+                    link += "../";
+                }
+                link += target.path.substr(2);
+                name << dir.path << "/l" << std::setw(6) << std::setfill('0') << i;
+                if ((base.empty() == false) && (::symlink(link.c_str(), disk_path(name.str()).c_str()) != 0)) {
+                    fail("Unable to create symbolic link", disk_path(name.str()));
+                }
+                emit_line(name.str(), "120777", link.size(), calc_str_crc32(link.c_str()), true, link.c_str());
+                symlinks++;
+            } else if ((r < symlink_ratio + hardlink_ratio) && (recent.empty() == false)) {
+                GenFile const& target = recent[rng() % recent.size()];
+                name << dir.path << "/h" << std::setw(6) << std::setfill('0') << i;
+                if ((base.empty() == false) &&
+                    (::link(disk_path(target.path).c_str(), disk_path(name.str()).c_str()) != 0)) {
+                    fail("Unable to create hard link", disk_path(name.str()));
+                }
+                emit_line(name.str(), "100644", target.size, target.checksum, true, nullptr);
+                hardlinks++;
+            } else {
+                name << dir.path << "/f" << std::setw(6) << std::setfill('0') << i;
+                GenFile f;
+                f.path     = name.str();
+                f.size     = file_size();
+                f.checksum = write_contents(f.path, f.size, index);
+                emit_line(f.path, "100644", f.size, f.checksum, true, nullptr);
+                if (recent.size() < 1024) {
+                    recent.push_back(f);
+                } else {
+                    recent[rng() % recent.size()] = f;
+                }
+                files++;
+                bytes += f.size;
+            }
+        }
+};
+
+void usage() {
+    std::cout << "Usage: gentree [-n entries] [-f fanout] [-d depth] [-x dirs] [-s sizes] [-l ratio] [-k ratio]" << std::endl;
+    std::cout << "               [-u uid] [-g gid] [-r seed] [-c] [-m file-list] [directory]" << std::endl << std::endl;
+    std::cout << "\t-n\tTotal number of entries including the root directory (default: 10000)" << std::endl;
+    std::cout << "\t-f\tNumber of entries created per directory and pass (default: 32)" << std::endl;
+    std::cout << "\t-d\tMaximum directory depth (default: 8)" << std::endl;
+    std::cout << "\t-x\tEvery n-th entry of a directory is a subdirectory (default: 8)" << std::endl;
+    std::cout << "\t-s\tFile size distribution: fixed:N, uniform:MIN:MAX or exp:MEAN (default: exp:4096)" << std::endl;
+    std::cout << "\t-l\tFraction of non-directory entries that are symbolic links (default: 0.05)" << std::endl;
+    std::cout << "\t-k\tFraction of non-directory entries that are hard links (default: 0.02)" << std::endl;
+    std::cout << "\t-u\tUser ID written to the file list (default: current user)" << std::endl;
+    std::cout << "\t-g\tGroup ID written to the file list (default: current group)" << std::endl;
+    std::cout << "\t-r\tRandom seed (default: 1)" << std::endl;
+    std::cout << "\t-c\tDo not compute checksums for the file list, write 0 instead" << std::endl;
+    std::cout << "\t-m\tWrite the file list in the format generated by ls4mkbom to this file, - for stdout" << std::endl;
+    std::cout << std::endl << "The tree is only created on disk if a directory is given, it must not exist yet." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t         num_entries = 10000;
+    uint32_t         fanout      = 32;
+    uint32_t         max_depth   = 8;
+    uint32_t         dir_every   = 8;
+    double           symlinks    = 0.05;
+    double           hardlinks   = 0.02;
+    uint32_t         uid         = ::getuid();
+    uint32_t         gid         = ::getgid();
+    uint32_t         seed        = 1;
+    bool             checksums   = true;
+    std::string      manifest_path;
+    SizeDistribution sizes;
+    sizes.kind = SizeDistribution::kExponential;
+    sizes.a    = 4096;
+    sizes.b    = 0;
+
+    while (true) {
+        char c = ::getopt(argc, argv, "hn:f:d:x:s:l:k:u:g:r:cm:");
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'n': num_entries = std::strtoull(optarg, nullptr, 10); break;
+            case 'f': fanout = std::atol(optarg); break;
+            case 'd': max_depth = std::atol(optarg); break;
+            case 'x': dir_every = std::atol(optarg); break;
+            case 's':
+                if (parse_size_distribution(optarg, sizes) == false) {
+                    std::cerr << "Invalid size distribution: " << optarg << std::endl;
+                    return 1;
+                }
+                break;
+            case 'l': symlinks = std::atof(optarg); break;
+            case 'k': hardlinks = std::atof(optarg); break;
+            case 'u': uid = std::atol(optarg); break;
+            case 'g': gid = std::atol(optarg); break;
+            case 'r': seed = std::atol(optarg); break;
+            case 'c': checksums = false; break;
+            case 'm': manifest_path = optarg; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
+        }
+    }
+
+    std::string base;
+    if (optind < argc) {
+        base = argv[optind];
+        if (::mkdir(base.c_str(), 0755) != 0) {
+            std::cerr << "Unable to create directory: " << base << " (" << std::strerror(errno) << ")" << std::endl;
+            return 1;
+        }
+    }
+    if (base.empty() && manifest_path.empty()) {
+        usage();
+        return 1;
+    }
+    if ((fanout < 1) || (dir_every < 1) || (max_depth < 1)) {
+        std::cerr << "fanout, depth and directory interval must be at least 1" << std::endl;
+        return 1;
+    }
+
+    std::ofstream manifest_file;
+    std::ostream* manifest = nullptr;
+    if (manifest_path == "-") {
+        manifest = &std::cout;
+    } else if (manifest_path.empty() == false) {
+        manifest_file.open(manifest_path.c_str(), std::ios::out | std::ios::binary);
+        if (manifest_file.fail()) {
+            std::cerr << "Unable to open file list: " << manifest_path << std::endl;
+            return 1;
+        }
+        manifest = &manifest_file;
+    }
+
+    Generator gen(seed, sizes, symlinks, hardlinks, uid, gid, base, manifest,
+                  checksums || (base.empty() == false));
+    std::vector<GenDir> dirs;
+    uint64_t            written = 0;
+    if (num_entries != 0) {
+        gen.add_dir(".");
+        GenDir root = { ".", 0, 0 };
+        dirs.push_back(root);
+        written++;
+    }
+    /* breadth first: every directory gets fanout entries per pass. Once the depth limit stops new
+       directories from appearing, further passes keep adding entries to the existing ones. */
+    while (written < num_entries) {
+        for (std::size_t d = 0; (d < dirs.size()) && (written < num_entries); ++d) {
+            for (uint32_t i = 0; (i < fanout) && (written < num_entries); ++i, ++written) {
+                uint32_t child = dirs[d].children++;
+                if (((child % dir_every) == 0) && (dirs[d].depth + 1 < max_depth)) {
+                    std::stringstream name;
+                    name << dirs[d].path << "/d" << std::setw(5) << std::setfill('0') << child;
+                    gen.add_dir(name.str());
+                    GenDir sub = { name.str(), dirs[d].depth + 1, 0 };
+                    dirs.push_back(sub);
+                } else {
+                    gen.add_leaf(dirs[d], child, written);
+                }
+            }
+        }
+    }
+
+    if (manifest) {
+        manifest->flush();
+    }
+    std::cerr << "entries=" << written << " dirs=" << gen.dirs << " files=" << gen.files
+              << " symlinks=" << gen.symlinks << " hardlinks=" << gen.hardlinks << " bytes=" << gen.bytes
+              << std::endl;
+    return 0;
+}
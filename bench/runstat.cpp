@@ -0,0 +1,158 @@
+/*
+  runstat.cpp - run a command and report its wall time, throughput and peak memory use
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void usage() {
+    std::cout << "Usage: runstat [-l label] [-n files] [-b bytes] [-i input] [-o output] [-a report] [-t seconds] [-H] command [args ...]" << std::endl << std::endl;
+    std::cout << "\t-l\tLabel of the result line (default: the command name)" << std::endl;
+    std::cout << "\t-n\tNumber of files processed by the command, used for files/s" << std::endl;
+    std::cout << "\t-b\tNumber of bytes processed by the command, used for MB/s" << std::endl;
+    std::cout << "\t-i\tRedirect the standard input of the command from this file" << std::endl;
+    std::cout << "\t-o\tRedirect the standard output of the command to this file" << std::endl;
+    std::cout << "\t-a\tAppend the result line to this file instead of printing it" << std::endl;
+    std::cout << "\t-t\tKill the command after this many seconds, the status is then 124" << std::endl;
+    std::cout << "\t-H\tPrint the header line of the result table and exit" << std::endl;
+}
+
+static const char* header = "label\tfiles\tbytes\twall_s\tfiles_per_s\tmb_per_s\tpeak_rss_kb\tstatus";
+
+static pid_t                 child     = 0;
+static volatile sig_atomic_t timed_out = 0;
+
+static void on_alarm(int) {
+    timed_out = 1;
+    ::kill(child, SIGKILL);
+}
+
+static void redirect(const char* path, int target, int flags) {
+    int fd = ::open(path, flags, 0644);
+    if ((fd < 0) || (::dup2(fd, target) < 0)) {
+        std::cerr << "Unable to redirect to " << path << " (" << std::strerror(errno) << ")" << std::endl;
+        std::_Exit(127);
+    }
+    ::close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    std::string label;
+    uint64_t    files   = 0;
+    uint64_t    bytes   = 0;
+    const char* input   = nullptr;
+    const char* output  = nullptr;
+    const char* report  = nullptr;
+    unsigned    timeout = 0;
+
+    while (true) {
+        /* stop at the first non-option so that the options of the command are left alone */
+        char c = ::getopt(argc, argv, "+hHl:n:b:i:o:a:t:");
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'l': label = optarg; break;
+            case 'n': files = std::strtoull(optarg, nullptr, 10); break;
+            case 'b': bytes = std::strtoull(optarg, nullptr, 10); break;
+            case 'i': input = optarg; break;
+            case 'o': output = optarg; break;
+            case 'a': report = optarg; break;
+            case 't': timeout = std::atol(optarg); break;
+            case 'H': std::cout << header << std::endl; return 0;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
+        }
+    }
+
+    if (optind == argc) {
+        usage();
+        return 1;
+    }
+    if (label.empty()) {
+        label = argv[optind];
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pid_t                                 pid   = ::fork();
+    if (pid < 0) {
+        std::cerr << "Unable to fork (" << std::strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+    if (pid == 0) {
+        if (input) {
+            redirect(input, STDIN_FILENO, O_RDONLY);
+        }
+        if (output) {
+            redirect(output, STDOUT_FILENO, O_WRONLY | O_CREAT | O_TRUNC);
+        }
+        ::execvp(argv[optind], &argv[optind]);
+        std::cerr << "Unable to run " << argv[optind] << " (" << std::strerror(errno) << ")" << std::endl;
+        std::_Exit(127);
+    }
+
+    child = pid;
+    if (timeout != 0) {
+        ::signal(SIGALRM, on_alarm);
+        ::alarm(timeout);
+    }
+
+    int           status;
+    struct rusage usage;
+    int           ret;
+    while (((ret = ::wait4(pid, &status, 0, &usage)) < 0) && (errno == EINTR)) {}
+    if (ret < 0) {
+        std::cerr << "Unable to wait for " << argv[optind] << " (" << std::strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+    double seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int    exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (timed_out) {
+        exit_code = 124;
+    }
+
+    std::ofstream report_file;
+    std::ostream* out = &std::cout;
+    if (report) {
+        report_file.open(report, std::ios::out | std::ios::app);
+        out = &report_file;
+    }
+    /* ru_maxrss is in kilobytes on Linux */
+    *out << label << '\t' << files << '\t' << bytes << '\t' << seconds << '\t'
+         << (seconds > 0 ? files / seconds : 0.) << '\t'
+         << (seconds > 0 ? bytes / seconds / (1024. * 1024.) : 0.) << '\t' << usage.ru_maxrss << '\t'
+         << exit_code << std::endl;
+    return exit_code;
+}
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+#  scaletest.sh - run mkbom, ls4mkbom and lsbom against synthetic inputs of growing size
+#
+#  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2, or (at your option)
+#  any later version.
+#  
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#  
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+#
+#  Initial work done by Joseph Coffland and Julian Devlin.
+#  Numerous further improvements by Baron Roberts.
+#
+#  All settings are taken from the environment:
+#    BIN_DIR             directory with the tools and benchmarks (build/bin)
+#    SCALE_SIZES         number of entries of each run (10000 100000 1000000 10000000)
+#    SCALE_TREE_MAX      largest run that also creates the tree on disk (100000)
+#    SCALE_THREADS       thread counts to try when a tool supports -j (1 2 4 8)
+#    SCALE_TIMEOUT       seconds after which a single command is killed (3600)
+#    SCALE_GENTREE_ARGS  extra options for gentree (-s exp:1024)
+#    SCALE_DIR           scratch directory (a new directory below /tmp)
+#    SCALE_REPORT        result table (build/scale.tsv)
+
+BIN_DIR=${BIN_DIR:-build/bin}
+SIZES=${SCALE_SIZES:-"10000 100000 1000000 10000000"}
+TREE_MAX=${SCALE_TREE_MAX:-100000}
+THREADS=${SCALE_THREADS:-"1 2 4 8"}
+TIMEOUT=${SCALE_TIMEOUT:-3600}
+GENTREE_ARGS=${SCALE_GENTREE_ARGS:-"-s exp:1024"}
+REPORT=${SCALE_REPORT:-build/scale.tsv}
+WORK_DIR=${SCALE_DIR:-$(mktemp -d /tmp/bomutils-scale.XXXXXX)}
+
+mkdir -p "$WORK_DIR" || exit 1
+trap 'rm -rf "$WORK_DIR"' EXIT INT TERM
+
+# prints the thread counts to try for a tool, or 0 if a single run has no -j option: only the
+# first usage line counts, mkbom lists -j on a second line that is about --batch
+thread_counts() {
+    if "$BIN_DIR/$1" -h 2>&1 | head -n 1 | grep -q -e '\[-j'; then
+        echo "$THREADS"
+    else
+        echo 0
+    fi
+}
+
+# run label files bytes [runstat options] -- command ...
+run() {
+    label=$1 files=$2 bytes=$3
+    shift 3
+    "$BIN_DIR/runstat" -t "$TIMEOUT" -a "$REPORT" -l "$label" -n "$files" -b "$bytes" "$@" ||
+        echo "$label failed with status $?" >&2
+}
+
+jobs_option() {
+    if [ "$1" -ne 0 ]; then
+        echo "-j $1"
+    fi
+}
+
+"$BIN_DIR/runstat" -H > "$REPORT"
+for n in $SIZES; do
+    manifest="$WORK_DIR/list-$n.txt"
+    tree="$WORK_DIR/tree-$n"
+    bom="$WORK_DIR/$n.bom"
+    if [ "$n" -le "$TREE_MAX" ]; then
+        echo "Generating tree with $n entries" >&2
+        summary=$("$BIN_DIR/gentree" $GENTREE_ARGS -n "$n" -m "$manifest" "$tree" 2>&1) || exit 1
+    else
+        echo "Generating file list with $n entries" >&2
+        summary=$("$BIN_DIR/gentree" $GENTREE_ARGS -n "$n" -m "$manifest" 2>&1) || exit 1
+    fi
+    bytes=$(echo "$summary" | sed -n 's/.*bytes=\([0-9]*\).*/\1/p')
+    list_bytes=$(wc -c < "$manifest")
+
+    if [ -d "$tree" ]; then
+        for j in $(thread_counts ls4mkbom); do
+            run "ls4mkbom/$n/j$j" "$n" "$bytes" -o /dev/null "$BIN_DIR/ls4mkbom" $(jobs_option "$j") "$tree"
+        done
+        for j in $(thread_counts mkbom); do
+            run "mkbom/$n/j$j" "$n" "$bytes" "$BIN_DIR/mkbom" $(jobs_option "$j") "$tree" "$bom"
+        done
+        rm -rf "$tree"
+    fi
+    for j in $(thread_counts mkbom); do
+        run "mkbom-i/$n/j$j" "$n" "$list_bytes" "$BIN_DIR/mkbom" $(jobs_option "$j") -i "$manifest" "$bom"
+    done
+    if [ -f "$bom" ]; then
+        run "lsbom/$n" "$n" "$(wc -c < "$bom")" -o /dev/null "$BIN_DIR/lsbom" "$bom"
+    fi
+    rm -f "$manifest" "$bom"
+done
+
+if command -v column > /dev/null; then
+    column -t -s "$(printf '\t')" "$REPORT"
+else
+    cat "$REPORT"
+fi
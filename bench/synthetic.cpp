@@ -0,0 +1,67 @@
+/*
+  synthetic.cpp - generate synthetic file lists for the benchmarks
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <deque>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#include "synthetic.hpp"
+
+void generate_manifest(std::ostream& output, std::vector<std::string>* paths, uint32_t num_entries,
+                       uint32_t dir_fanout, uint32_t seed) {
+    std::mt19937            rng(seed);
+    std::deque<std::string> dirs;
+    uint32_t                written = 0;
+
+    if (dir_fanout < 1) {
+        dir_fanout = 1;
+    }
+    if (num_entries == 0) {
+        return;
+    }
+    output << ".\t40755\t0/80\n";
+    if (paths) {
+        paths->push_back(".");
+    }
+    dirs.push_back(".");
+    written++;
+    while ((written < num_entries) && (dirs.empty() == false)) {
+        std::string dir = dirs.front();
+        dirs.pop_front();
+        for (uint32_t i = 0; (i < dir_fanout) && (written < num_entries); ++i, ++written) {
+            std::stringstream name;
+            bool              is_dir = ((i % 8) == 0) || (dirs.empty() && (i + 1 == dir_fanout));
+            name << dir << "/" << (is_dir ? "dir" : "file") << std::setw(6) << std::setfill('0') << i;
+            if (is_dir) {
+                output << name.str() << "\t40755\t0/80\n";
+                dirs.push_back(name.str());
+            } else {
+                output << name.str() << "\t100644\t0/80\t" << (rng() % (1024 * 1024)) << "\t"
+                       << rng() << "\n";
+            }
+            if (paths) {
+                paths->push_back(name.str());
+            }
+        }
+    }
+}
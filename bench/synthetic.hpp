@@ -0,0 +1,34 @@
+/*
+  synthetic.hpp - generate synthetic file lists for the benchmarks
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* Writes a file list in the format generated by ls4mkbom with num_entries entries (including
+   the root "."). Every directory gets dir_fanout children, one in eight of them is a directory.
+   If paths is not null the generated paths are appended to it in output order. */
+void generate_manifest(std::ostream& output, std::vector<std::string>* paths, uint32_t num_entries,
+                       uint32_t dir_fanout, uint32_t seed);
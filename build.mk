@@ -20,63 +20,159 @@
 #  Initial work done by Joseph Coffland and Julian Devlin.
 #  Numerous further improvements by Baron Roberts.
 OPTFLAGS=-O2 -g0 -mtune=native
+# flags needed to compile and link code using std::thread
+THREAD_FLAGS?=-pthread
+# flags for the objects of the shared library
+PIC_FLAGS?=-fPIC
+SHARED_SUFFIX?=.so
 
 APP_SOURCES=\
 	mkbom.cpp \
 	dumpbom.cpp \
 	lsbom.cpp \
-	ls4mkbom.cpp
+	ls4mkbom.cpp \
+	bomverify.cpp \
+	manifestconv.cpp
 
+# the sources of libbomutils, the tools are linked against its static version
 COMMON_SOURCES=\
+	bomutils.cpp \
 	printnode.cpp \
-	crc32.cpp
+	writebom.cpp \
+	nodetree.cpp \
+	bomreader.cpp \
+	mappedfile.cpp \
+	crc32.cpp \
+	stats.cpp \
+	trace.cpp \
+	binmanifest.cpp \
+	pathfilter.cpp \
+	bomstreamwriter.cpp \
+	externalbom.cpp \
+	payload.cpp \
+	archivereader.cpp \
+	xar.cpp \
+	buildcache.cpp \
+	watch.cpp \
+	batch.cpp \
+	idnames.cpp
+
+# bomutils.hpp and the headers it includes, and payload.hpp
+LIB_HEADERS=\
+	src/bomutils.hpp \
+	src/archivereader.hpp \
+	src/bom.h \
+	src/bomreader.hpp \
+	src/boundedqueue.hpp \
+	src/crc32.hpp \
+	src/externalbom.hpp \
+	src/mappedfile.hpp \
+	src/nodetree.hpp \
+	src/pathfilter.hpp \
+	src/payload.hpp \
+	src/printnode.hpp \
+	src/writebom.hpp
+
+BENCH_SOURCES=\
+	bombench.cpp \
+	fanoutbench.cpp \
+	gentree.cpp \
+	runstat.cpp
+
+BENCH_COMMON_SOURCES=\
+	synthetic.cpp
 
 BUILD_DIR=build
 BUILD_BIN_DIR=$(BUILD_DIR)/bin
 BUILD_OBJ_DIR=$(BUILD_DIR)/obj
+BUILD_PIC_DIR=$(BUILD_DIR)/obj/pic
+BUILD_LIB_DIR=$(BUILD_DIR)/lib
 BUILD_MAN_DIR=$(BUILD_DIR)/man
 
 SOURCES=$(APP_SOURCES) $(COMMON_SOURCES)
-DEPS=$(addprefix $(BUILD_OBJ_DIR)/,$(SOURCES:.cpp=.d))
+DEPS=$(addprefix $(BUILD_OBJ_DIR)/,$(SOURCES:.cpp=.d) $(BENCH_SOURCES:.cpp=.d) $(BENCH_COMMON_SOURCES:.cpp=.d))
 COMMON_OBJECTS=$(addprefix $(BUILD_OBJ_DIR)/,$(COMMON_SOURCES:.cpp=.o))
+PIC_OBJECTS=$(addprefix $(BUILD_PIC_DIR)/,$(COMMON_SOURCES:.cpp=.o))
+STATIC_LIB=$(BUILD_LIB_DIR)/libbomutils.a
+SHARED_LIB=$(BUILD_LIB_DIR)/libbomutils$(SHARED_SUFFIX)
 APP_NAMES=$(addsuffix $(SUFFIX),$(APP_SOURCES:.cpp=))
 APPS=$(addprefix $(BUILD_BIN_DIR)/,$(APP_NAMES))
+BENCH_COMMON_OBJECTS=$(addprefix $(BUILD_OBJ_DIR)/,$(BENCH_COMMON_SOURCES:.cpp=.o))
+BENCH_NAMES=$(addsuffix $(SUFFIX),$(BENCH_SOURCES:.cpp=))
+BENCH_APPS=$(addprefix $(BUILD_BIN_DIR)/,$(BENCH_NAMES))
 MAN=$(addprefix $(BUILD_MAN_DIR)/,$(APP_SOURCES:.cpp=.1.gz))
 GIT_VERSION=$(shell if ( git tag 2>&1 ) > /dev/null; then git tag | tail -n 1; else echo unknown; fi)
 ROOT_DIRECTORY_NAME=$(shell basename $${PWD})
 
-vpath %.cpp src
+INCLUDES=-Isrc
+
+vpath %.cpp src bench
 vpath %.1 man
 
-.PHONY: $(APP_NAMES) all install clean dist
-.PRECIOUS: $(BUILD_OBJ_DIR)/%.o $(BUILD_OBJ_DIR)/%.d
+.PHONY: $(APP_NAMES) $(BENCH_NAMES) all lib benchmarks bench scale-test install clean dist
+.PRECIOUS: $(BUILD_OBJ_DIR)/%.o $(BUILD_OBJ_DIR)/%.d $(BUILD_PIC_DIR)/%.o
+
+all : $(APPS) $(MAN) lib
+
+lib : $(STATIC_LIB) $(SHARED_LIB)
+
+benchmarks : $(BENCH_APPS)
+
+# Runs the micro-benchmarks and stores the results (one JSON object per line) in
+# $(BUILD_DIR)/bench.json. Pass e.g. BENCH_ARGS="-f crc32 -t 1" to select and tune them.
+bench : benchmarks
+	$(BUILD_BIN_DIR)/bombench$(SUFFIX) $(BENCH_ARGS) | tee $(BUILD_DIR)/bench.json
 
-all : $(APPS) $(MAN)
+# Runs the tools against synthetic trees and file lists of 10k to 10M entries and writes
+# the timings to $(BUILD_DIR)/scale.tsv. See bench/scaletest.sh for the SCALE_* settings.
+scale-test : $(APPS) benchmarks
+	BIN_DIR=$(BUILD_BIN_DIR) SCALE_REPORT=$(BUILD_DIR)/scale.tsv sh bench/scaletest.sh
 
 install : all
 	install -d $(DESTDIR)$(BIN_DIR)
 	install -d $(DESTDIR)$(MAN_DIR)/man1
 	install -m 0755 $(APPS) $(DESTDIR)$(BIN_DIR)
 	install -m 0644 $(MAN) $(DESTDIR)$(MAN_DIR)/man1
+	install -d $(DESTDIR)$(LIB_DIR)
+	install -d $(DESTDIR)$(INCLUDE_DIR)/bomutils
+	install -m 0644 $(STATIC_LIB) $(DESTDIR)$(LIB_DIR)
+	install -m 0755 $(SHARED_LIB) $(DESTDIR)$(LIB_DIR)
+	install -m 0644 $(LIB_HEADERS) $(DESTDIR)$(INCLUDE_DIR)/bomutils
 
 $(BUILD_OBJ_DIR)/%.o : %.cpp
 	@mkdir -p $(BUILD_OBJ_DIR)
-	$(CXX) -o $@ -c $(OPTFLAGS) $(CXXFLAGS) $(CFLAGS) $<
+	$(CXX) -o $@ -c $(OPTFLAGS) $(THREAD_FLAGS) $(CXXFLAGS) $(CFLAGS) $(INCLUDES) $<
+
+$(BUILD_PIC_DIR)/%.o : %.cpp
+	@mkdir -p $(BUILD_PIC_DIR)
+	$(CXX) -o $@ -c $(OPTFLAGS) $(PIC_FLAGS) $(THREAD_FLAGS) $(CXXFLAGS) $(CFLAGS) $(INCLUDES) $<
 
 $(BUILD_OBJ_DIR)/%.d : %.cpp
 	@mkdir -p $(BUILD_OBJ_DIR)
-	@set -e; rm -f $@; $(CXX) -MM $(OPTFLAGS) $(CXXFLAGS) $(CFLAGS) $< > $@.$$$$; \
-	sed -e 's,\($*\)\.o[ :]*,$(BUILD_OBJ_DIR)/\1.o $@ : ,g' < $@.$$$$ > $@; rm -f $@.$$$$
+	@set -e; rm -f $@; $(CXX) -MM $(OPTFLAGS) $(THREAD_FLAGS) $(CXXFLAGS) $(CFLAGS) $(INCLUDES) $< > $@.$$$$; \
+	sed -e 's,\($*\)\.o[ :]*,$(BUILD_OBJ_DIR)/\1.o $(BUILD_PIC_DIR)/\1.o $@ : ,g' < $@.$$$$ > $@; rm -f $@.$$$$
+
+$(STATIC_LIB) : $(COMMON_OBJECTS)
+	@mkdir -p $(BUILD_LIB_DIR)
+	rm -f $@
+	$(AR) rcs $@ $^
 
-$(BUILD_BIN_DIR)/%$(SUFFIX) : $(BUILD_OBJ_DIR)/%.o $(COMMON_OBJECTS)
+$(SHARED_LIB) : $(PIC_OBJECTS)
+	@mkdir -p $(BUILD_LIB_DIR)
+	$(CXX) -shared -o $@ $(THREAD_FLAGS) $(LDFLAGS) $^ $(LIBS)
+
+# the library goes last, after the objects that use it
+$(BUILD_BIN_DIR)/%$(SUFFIX) : $(BUILD_OBJ_DIR)/%.o $(STATIC_LIB)
 	@mkdir -p $(BUILD_BIN_DIR)
-	$(CXX) -o $@ $(LDFLAGS) $^ $(LIBS)
+	$(CXX) -o $@ $(THREAD_FLAGS) $(LDFLAGS) $(filter-out $(STATIC_LIB),$^) $(STATIC_LIB) $(LIBS)
+
+$(BENCH_APPS) : $(BENCH_COMMON_OBJECTS)
 
 $(BUILD_MAN_DIR)/%.1.gz : %.1
 	@mkdir -p $(BUILD_MAN_DIR)
 	gzip -c $< > $@
 
-$(APP_NAMES) :
+$(APP_NAMES) $(BENCH_NAMES) :
 	$(MAKE) $(BUILD_BIN_DIR)/$@
 
 -include $(DEPS)
@@ -0,0 +1,476 @@
+/*
+  archivereader.cpp - read the members of a tar or cpio archive as a stream
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+#include "archivereader.hpp"
+
+/* bytes read from the stream at a time, and the size of the buffer used to skip data */
+#define INPUT_BUFFER_SIZE (256 * 1024)
+#define SKIP_BUFFER_SIZE  (64 * 1024)
+
+#define TAR_BLOCK_SIZE   512
+#define ODC_HEADER_SIZE  76
+#define NEWC_HEADER_SIZE 110
+#define MAGIC_SIZE       6
+#define CPIO_TRAILER     "TRAILER!!!"
+
+/* The bytes of the archive, inflated if the stream starts with the gzip magic. Concatenated
+   gzip members are read one after the other, anything else after the last one is ignored. */
+class ArchiveInput {
+    private:
+        std::istream&     input;
+        std::vector<char> buffer;
+        std::size_t       pos;
+        std::size_t       end;
+        bool              gzip;
+        bool              streamEnded; // at the end of a gzip member
+        z_stream          z;
+
+        ArchiveInput(ArchiveInput const&);
+        ArchiveInput& operator=(ArchiveInput const&);
+
+        bool refill() {
+            input.read(buffer.data(), buffer.size());
+            pos = 0;
+            end = input.gcount();
+            return end > 0;
+        }
+
+    public:
+        explicit ArchiveInput(std::istream& i)
+            : input(i)
+            , buffer(INPUT_BUFFER_SIZE)
+            , pos(0)
+            , end(0)
+            , gzip(false)
+            , streamEnded(false) {
+            refill();
+            if ((end >= 2) && ((uint8_t)buffer[0] == 0x1f) && ((uint8_t)buffer[1] == 0x8b)) {
+                std::memset(&z, 0, sizeof(z));
+                /* 16 + 15: a gzip stream with a window of up to 32k */
+                if (::inflateInit2(&z, 16 + 15) != Z_OK) {
+                    throw std::runtime_error("Unable to initialize the decompression of the archive");
+                }
+                gzip = true;
+            }
+        }
+
+        ~ArchiveInput() {
+            if (gzip) {
+                ::inflateEnd(&z);
+            }
+        }
+
+        /* returns less than length bytes only at the end of the archive */
+        std::size_t read(char* data, std::size_t length) {
+            std::size_t done = 0;
+            while (done < length) {
+                if (pos == end) {
+                    refill();
+                }
+                if (gzip == false) {
+                    if (pos == end) {
+                        break;
+                    }
+                    std::size_t n = std::min(length - done, end - pos);
+                    std::memcpy(data + done, &buffer[pos], n);
+                    pos += n;
+                    done += n;
+                    continue;
+                }
+                if (streamEnded) {
+                    if ((pos == end) || ((uint8_t)buffer[pos] != 0x1f)) {
+                        break;
+                    }
+                    ::inflateReset(&z);
+                    streamEnded = false;
+                }
+                z.next_in   = (Bytef*)&buffer[pos];
+                z.avail_in  = end - pos;
+                z.next_out  = (Bytef*)(data + done);
+                z.avail_out = length - done;
+                int ret     = ::inflate(&z, Z_NO_FLUSH);
+                pos         = end - z.avail_in;
+                done        = length - z.avail_out;
+                if (ret == Z_STREAM_END) {
+                    streamEnded = true;
+                } else if (ret == Z_BUF_ERROR) {
+                    if (pos == end) {
+                        break; // the compressed stream is truncated
+                    }
+                } else if (ret != Z_OK) {
+                    throw std::runtime_error("Invalid gzip data in archive");
+                }
+            }
+            return done;
+        }
+};
+
+/* parses a number field of a header, surrounding spaces and NULs are allowed */
+static uint64_t parse_number(const char* field, std::size_t length, unsigned int base) {
+    std::size_t i = 0;
+    while ((i < length) && (field[i] == ' ')) {
+        ++i;
+    }
+    uint64_t value = 0;
+    for (; i < length; ++i) {
+        char         c = field[i];
+        unsigned int digit;
+        if ((c >= '0') && (c <= '9')) {
+            digit = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            digit = c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            throw std::runtime_error("Invalid number in archive header");
+        }
+        value = value * base + digit;
+    }
+    for (; i < length; ++i) {
+        if ((field[i] != ' ') && (field[i] != '\0')) {
+            throw std::runtime_error("Invalid number in archive header");
+        }
+    }
+    return value;
+}
+
+/* tar numbers are octal, or big endian binary if the high bit of the first byte is set */
+static uint64_t parse_tar_number(const char* field, std::size_t length) {
+    if ((field[0] & 0x80) == 0) {
+        return parse_number(field, length, 8);
+    }
+    if ((uint8_t)field[0] == 0xff) {
+        throw std::runtime_error("Negative number in tar header");
+    }
+    uint64_t value = field[0] & 0x7f;
+    for (std::size_t i = 1; i < length; ++i) {
+        if (value >> 56) {
+            throw std::runtime_error("Number too large in tar header");
+        }
+        value = (value << 8) | (uint8_t)field[i];
+    }
+    return value;
+}
+
+/* a string field of a tar header, NUL terminated unless it fills the field */
+static std::string tar_string(const char* field, std::size_t length) {
+    return std::string(field, std::find(field, field + length, '\0'));
+}
+
+/* compares the checksum of a tar header, computed with the checksum field filled with spaces,
+   to the stored one; some old implementations summed signed chars */
+static bool valid_tar_header(const char* h) {
+    uint64_t stored;
+    try {
+        stored = parse_number(h + 148, 8, 8);
+    } catch (std::runtime_error const&) {
+        return false;
+    }
+    uint64_t unsigned_sum = 8 * ' ';
+    int64_t  signed_sum   = 8 * ' ';
+    for (int i = 0; i < TAR_BLOCK_SIZE; ++i) {
+        if ((i < 148) || (i >= 156)) {
+            unsigned_sum += (uint8_t)h[i];
+            signed_sum += (signed char)h[i];
+        }
+    }
+    return (stored == unsigned_sum) || ((int64_t)stored == signed_sum);
+}
+
+/* adds the "length key=value\n" records of a pax extended header to attributes */
+static void parse_pax(std::string const& records, std::map<std::string, std::string>& attributes) {
+    std::size_t pos = 0;
+    while (pos < records.size()) {
+        std::size_t space  = records.find(' ', pos);
+        uint64_t    length = std::strtoull(records.c_str() + pos, nullptr, 10);
+        if ((space == std::string::npos) || (length == 0) || (pos + length > records.size()) ||
+            (records[pos + length - 1] != '\n')) {
+            if (records.find_first_not_of('\0', pos) == std::string::npos) {
+                break;
+            }
+            throw std::runtime_error("Invalid pax extended header");
+        }
+        std::string record = records.substr(space + 1, pos + length - 1 - (space + 1));
+        std::size_t equals = record.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error("Invalid pax extended header");
+        }
+        attributes[record.substr(0, equals)] = record.substr(equals + 1);
+        pos += length;
+    }
+}
+
+ArchiveReader::ArchiveReader(std::istream& i)
+    : input(new ArchiveInput(i))
+    , format(kTarArchive)
+    , started(false)
+    , ended(false)
+    , remaining(0)
+    , padding(0)
+    , header(TAR_BLOCK_SIZE) {}
+
+ArchiveReader::~ArchiveReader() {}
+
+void ArchiveReader::readFully(char* data, std::size_t length) {
+    if (input->read(data, length) != length) {
+        throw std::runtime_error("Unexpected end of archive");
+    }
+}
+
+void ArchiveReader::skip(uint64_t length) {
+    char buffer[SKIP_BUFFER_SIZE];
+    while (length) {
+        std::size_t n = std::min<uint64_t>(length, sizeof(buffer));
+        readFully(buffer, n);
+        length -= n;
+    }
+}
+
+std::string ArchiveReader::readString(uint64_t length) {
+    if (length > INPUT_BUFFER_SIZE) {
+        throw std::runtime_error("Archive header too large");
+    }
+    std::string s(length, '\0');
+    readFully(&s[0], length);
+    return s;
+}
+
+bool ArchiveReader::next(ArchiveMember& m) {
+    if (ended) {
+        return false;
+    }
+    skip(remaining + padding);
+    remaining = 0;
+    padding   = 0;
+
+    std::size_t prefetched = 0;
+    if (started == false) {
+        /* the magic of cpio archives, tar headers are told apart by their checksum */
+        started    = true;
+        prefetched = input->read(header.data(), MAGIC_SIZE);
+        if (prefetched == 0) {
+            throw std::runtime_error("The archive is empty");
+        }
+        if (prefetched == MAGIC_SIZE) {
+            if (std::memcmp(header.data(), "070707", MAGIC_SIZE) == 0) {
+                format = kOdcArchive;
+            } else if ((std::memcmp(header.data(), "070701", MAGIC_SIZE) == 0) ||
+                       (std::memcmp(header.data(), "070702", MAGIC_SIZE) == 0)) {
+                format = kNewcArchive;
+            }
+        }
+    }
+
+    m.linkName.clear();
+    m.hardLink = false;
+    m.nlink    = 1;
+    m.dev      = 0;
+    m.ino      = 0;
+    switch (format) {
+        case kOdcArchive:
+            readFully(header.data() + prefetched, ODC_HEADER_SIZE - prefetched);
+            return nextOdc(m);
+        case kNewcArchive:
+            readFully(header.data() + prefetched, NEWC_HEADER_SIZE - prefetched);
+            return nextNewc(m);
+        default:
+            readFully(header.data() + prefetched, TAR_BLOCK_SIZE - prefetched);
+            return nextTar(m, prefetched != 0);
+    }
+}
+
+bool ArchiveReader::nextOdc(ArchiveMember& m) {
+    const char* h = header.data();
+    if (std::memcmp(h, "070707", MAGIC_SIZE) != 0) {
+        throw std::runtime_error("Invalid cpio header");
+    }
+    m.dev              = parse_number(h + 6, 6, 8);
+    m.ino              = parse_number(h + 12, 6, 8);
+    m.mode             = parse_number(h + 18, 6, 8);
+    m.uid              = parse_number(h + 24, 6, 8);
+    m.gid              = parse_number(h + 30, 6, 8);
+    m.nlink            = parse_number(h + 36, 6, 8);
+    m.mtime            = parse_number(h + 48, 11, 8);
+    uint64_t name_size = parse_number(h + 59, 6, 8);
+    m.size             = parse_number(h + 65, 11, 8);
+    std::string name   = readString(name_size);
+    m.path             = name.c_str();
+    if (m.path == CPIO_TRAILER) {
+        ended = true;
+        return false;
+    }
+    if (S_ISLNK(m.mode)) {
+        m.linkName = readString(m.size).c_str();
+        m.size     = 0;
+    }
+    remaining = m.size;
+    return true;
+}
+
+bool ArchiveReader::nextNewc(ArchiveMember& m) {
+    const char* h = header.data();
+    if ((std::memcmp(h, "070701", MAGIC_SIZE) != 0) && (std::memcmp(h, "070702", MAGIC_SIZE) != 0)) {
+        throw std::runtime_error("Invalid cpio header");
+    }
+    m.ino              = parse_number(h + 6, 8, 16);
+    m.mode             = parse_number(h + 14, 8, 16);
+    m.uid              = parse_number(h + 22, 8, 16);
+    m.gid              = parse_number(h + 30, 8, 16);
+    m.nlink            = parse_number(h + 38, 8, 16);
+    m.mtime            = parse_number(h + 46, 8, 16);
+    m.size             = parse_number(h + 54, 8, 16);
+    m.dev              = (parse_number(h + 62, 8, 16) << 32) | parse_number(h + 70, 8, 16);
+    uint64_t name_size = parse_number(h + 94, 8, 16);
+    /* the name and the contents are padded to a multiple of four bytes */
+    std::string name = readString(name_size);
+    skip((4 - (NEWC_HEADER_SIZE + name_size) % 4) % 4);
+    m.path = name.c_str();
+    if (m.path == CPIO_TRAILER) {
+        ended = true;
+        return false;
+    }
+    if (S_ISLNK(m.mode)) {
+        m.linkName = readString(m.size).c_str();
+        skip((4 - m.size % 4) % 4);
+        m.size = 0;
+    }
+    remaining = m.size;
+    padding   = (4 - m.size % 4) % 4;
+    return true;
+}
+
+bool ArchiveReader::nextTar(ArchiveMember& m, bool first) {
+    std::map<std::string, std::string> pax(globalPax);
+    std::string                        long_name;
+    std::string                        long_link;
+    while (true) {
+        const char* h = header.data();
+        if (std::count(header.begin(), header.end(), '\0') == TAR_BLOCK_SIZE) {
+            /* the end of archive marker, the second zero block is not read */
+            ended = true;
+            return false;
+        }
+        if (valid_tar_header(h) == false) {
+            throw std::runtime_error(first ? "Unrecognized archive format, only tar and cpio archives are supported"
+                                           : "Invalid tar header checksum");
+        }
+        uint64_t size       = parse_tar_number(h + 124, 12);
+        uint64_t block_rest = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+        char     type       = h[156];
+        switch (type) {
+            case 'x':
+                parse_pax(readString(size), pax);
+                skip(block_rest);
+                break;
+            case 'g': {
+                std::string records = readString(size);
+                parse_pax(records, globalPax);
+                parse_pax(records, pax);
+                skip(block_rest);
+                break;
+            }
+            case 'L':
+                long_name = readString(size).c_str();
+                skip(block_rest);
+                break;
+            case 'K':
+                long_link = readString(size).c_str();
+                skip(block_rest);
+                break;
+            case 'V':
+                skip(size + block_rest); // volume label
+                break;
+            case 'M':
+            case 'S':
+                throw std::runtime_error("Multi-volume and sparse tar members are not supported");
+            default: {
+                std::string name = tar_string(h, 100);
+                if ((std::memcmp(h + 257, "ustar", 6) == 0) && (h[345] != '\0')) {
+                    name = tar_string(h + 345, 155) + "/" + name; // POSIX ustar prefix
+                }
+                m.path     = long_name.empty() ? name : long_name;
+                m.linkName = long_link.empty() ? tar_string(h + 157, 100) : long_link;
+                m.uid      = parse_tar_number(h + 108, 8);
+                m.gid      = parse_tar_number(h + 116, 8);
+                m.mtime    = parse_tar_number(h + 136, 12);
+                m.size     = size;
+                for (std::map<std::string, std::string>::const_iterator it = pax.begin(); it != pax.end(); ++it) {
+                    if (it->first == "path") {
+                        m.path = it->second;
+                    } else if (it->first == "linkpath") {
+                        m.linkName = it->second;
+                    } else if (it->first == "uid") {
+                        m.uid = std::strtoul(it->second.c_str(), nullptr, 10);
+                    } else if (it->first == "gid") {
+                        m.gid = std::strtoul(it->second.c_str(), nullptr, 10);
+                    } else if (it->first == "mtime") {
+                        m.mtime = std::strtoll(it->second.c_str(), nullptr, 10);
+                    } else if (it->first == "size") {
+                        m.size = std::strtoull(it->second.c_str(), nullptr, 10);
+                    }
+                }
+                uint32_t file_type;
+                switch (type) {
+                    case '1': file_type = S_IFREG; m.hardLink = true; break;
+                    case '2': file_type = S_IFLNK; break;
+                    case '3': file_type = S_IFCHR; break;
+                    case '4': file_type = S_IFBLK; break;
+                    case '5':
+                    case 'D': file_type = S_IFDIR; break; // 'D' is a GNU directory with a list of its contents
+                    case '6': file_type = S_IFIFO; break;
+                    default:
+                        /* v7 archives mark directories with a trailing slash, unknown types are files */
+                        file_type = ((m.path.empty() == false) && (m.path[m.path.size() - 1] == '/')) ? S_IFDIR
+                                                                                                       : S_IFREG;
+                        break;
+                }
+                m.mode = (parse_tar_number(h + 100, 8) & 07777) | file_type;
+                if ((file_type != S_IFLNK) && (m.hardLink == false)) {
+                    m.linkName.clear();
+                }
+                remaining = m.size;
+                padding   = (TAR_BLOCK_SIZE - m.size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+                return true;
+            }
+        }
+        readFully(header.data(), TAR_BLOCK_SIZE);
+        first = false;
+    }
+}
+
+std::size_t ArchiveReader::read(uint8_t* buffer, std::size_t length) {
+    std::size_t n = std::min<uint64_t>(length, remaining);
+    readFully((char*)buffer, n);
+    remaining -= n;
+    return n;
+}
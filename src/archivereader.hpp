@@ -0,0 +1,85 @@
+/*
+  archivereader.hpp - read the members of a tar or cpio archive as a stream
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* one member of an archive */
+struct ArchiveMember {
+    std::string path;     // as stored in the archive
+    uint32_t    mode;     // including the file type bits
+    uint32_t    uid;
+    uint32_t    gid;
+    int64_t     mtime;
+    uint64_t    size;     // bytes of contents that read() returns
+    std::string linkName; // the target of a symbolic or hard link
+    bool        hardLink; // a tar hard link to the earlier member linkName
+    uint32_t    nlink;    // cpio only, 1 for tar members
+    uint64_t    dev;      // cpio only, with ino identifies the members that are hard links of each other
+    uint64_t    ino;
+};
+
+class ArchiveInput;
+
+/* Reads tar (v7, ustar, GNU and pax) and cpio (odc and newc) archives from a stream, without
+   seeking, optionally gzip compressed. The format and the compression are detected from the
+   first bytes. The contents of symbolic links are returned in linkName, those of other members
+   through read(). All methods throw std::runtime_error on a truncated or malformed archive. */
+class ArchiveReader {
+    private:
+        typedef enum { kTarArchive, kOdcArchive, kNewcArchive } archive_format_t;
+
+        std::unique_ptr<ArchiveInput>      input;
+        archive_format_t                   format;
+        bool                               started;
+        bool                               ended;
+        uint64_t                           remaining; // contents of the current member not read yet
+        uint64_t                           padding;   // bytes after the contents of the current member
+        std::vector<char>                  header;
+        std::map<std::string, std::string> globalPax; // attributes of the pax 'g' headers
+
+        ArchiveReader(ArchiveReader const&);
+        ArchiveReader& operator=(ArchiveReader const&);
+
+        void readFully(char* data, std::size_t length);
+        void skip(uint64_t length);
+        std::string readString(uint64_t length);
+        bool nextTar(ArchiveMember& m, bool first);
+        bool nextOdc(ArchiveMember& m);
+        bool nextNewc(ArchiveMember& m);
+
+    public:
+        explicit ArchiveReader(std::istream& input);
+        ~ArchiveReader();
+
+        /* skips what is left of the current member, returns false after the last one */
+        bool next(ArchiveMember& m);
+
+        /* reads the contents of the current member, returns 0 at its end */
+        std::size_t read(uint8_t* buffer, std::size_t length);
+};
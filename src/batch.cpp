@@ -0,0 +1,194 @@
+/*
+  batch.cpp - building the boms of many directories in one process
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "batch.hpp"
+#include "bomutils.hpp"
+#include "buildcache.hpp"
+#include "printnode.hpp"
+#include "streampipe.hpp"
+#include "trace.hpp"
+
+/* the result of one job */
+struct BatchResult {
+    uint64_t    cost;
+    uint32_t    numEntries;
+    double      seconds;
+    std::string sizing; // error of the walk that estimated the cost, empty if none
+    std::string error;  // empty if the job succeeded
+};
+
+/* parses the uid or gid field of a job, "-" or an empty field gives fallback */
+static uint32_t parse_id(std::string const& field, uint32_t fallback, unsigned int line) {
+    if (field.empty() || (field == "-")) {
+        return fallback;
+    }
+    char*         end;
+    unsigned long value = std::strtoul(field.c_str(), &end, 10);
+    if ((*end != '\0') || (value >= UINT_MAX)) {
+        throw std::runtime_error("Invalid uid or gid in line " + std::to_string(line) + " of the job file: " + field);
+    }
+    return value;
+}
+
+/* the target with its directory resolved, so that "a.bom", "./a.bom" and "link/a.bom", with link
+   a symbolic link to ".", compare equal; the last component is kept, rename replaces it as it is */
+static std::string resolve_target(std::string const& target) {
+    std::size_t slash     = target.rfind('/');
+    std::string directory = (slash == std::string::npos) ? std::string(".") : target.substr(0, slash ? slash : 1);
+#if defined(WINDOWS)
+    char* resolved = ::_fullpath(nullptr, directory.c_str(), 0);
+#else
+    char* resolved = ::realpath(directory.c_str(), nullptr);
+#endif
+    if (resolved == nullptr) {
+        return target; // the job fails once it writes the target
+    }
+    std::string result(resolved);
+    if ((result.empty() == false) && (result[result.size() - 1] != '/')) {
+        result += "/";
+    }
+    result += target.substr(slash + 1);
+    std::free(resolved);
+    return result;
+}
+
+void read_jobs(std::istream& input, uint32_t uid, uint32_t gid, std::vector<BatchJob>& jobs) {
+    std::set<std::string> outputs;
+    std::string           text;
+    for (unsigned int line = 1; std::getline(input, text); ++line) {
+        if ((text.empty() == false) && (text[text.size() - 1] == '\r')) {
+            text.erase(text.size() - 1);
+        }
+        if (text.empty() || (text[0] == '#')) {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::stringstream        ss(text);
+        for (std::string field; std::getline(ss, field, '\t');) {
+            fields.push_back(field);
+        }
+        if ((fields.size() < 2) || (fields.size() > 4) || fields[0].empty() || fields[1].empty()) {
+            throw std::runtime_error("Syntax error in line " + std::to_string(line) +
+                                     " of the job file, expected source, target and optionally uid and gid");
+        }
+        BatchJob job;
+        job.source = fields[0];
+        job.output = fields[1];
+        job.uid    = parse_id(fields.size() > 2 ? fields[2] : std::string(), uid, line);
+        job.gid    = parse_id(fields.size() > 3 ? fields[3] : std::string(), gid, line);
+        if (outputs.insert(resolve_target(job.output)).second == false) {
+            throw std::runtime_error("The target " + job.output + " is listed twice in the job file");
+        }
+        jobs.push_back(job);
+    }
+}
+
+/* calls f(i) for the i in order, on num_threads threads */
+template <typename F>
+static void run_parallel(std::vector<std::size_t> const& order, unsigned int num_threads, F f) {
+    std::atomic<std::size_t> next(0);
+    std::vector<std::thread> workers;
+    num_threads = std::max(1u, std::min<unsigned int>(num_threads, order.size()));
+    for (unsigned int t = 0; t < num_threads; ++t) {
+        workers.push_back(std::thread([&]() {
+            trace_thread_name("batch worker");
+            for (std::size_t i; (i = next.fetch_add(1)) < order.size();) {
+                f(order[i]);
+            }
+        }));
+    }
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+}
+
+unsigned int run_batch(std::vector<BatchJob> const& jobs, BOMLayout const& layout, PathFilter const* filter,
+                       unsigned int num_threads, std::ostream& report) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<BatchResult>              results(jobs.size());
+    std::vector<std::size_t>              order(jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        order[i] = i;
+    }
+
+    run_parallel(order, num_threads, [&](std::size_t i) {
+        uint64_t num_entries = 0;
+        uint64_t num_bytes   = 0;
+        try {
+            measure_node(jobs[i].source, filter, num_entries, num_bytes);
+        } catch (std::exception const& e) {
+            results[i].sizing = std::string("sizing: ") + e.what();
+            num_entries = num_bytes = 0; // built last
+        }
+        results[i].cost = num_bytes + num_entries * BATCH_ENTRY_COST;
+    });
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) { return results[a].cost > results[b].cost; });
+
+    ChecksumCache checksums;
+    run_parallel(order, num_threads, [&](std::size_t i) {
+        BatchResult&                          r         = results[i];
+        std::chrono::steady_clock::time_point job_start = std::chrono::steady_clock::now();
+        try {
+            BomWriter writer(layout);
+            StreamPipe::run(
+                [&](std::ostream& output) {
+                    print_node(output, jobs[i].source, jobs[i].uid, jobs[i].gid, kTextManifest, filter, nullptr,
+                               &checksums);
+                },
+                [&](std::istream& file_list) { writer.addFileList(file_list); });
+            writer.write(jobs[i].output);
+            r.numEntries = writer.size();
+        } catch (std::exception const& e) {
+            r.error = "building: " + std::string(e.what());
+            if ((r.sizing.empty() == false) && (r.sizing != "sizing: " + std::string(e.what()))) {
+                r.error = r.sizing + "; " + r.error;
+            }
+        }
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job_start).count();
+    });
+
+    unsigned int num_failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (results[i].error.empty()) {
+            report << jobs[i].output << ": " << results[i].numEntries << " entries in " << results[i].seconds << " s"
+                   << std::endl;
+        } else {
+            report << jobs[i].output << ": failed: " << results[i].error << std::endl;
+            num_failed++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report << jobs.size() << " jobs, " << (jobs.size() - num_failed) << " written, " << num_failed << " failed, "
+           << checksums.hits() << " checksums shared, " << seconds << " s" << std::endl;
+    return num_failed;
+}
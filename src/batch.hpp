@@ -0,0 +1,57 @@
+/*
+  batch.hpp - building the boms of many directories in one process
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "writebom.hpp"
+
+class PathFilter;
+
+/* what checksumming an entry is estimated to cost besides reading its contents, in bytes */
+#define BATCH_ENTRY_COST 4096
+
+/* one line of the job file of mkbom --batch */
+struct BatchJob {
+    std::string source; // a directory
+    std::string output; // the bom file
+    uint32_t    uid;    // replaces the owner of every entry unless UINT_MAX
+    uint32_t    gid;
+};
+
+/* Reads a job file: one job per line, the source directory, the target bom file and optionally a
+   uid and a gid, separated by tabs. A missing uid or gid, or "-", stands for uid or gid. Empty
+   lines and lines starting with # are skipped. Throws std::runtime_error naming the line of a
+   malformed job, or a target that is listed twice. */
+void read_jobs(std::istream& input, uint32_t uid, uint32_t gid, std::vector<BatchJob>& jobs);
+
+/* Builds the bom of every job like mkbom does, on num_threads threads. The directories are
+   walked once without reading any file to estimate their cost, then built most expensive first,
+   so the batch does not end with one large job running alone. A file that several jobs have in
+   common, through the same directory or a hard link, is only read once. Prints one line per job
+   and a summary to report, and returns the number of jobs that failed. */
+unsigned int run_batch(std::vector<BatchJob> const& jobs, BOMLayout const& layout, PathFilter const* filter,
+                       unsigned int num_threads, std::ostream& report);
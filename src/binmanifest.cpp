@@ -0,0 +1,237 @@
+/*
+  binmanifest.cpp - compact binary file list exchanged between ls4mkbom and mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "binmanifest.hpp"
+#include "writebom.hpp"
+
+bool is_binary_manifest(const char* data, std::size_t length) {
+    return (length >= 8) && (std::memcmp(data, BOM_MANIFEST_MAGIC, 8) == 0);
+}
+
+BinaryManifestWriter::BinaryManifestWriter(std::ostream& o)
+    : output(o)
+    , num_records(0) {
+    BOMManifestHeader header;
+    std::memcpy(header.magic, BOM_MANIFEST_MAGIC, 8);
+    header.version  = htonl(BOM_MANIFEST_VERSION);
+    header.reserved = 0;
+    output.write((const char*)&header, sizeof(header));
+}
+
+uint32_t BinaryManifestWriter::intern(std::string const& s) {
+    std::unordered_map<std::string, uint32_t>::const_iterator it = interned.find(s);
+    if (it != interned.end()) {
+        return it->second;
+    }
+    uint64_t offset = strings.size();
+    if (offset + sizeof(uint32_t) + s.size() + 1 > UINT32_MAX) {
+        throw std::runtime_error("String table of the binary file list exceeds 4 GB");
+    }
+    uint32_t length = htonl(s.size());
+    strings.insert(strings.end(), (const char*)&length, (const char*)&length + sizeof(length));
+    strings.insert(strings.end(), s.begin(), s.end());
+    strings.push_back('\0');
+    interned[s] = offset;
+    return offset;
+}
+
+uint32_t BinaryManifestWriter::add(uint32_t parent, std::string const& name, uint32_t mode, uint32_t uid,
+                                   uint32_t gid, uint32_t size, uint32_t checksum, const char* link_name) {
+    if (num_records == UINT32_MAX) {
+        throw std::runtime_error("Too many entries for a binary file list");
+    }
+    BOMManifestRecord r;
+    r.parent   = htonl(parent);
+    r.name     = htonl(intern(name));
+    r.mode     = htonl(mode);
+    r.uid      = htonl(uid);
+    r.gid      = htonl(gid);
+    r.size     = htonl(size);
+    r.checksum = htonl(checksum);
+    r.linkName = htonl(link_name ? intern(link_name) : BOM_MANIFEST_NO_LINK);
+    output.write((const char*)&r, sizeof(r));
+    return ++num_records;
+}
+
+void BinaryManifestWriter::finish() {
+    uint64_t strings_offset = sizeof(BOMManifestHeader) + (uint64_t)num_records * sizeof(BOMManifestRecord);
+    if (strings_offset + strings.size() > UINT32_MAX) {
+        throw std::runtime_error("Binary file list exceeds 4 GB");
+    }
+    if (strings.size()) {
+        output.write(&strings[0], strings.size());
+    }
+    BOMManifestTrailer trailer;
+    std::memset(&trailer, 0, sizeof(trailer));
+    trailer.numRecords    = htonl(num_records);
+    trailer.recordsOffset = htonl(sizeof(BOMManifestHeader));
+    trailer.stringsOffset = htonl(strings_offset);
+    trailer.stringsLength = htonl(strings.size());
+    std::memcpy(trailer.magic, BOM_MANIFEST_MAGIC, 8);
+    output.write((const char*)&trailer, sizeof(trailer));
+    output.flush();
+}
+
+BinaryManifestReader::BinaryManifestReader()
+    : data(nullptr)
+    , length(0)
+    , num_records(0)
+    , records_offset(0)
+    , strings_offset(0)
+    , strings_length(0) {}
+
+void BinaryManifestReader::open(const char* buffer, std::size_t buffer_length) {
+    if ((is_binary_manifest(buffer, buffer_length) == false) ||
+        (buffer_length < sizeof(BOMManifestHeader) + sizeof(BOMManifestTrailer))) {
+        throw std::runtime_error("not a binary file list");
+    }
+    const BOMManifestHeader* header = (const BOMManifestHeader*)buffer;
+    if (ntohl(header->version) != BOM_MANIFEST_VERSION) {
+        throw std::runtime_error("unsupported binary file list version");
+    }
+    const BOMManifestTrailer* trailer =
+        (const BOMManifestTrailer*)(buffer + buffer_length - sizeof(BOMManifestTrailer));
+    if (std::memcmp(trailer->magic, BOM_MANIFEST_MAGIC, 8) != 0) {
+        throw std::runtime_error("binary file list is truncated");
+    }
+    data           = buffer;
+    length         = buffer_length;
+    num_records    = ntohl(trailer->numRecords);
+    records_offset = ntohl(trailer->recordsOffset);
+    strings_offset = ntohl(trailer->stringsOffset);
+    strings_length = ntohl(trailer->stringsLength);
+    uint64_t end   = length - sizeof(BOMManifestTrailer);
+    if (((uint64_t)records_offset + (uint64_t)num_records * sizeof(BOMManifestRecord) > end) ||
+        ((uint64_t)strings_offset + strings_length > end)) {
+        throw std::runtime_error("binary file list is truncated");
+    }
+}
+
+BOMManifestRecord BinaryManifestReader::record(uint32_t i) const {
+    BOMManifestRecord r;
+    std::memcpy(&r, data + records_offset + (uint64_t)i * sizeof(BOMManifestRecord), sizeof(r));
+    r.parent   = ntohl(r.parent);
+    r.name     = ntohl(r.name);
+    r.mode     = ntohl(r.mode);
+    r.uid      = ntohl(r.uid);
+    r.gid      = ntohl(r.gid);
+    r.size     = ntohl(r.size);
+    r.checksum = ntohl(r.checksum);
+    r.linkName = ntohl(r.linkName);
+    return r;
+}
+
+const char* BinaryManifestReader::string(uint32_t offset) const {
+    uint32_t string_length;
+    if ((uint64_t)offset + sizeof(uint32_t) > strings_length) {
+        throw std::runtime_error("string offset out of range");
+    }
+    std::memcpy(&string_length, data + strings_offset + offset, sizeof(uint32_t));
+    string_length = ntohl(string_length);
+    if ((uint64_t)offset + sizeof(uint32_t) + string_length + 1 > strings_length) {
+        throw std::runtime_error("string exceeds the string table");
+    }
+    const char* s = data + strings_offset + offset + sizeof(uint32_t);
+    if (s[string_length] != '\0') {
+        throw std::runtime_error("string is not terminated");
+    }
+    return s;
+}
+
+void read_binary_tree(BinaryManifestReader const& reader, NodeTree& tree) {
+    Node n;
+    for (uint32_t i = 0; i < reader.size(); ++i) {
+        BOMManifestRecord r = reader.record(i);
+        if (r.parent > i) {
+            std::stringstream ss;
+            ss << "Parent of record " << i << " does not appear before it";
+            throw std::runtime_error(ss.str());
+        }
+        n.mode     = r.mode;
+        n.uid      = r.uid;
+        n.gid      = r.gid;
+        n.size     = 0;
+        n.checksum = 0;
+        n.linkName.clear();
+        if ((r.mode & 0xF000) == 0x4000) {
+            n.type = kDirectoryNode;
+        } else if ((r.mode & 0xF000) == 0x8000) {
+            n.type     = kFileNode;
+            n.size     = r.size;
+            n.checksum = r.checksum;
+        } else if (((r.mode & 0xF000) == 0xA000) && (r.linkName != BOM_MANIFEST_NO_LINK)) {
+            n.type     = kSymbolicLinkNode;
+            n.size     = r.size;
+            n.checksum = r.checksum;
+            n.linkName = reader.string(r.linkName);
+        } else {
+            throw std::runtime_error("Node type not supported");
+        }
+        /* record i becomes entry i of the tree */
+        tree.add(r.parent ? r.parent - 1 : NodeTree::kRoot, reader.string(r.name), n);
+    }
+}
+
+void text_to_binary_manifest(std::istream& input, std::ostream& output) {
+    NodeTree tree;
+    read_tree(input, tree);
+    /* the finished tree lists parents before their children, entry i becomes record i */
+    BinaryManifestWriter writer(output);
+    for (uint32_t i = 0; i < tree.size(); ++i) {
+        writer.add(tree.parent(i) == NodeTree::kRoot ? 0 : tree.parent(i) + 1, tree.name(i), tree.mode(i),
+                   tree.uid(i), tree.gid(i), tree.fileSize(i), tree.checksum(i),
+                   tree.type(i) == kSymbolicLinkNode ? tree.linkName(i) : nullptr);
+    }
+    writer.finish();
+}
+
+void binary_to_text_manifest(BinaryManifestReader const& reader, std::ostream& output) {
+    ManifestWriter           writer(output);
+    std::vector<std::string> paths(reader.size());
+    for (uint32_t i = 0; i < reader.size(); ++i) {
+        BOMManifestRecord r = reader.record(i);
+        if (r.parent > i) {
+            std::stringstream ss;
+            ss << "Parent of record " << i << " does not appear before it";
+            throw std::runtime_error(ss.str());
+        }
+        paths[i] = r.parent ? paths[r.parent - 1] + "/" + reader.string(r.name) : reader.string(r.name);
+        writer.string(paths[i]).put('\t').octal(r.mode).put('\t').decimal(r.uid).put('/').decimal(r.gid);
+        if (((r.mode & 0xF000) == 0x8000) || ((r.mode & 0xF000) == 0xA000)) {
+            writer.put('\t').decimal(r.size).put('\t').decimal(r.checksum);
+        }
+        if ((r.mode & 0xF000) == 0xA000) {
+            writer.put('\t').string(r.linkName == BOM_MANIFEST_NO_LINK ? "" : reader.string(r.linkName));
+        }
+        writer.put('\n');
+    }
+}
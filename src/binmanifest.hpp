@@ -0,0 +1,135 @@
+/*
+  binmanifest.hpp - compact binary file list exchanged between ls4mkbom and mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+#include "manifestwriter.hpp"
+
+/* The binary file list holds the same information as the text format of ls4mkbom and lsbom:
+
+     BOMManifestHeader
+     BOMManifestRecord[numRecords]  one fixed size record per path, parents before their children
+     string table                   uint32_t length, the bytes and a terminating NUL for each string
+     BOMManifestTrailer             where the records and the string table are
+
+   The trailer is at the end so that the file can be written in one pass to a pipe. All values
+   are in network byte order like in the bom file, offsets are relative to the start of the file
+   and strings are referred to by their offset into the string table. Each path component is
+   stored only once. */
+
+#define BOM_MANIFEST_MAGIC   "\x89" "BOMLIST"
+#define BOM_MANIFEST_VERSION 1
+#define BOM_MANIFEST_NO_LINK 0xffffffff
+
+struct BOMManifestHeader {
+    char     magic[8]; // BOM_MANIFEST_MAGIC, the first byte never starts a text file list
+    uint32_t version;  // BOM_MANIFEST_VERSION
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct BOMManifestRecord {
+    uint32_t parent;   // 1-based index of the parent record, 0 for the top level entry "."
+    uint32_t name;     // last path component
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t size;     // only meaningful for files and links
+    uint32_t checksum; // only meaningful for files and links
+    uint32_t linkName; // BOM_MANIFEST_NO_LINK for anything but links
+} __attribute__((packed));
+
+struct BOMManifestTrailer {
+    uint32_t numRecords;
+    uint32_t recordsOffset;
+    uint32_t stringsOffset;
+    uint32_t stringsLength;
+    uint32_t reserved[4];
+    char     magic[8]; // BOM_MANIFEST_MAGIC again
+} __attribute__((packed));
+
+/* true if the data starts like a binary file list */
+bool is_binary_manifest(const char* data, std::size_t length);
+
+/* Writes records as they are added, the string table is kept in memory until finish(). */
+class BinaryManifestWriter {
+    private:
+        ManifestWriter                            output;
+        std::vector<char>                         strings;
+        std::unordered_map<std::string, uint32_t> interned;
+        uint32_t                                  num_records;
+
+        uint32_t intern(std::string const& s);
+
+        BinaryManifestWriter(BinaryManifestWriter const&);
+        BinaryManifestWriter& operator=(BinaryManifestWriter const&);
+
+    public:
+        explicit BinaryManifestWriter(std::ostream& o);
+
+        /* parent is the value returned when the parent was added, 0 for "."; link_name is
+           nullptr for anything but symbolic links. Returns the index of the new record. */
+        uint32_t add(uint32_t parent, std::string const& name, uint32_t mode, uint32_t uid, uint32_t gid,
+                     uint32_t size, uint32_t checksum, const char* link_name);
+
+        /* writes the string table and the trailer */
+        void finish();
+};
+
+/* Read access to a binary file list in memory. open() throws std::runtime_error if the data is
+   not a binary file list or is truncated. */
+class BinaryManifestReader {
+    private:
+        const char* data;
+        std::size_t length;
+        uint32_t    num_records;
+        uint32_t    records_offset;
+        uint32_t    strings_offset;
+        uint32_t    strings_length;
+
+    public:
+        BinaryManifestReader();
+
+        void open(const char* buffer, std::size_t buffer_length);
+
+        uint32_t size() const { return num_records; }
+
+        /* i is 0-based, the values are converted to host byte order */
+        BOMManifestRecord record(uint32_t i) const;
+        const char*       string(uint32_t offset) const;
+};
+
+class NodeTree;
+
+/* adds the records to tree, which still has to be finished; exits with an error message if a
+   record refers to an unknown parent */
+void read_binary_tree(BinaryManifestReader const& reader, NodeTree& tree);
+
+/* converts between the two formats, exit with an error message on malformed input */
+void text_to_binary_manifest(std::istream& input, std::ostream& output);
+void binary_to_text_manifest(BinaryManifestReader const& reader, std::ostream& output);
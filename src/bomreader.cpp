@@ -0,0 +1,362 @@
+/*
+  bomreader.cpp - read-only access to the blocks and trees of a bom file
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+#include <zlib.h>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "bomreader.hpp"
+#include "xar.hpp"
+
+/* the largest ratio of inflated to deflated size a zlib stream can reach */
+#define ZLIB_MAX_RATIO 1032
+
+BOMReader::BOMReader()
+    : data(nullptr)
+    , length(0)
+    , block_table(nullptr)
+    , vars(nullptr) {}
+
+BOMReader::~BOMReader() { close(); }
+
+void BOMReader::close() {
+    file.close();
+    inflated.reset();
+    data        = nullptr;
+    length      = 0;
+    block_table = nullptr;
+    vars        = nullptr;
+}
+
+void BOMReader::load(const char* path, uint64_t offset, uint64_t range) {
+    file.open(path, offset, range);
+    data   = file.buffer();
+    length = file.size();
+}
+
+void BOMReader::loadPackageBom(std::string const& package, std::string const& member) {
+    std::vector<XarFile> boms = find_package_boms(package.c_str());
+    std::size_t          i    = 0;
+    if (member.empty()) {
+        if (boms.size() != 1) {
+            std::string names;
+            for (std::size_t j = 0; j < boms.size(); ++j) {
+                names += (j ? ", " : "") + boms[j].path;
+            }
+            throw std::runtime_error(boms.empty() ? "No Bom in package: " + package
+                                                  : "Several Boms in package " + package + ", select one with " +
+                                                        package + ":component (" + names + ")");
+        }
+    } else {
+        while ((i < boms.size()) && (boms[i].path != member) && (boms[i].path != member + "/Bom")) {
+            ++i;
+        }
+        if (i == boms.size()) {
+            throw std::runtime_error("No Bom " + member + " in package: " + package);
+        }
+    }
+    XarFile const& bom = boms[i];
+    if (bom.encoding == XAR_UNCOMPRESSED) {
+        load(package.c_str(), bom.offset, bom.length);
+        return;
+    }
+    if (bom.encoding != XAR_ZLIB) {
+        throw std::runtime_error("Unsupported encoding " + bom.encoding + " of " + package + ":" + bom.path);
+    }
+    /* throws if the stored data lies outside of the file */
+    load(package.c_str(), bom.offset, bom.length);
+    /* the size comes from the table of contents; zlib never expands data by more than 1032:1 */
+    if (bom.size > bom.length * ZLIB_MAX_RATIO) {
+        close();
+        throw std::runtime_error("Truncated package " + package + ": " + bom.path + " cannot hold " +
+                                 std::to_string(bom.size) + " bytes");
+    }
+    std::unique_ptr<char[]> buf(new char[bom.size]);
+    z_stream                z;
+    std::memset(&z, 0, sizeof(z));
+    /* 32 + 15: a zlib or gzip stream with a window of up to 32k */
+    int ret = ::inflateInit2(&z, 32 + 15);
+    if (ret == Z_OK) {
+        z.next_in   = (Bytef*)data;
+        z.avail_in  = length;
+        z.next_out  = (Bytef*)buf.get();
+        z.avail_out = bom.size;
+        ret         = ::inflate(&z, Z_FINISH);
+        ::inflateEnd(&z);
+    }
+    close();
+    if ((ret != Z_STREAM_END) || (z.total_out != bom.size)) {
+        throw std::runtime_error("Unable to decompress " + package + ":" + bom.path);
+    }
+    inflated = std::move(buf);
+    data     = inflated.get();
+    length   = bom.size;
+}
+
+void BOMReader::open(const char* path) {
+    close();
+    /* "package:component" unless a file of that name exists */
+    std::string file(path);
+    std::string member;
+    std::size_t colon = file.rfind(':');
+    if ((colon != std::string::npos) && (colon > 1) && (std::ifstream(path).is_open() == false)) {
+        member = file.substr(colon + 1);
+        file.erase(colon);
+    }
+    try {
+        if (is_xar_file(file.c_str())) {
+            loadPackageBom(file, member);
+        } else if (member.empty() == false) {
+            throw std::runtime_error("Not a flat package: " + file);
+        } else {
+            load(path, 0, UINT64_MAX);
+        }
+    } catch (...) {
+        close();
+        throw;
+    }
+
+    const BOMHeader* header = (const BOMHeader*)data;
+    if ((length < sizeof(BOMHeader)) || (std::string(header->magic, 8) != "BOMStore")) {
+        close();
+        throw std::runtime_error(std::string("Not a BOM file: ") + path);
+    }
+    uint64_t index_offset = ntohl(header->indexOffset);
+    uint64_t vars_offset  = ntohl(header->varsOffset);
+    if ((index_offset + sizeof(uint32_t) > length) || (vars_offset + sizeof(uint32_t) > length)) {
+        close();
+        throw std::runtime_error(std::string("Truncated BOM file: ") + path);
+    }
+    block_table = (const BOMBlockTable*)(data + index_offset);
+    vars        = (const BOMVars*)(data + vars_offset);
+    if (index_offset + sizeof(uint32_t) + (uint64_t)numberOfBlockPointers() * sizeof(BOMPointer) >
+        length) {
+        close();
+        throw std::runtime_error(std::string("Truncated BOM file: ") + path);
+    }
+}
+
+uint32_t BOMReader::numberOfBlockPointers() const {
+    return ntohl(block_table->numberOfBlockTablePointers);
+}
+
+uint32_t BOMReader::blockAddress(uint32_t id) const {
+    if (id >= numberOfBlockPointers()) {
+        std::stringstream ss;
+        ss << "Invalid block index " << id;
+        throw std::runtime_error(ss.str());
+    }
+    return ntohl(block_table->blockPointers[id].address);
+}
+
+uint32_t BOMReader::blockLength(uint32_t id) const {
+    blockAddress(id); // throws if id does not exist
+    return ntohl(block_table->blockPointers[id].length);
+}
+
+const char* BOMReader::lookup(uint32_t id, uint32_t* block_length) const {
+    uint64_t address = blockAddress(id);
+    uint32_t len     = ntohl(block_table->blockPointers[id].length);
+    if (address + len > length) {
+        std::stringstream ss;
+        ss << "Block " << id << " lies outside of the BOM file";
+        throw std::runtime_error(ss.str());
+    }
+    if (block_length) {
+        *block_length = len;
+    }
+    return data + address;
+}
+
+uint32_t BOMReader::var(const char* name) const {
+    std::size_t name_length = std::strlen(name);
+    const char* ptr         = (const char*)vars->first;
+    for (uint32_t i = 0; i < ntohl(vars->count); ++i) {
+        const BOMVar* v = (const BOMVar*)ptr;
+        if ((uint64_t)(ptr - data) + sizeof(BOMVar) > length) {
+            throw std::runtime_error("Truncated variable list");
+        }
+        if ((v->length == name_length) && (std::memcmp(v->name, name, name_length) == 0)) {
+            return ntohl(v->index);
+        }
+        ptr += sizeof(BOMVar) + v->length;
+    }
+    return 0;
+}
+
+const BOMTree* BOMReader::tree(const char* name) const {
+    uint32_t index = var(name);
+    if (index == 0) {
+        return nullptr;
+    }
+    uint32_t       len;
+    const BOMTree* tree = (const BOMTree*)lookup(index, &len);
+    if (len < sizeof(BOMTree)) {
+        throw std::runtime_error(std::string("The ") + name + " tree block is too short");
+    }
+    return tree;
+}
+
+const BOMPaths* BOMReader::pathsBlock(uint32_t id) const {
+    uint32_t        len;
+    const BOMPaths* paths = (const BOMPaths*)lookup(id, &len);
+    if ((len < sizeof(BOMPaths)) ||
+        (len < sizeof(BOMPaths) + (uint64_t)ntohs(paths->count) * sizeof(BOMPathIndices))) {
+        std::stringstream ss;
+        ss << "Block " << id << " is too short for a tree node";
+        throw std::runtime_error(ss.str());
+    }
+    return paths;
+}
+
+const BOMFile* BOMReader::fileBlock(uint32_t id) const {
+    uint32_t       len;
+    const BOMFile* file = (const BOMFile*)lookup(id, &len);
+    if ((len <= sizeof(BOMFile)) || (std::memchr(file->name, 0, len - sizeof(BOMFile)) == nullptr)) {
+        std::stringstream ss;
+        ss << "Block " << id << " does not hold a terminated path name";
+        throw std::runtime_error(ss.str());
+    }
+    return file;
+}
+
+const BOMPaths* BOMReader::firstLeaf(const BOMTree* tree) const {
+    uint32_t child = ntohl(tree->child);
+    /* mkbom stores the root of an empty tree as an empty block */
+    if ((child < numberOfBlockPointers()) && (block_table->blockPointers[child].length == 0)) {
+        return nullptr;
+    }
+    const BOMPaths* paths = pathsBlock(child);
+    while (paths->isLeaf == htons(0)) {
+        if (paths->count == 0) {
+            return nullptr;
+        }
+        paths = pathsBlock(ntohl(paths->indices[0].index0));
+    }
+    return paths;
+}
+
+const BOMPaths* BOMReader::nextLeaf(const BOMPaths* leaf) const {
+    if (leaf->forward == htonl(0)) {
+        return nullptr;
+    }
+    return pathsBlock(ntohl(leaf->forward));
+}
+
+BOMEntry BOMReader::entry(const BOMPaths* leaf, unsigned int i) const {
+    if (i >= ntohs(leaf->count)) {
+        throw std::runtime_error("Entry index beyond the end of the tree node");
+    }
+    uint32_t            info1_length;
+    const BOMFile*      file  = fileBlock(ntohl(leaf->indices[i].index1));
+    const BOMPathInfo1* info1 = (const BOMPathInfo1*)lookup(ntohl(leaf->indices[i].index0), &info1_length);
+    if (info1_length < sizeof(BOMPathInfo1)) {
+        throw std::runtime_error("Path info block is too short");
+    }
+    BOMEntry e;
+    e.id     = ntohl(info1->id);
+    e.parent = ntohl(file->parent);
+    e.name   = file->name;
+    e.info   = (const BOMPathInfo2*)lookup(ntohl(info1->index), &e.infoLength);
+    if (e.infoLength < sizeof(BOMPathInfo2)) {
+        throw std::runtime_error("Path info block of " + std::string(e.name) + " is too short");
+    }
+    return e;
+}
+
+static int compare_key(const BOMFile* file, uint32_t parent, const char* name) {
+    uint32_t file_parent = ntohl(file->parent);
+    if (file_parent != parent) {
+        return (file_parent < parent) ? -1 : 1;
+    }
+    return std::strcmp(file->name, name);
+}
+
+bool BOMReader::findPath(std::string const& path, BOMEntry* result) const {
+    const BOMTree* paths_tree = tree("Paths");
+    if (paths_tree == nullptr) {
+        return false;
+    }
+    BOMEntry           found;
+    uint32_t           parent = 0;
+    std::istringstream ss(path);
+    /* mkbom stores the root of an empty tree as an empty block */
+    if (blockLength(ntohl(paths_tree->child)) == 0) {
+        return false;
+    }
+    for (std::string element; std::getline(ss, element, '/');) {
+        const BOMPaths* paths = pathsBlock(ntohl(paths_tree->child));
+        /* the key of a branch entry is the last key of the subtree it points to */
+        while (paths->isLeaf == htons(0)) {
+            unsigned int lo = 0, hi = ntohs(paths->count);
+            while (lo < hi) {
+                unsigned int   mid  = lo + ((hi - lo) / 2);
+                const BOMFile* file = fileBlock(ntohl(paths->indices[mid].index1));
+                if (compare_key(file, parent, element.c_str()) < 0) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo == ntohs(paths->count)) {
+                return false;
+            }
+            paths = pathsBlock(ntohl(paths->indices[lo].index0));
+        }
+        unsigned int lo = 0, hi = ntohs(paths->count);
+        bool         match = false;
+        while (lo < hi) {
+            unsigned int   mid  = lo + ((hi - lo) / 2);
+            const BOMFile* file = fileBlock(ntohl(paths->indices[mid].index1));
+            int            cmp  = compare_key(file, parent, element.c_str());
+            if (cmp == 0) {
+                found = entry(paths, mid);
+                match = true;
+                break;
+            } else if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (match == false) {
+            return false;
+        }
+        parent = found.id;
+    }
+    if (parent == 0) {
+        return false;
+    }
+    if (result) {
+        *result = found;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+/*
+  bomreader.hpp - read-only access to the blocks and trees of a bom file
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "bom.h"
+#include "mappedfile.hpp"
+
+/* One entry of a leaf in the Paths tree. All values are converted to host byte order,
+   info points into the bom file and is still in network byte order. */
+struct BOMEntry {
+    uint32_t            id;         // BOMPathInfo1->id
+    uint32_t            parent;     // id of the parent directory, 0 for top level entries
+    const char*         name;       // last path component
+    const BOMPathInfo2* info;
+    uint32_t            infoLength; // length of the BOMPathInfo2 block
+};
+
+/* The file is mapped read-only where possible. All methods throw std::runtime_error when the
+   bom file is truncated or refers to blocks that do not exist.
+
+   open() also accepts a flat installer package (a xar archive) and reads its Bom without
+   extracting it: in place if it is stored uncompressed, inflated into memory otherwise. A
+   product archive with several components needs the component after a colon, e.g.
+   "product.pkg:core.pkg" or "product.pkg:core.pkg/Bom". */
+class BOMReader {
+    private:
+        MappedFile              file;
+        std::unique_ptr<char[]> inflated;    // the Bom of a package, if it is compressed
+        const char*             data;
+        uint64_t                length;
+        const BOMBlockTable*    block_table;
+        const BOMVars*          vars;
+
+        BOMReader(BOMReader const&);
+        BOMReader& operator=(BOMReader const&);
+
+        /* maps or reads range bytes at offset of the file at path, UINT64_MAX is up to the end */
+        void load(const char* path, uint64_t offset, uint64_t range);
+        void loadPackageBom(std::string const& package, std::string const& member);
+
+        /* return the block as a tree node or a key, after checking that the node holds all of its
+           indices and that the name of the key ends inside the block */
+        const BOMPaths* pathsBlock(uint32_t id) const;
+        const BOMFile*  fileBlock(uint32_t id) const;
+
+    public:
+        BOMReader();
+        ~BOMReader();
+
+        void open(const char* path);
+        void close();
+
+        const char* buffer() const { return data; }
+        uint64_t    size() const { return length; }
+
+        /* id is in host byte order */
+        const char* lookup(uint32_t id, uint32_t* block_length = nullptr) const;
+        uint32_t    blockAddress(uint32_t id) const;
+        uint32_t    blockLength(uint32_t id) const;
+        uint32_t    numberOfBlockPointers() const;
+
+        /* returns the block index of the variable or 0 if it does not exist */
+        uint32_t       var(const char* name) const;
+        const BOMTree* tree(const char* name) const;
+
+        /* walk the leaves of a tree from left to right */
+        const BOMPaths* firstLeaf(const BOMTree* tree) const;
+        const BOMPaths* nextLeaf(const BOMPaths* leaf) const;
+        BOMEntry        entry(const BOMPaths* leaf, unsigned int i) const;
+
+        /* Finds a path such as "./usr/bin" in the Paths tree. The keys must be ordered by parent id
+           and name, which is how mkbom writes them. Returns false if the path does not exist. */
+        bool findPath(std::string const& path, BOMEntry* result = nullptr) const;
+};
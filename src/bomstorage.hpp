@@ -0,0 +1,212 @@
+/*
+  bomstorage.hpp - in-memory representation of a bom file while it is being written
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "bom.h"
+#include "stats.hpp"
+
+class BOMStorage {
+    
+    private:
+        uint32_t   size_of_header;
+        BOMHeader* header;
+        
+        uint32_t size_of_vars;
+        uint32_t num_vars;
+        BOMVars* vars;
+        
+        uint32_t       size_of_block_table;
+        uint32_t       num_block_entries;
+        BOMBlockTable* block_table;
+        
+        uint32_t     size_of_free_list;
+        uint32_t     num_free_list_entries;
+        BOMFreeList* free_list;
+        
+        uint32_t entry_size;
+        char*    entries;
+
+        uint32_t moveBlock(uint32_t id, char* dest, uint32_t pos, std::vector<bool>& placed,
+                           std::vector<uint32_t>& addresses) {
+            if (placed[id]) {
+                return pos;
+            }
+            uint32_t length = ntohl(block_table->blockPointers[id].length);
+            std::memcpy(&dest[pos], &entries[block_table->blockPointers[id].address], length);
+            addresses[id] = pos;
+            placed[id]    = true;
+            return pos + length;
+        }
+
+    public:
+        BOMStorage() {
+            size_of_header = 512;
+            header         = (BOMHeader*)std::malloc(size_of_header);
+            
+            num_block_entries   = 1;
+            size_of_block_table = sizeof(uint32_t) + (num_block_entries * sizeof(BOMPointer));
+            block_table         = (BOMBlockTable*)std::malloc(size_of_block_table);
+            
+            size_of_free_list     = sizeof(uint32_t) + (2 * sizeof(BOMPointer));
+            free_list             = (BOMFreeList*)std::malloc(size_of_free_list);
+            num_free_list_entries = 0;
+            
+            num_vars     = 0;
+            size_of_vars = sizeof(uint32_t);
+            vars         = (BOMVars*)std::malloc(size_of_vars);
+            
+            entry_size = 0;
+            entries    = nullptr;
+            
+            std::memset(header, 0, size_of_header);
+            std::memcpy(header->magic, "BOMStore", 8);
+            header->version        = htonl(1);
+            header->numberOfBlocks = htonl(0);
+            header->indexOffset    = htonl(size_of_header + size_of_vars + entry_size);
+            header->indexLength    = htonl(size_of_block_table + size_of_free_list);
+            header->varsOffset     = htonl(size_of_header);
+            header->varsLength     = htonl(size_of_vars);
+            
+            block_table->numberOfBlockTablePointers = htonl(num_block_entries);
+            block_table->blockPointers[0].address   = htonl(0);
+            block_table->blockPointers[0].length    = htonl(0);
+            
+            vars->count = htonl(0);
+            
+            free_list->numberOfFreeListPointers = htonl(num_free_list_entries);
+            for (unsigned int i = 0; i < 2; ++i) {
+                free_list->freelistPointers[i].address = htonl(0);
+                free_list->freelistPointers[i].length  = htonl(0);
+            }
+        }
+        
+        void* getBlock(uint32_t id) { return &entries[block_table->blockPointers[id].address]; }
+        
+        /* overwrites length bytes of a block, starting at offset */
+        void patchBlock(uint32_t id, uint32_t offset, const void* data, uint32_t length) {
+            std::memcpy((char*)getBlock(id) + offset, data, length);
+        }
+        
+        int addBlock(const void* data, uint32_t length) {
+            if (entries == nullptr) {
+                entries = (char*)std::malloc(length);
+            } else {
+                entries = (char*)std::realloc(entries, length + entry_size);
+                stats_count(kCounterReallocs);
+            }
+            std::memcpy(&entries[entry_size], data, length);
+            size_of_block_table = sizeof(uint32_t) + ((num_block_entries + 1) * sizeof(BOMPointer));
+            block_table         = (BOMBlockTable*)std::realloc(block_table, size_of_block_table);
+            stats_count(kCounterReallocs);
+            stats_count(kCounterBlocks);
+            block_table->blockPointers[num_block_entries].address = entry_size; // This will be converted to the right value later on.
+            block_table->blockPointers[num_block_entries].length = htonl(length);
+            num_block_entries++;
+            entry_size += length;
+            block_table->numberOfBlockTablePointers = htonl(num_block_entries);
+            
+            /* update header */
+            header->numberOfBlocks = htonl(ntohl(header->numberOfBlocks) + 1);
+            header->indexLength    = htonl(size_of_block_table + size_of_free_list);
+            return num_block_entries - 1;
+        }
+        
+        /* Moves the listed blocks to the start of the data area in the given order, all other
+           blocks follow in the order they were added. Block ids do not change. */
+        void reorderBlocks(std::vector<uint32_t> const& order) {
+            if (entries == nullptr) {
+                return;
+            }
+            char*                 reordered = (char*)std::malloc(entry_size);
+            std::vector<bool>     placed(num_block_entries, false);
+            std::vector<uint32_t> addresses(num_block_entries, 0);
+            uint32_t              pos = 0;
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                pos = moveBlock(order[i], reordered, pos, placed, addresses);
+            }
+            for (uint32_t id = 1; id < num_block_entries; ++id) {
+                pos = moveBlock(id, reordered, pos, placed, addresses);
+            }
+            for (uint32_t id = 1; id < num_block_entries; ++id) {
+                block_table->blockPointers[id].address = addresses[id];
+            }
+            std::free((void*)entries);
+            entries = reordered;
+        }
+
+        void addVar(const char* name, const void* data, uint32_t length) {
+            unsigned int new_size = sizeof(uint32_t) + 1 + std::strlen(name);
+            
+            vars        = (BOMVars*)std::realloc(vars, size_of_vars + new_size);
+            stats_count(kCounterReallocs);
+            BOMVar* var = (BOMVar*)&(((char*)vars)[size_of_vars]);
+            size_of_vars += new_size;
+            var->index  = htonl(addBlock(data, length));
+            var->length = std::strlen(name);
+            std::memcpy(var->name, name, std::strlen(name));
+            vars->count = htonl(ntohl(vars->count) + 1);
+            
+            /* update header */
+            header->indexOffset = htonl(size_of_header + size_of_vars + entry_size);
+            header->varsLength  = htonl(size_of_vars);
+        }
+        
+        void write(std::ostream& bom_file) {
+            bom_file.write((char*)header, size_of_header);
+            bom_file.write((char*)vars, size_of_vars);
+            if (entries != nullptr) {
+                bom_file.write((char*)entries, entry_size);
+            }
+            BOMBlockTable* temp = (BOMBlockTable*)std::malloc(size_of_block_table);
+            std::memcpy(temp, block_table, size_of_block_table);
+            for (unsigned int i = 0; i < ntohl(temp->numberOfBlockTablePointers); ++i) {
+                if (temp->blockPointers[i].length != 0) {
+                    temp->blockPointers[i].address = htonl(temp->blockPointers[i].address + size_of_header + size_of_vars);
+                }
+            }
+            bom_file.write((char*)temp, size_of_block_table);
+            std::free((void*)temp);
+            bom_file.write((char*)free_list, size_of_free_list);
+        }
+        
+        ~BOMStorage() {
+            if (entries != nullptr) {
+                std::free((void*)entries);
+            }
+            std::free((void*)vars);
+            std::free((void*)free_list);
+            std::free((void*)block_table);
+            std::free((void*)header);
+        }
+};
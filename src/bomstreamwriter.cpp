@@ -0,0 +1,174 @@
+/*
+  bomstreamwriter.cpp - writes the blocks of a bom file to disk as they are added
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "bom.h"
+#include "bomstreamwriter.hpp"
+#include "stats.hpp"
+
+#define STREAM_BUFFER_SIZE (1024 * 1024)
+
+BOMStreamWriter::BOMStreamWriter(std::string const& output_path, std::vector<std::string> const& names,
+                                 std::string const& temp_dir)
+    : var_names(names)
+    , size_of_vars(sizeof(uint32_t))
+    , entry_size(0)
+    , num_block_entries(1)
+    , output_buffer(STREAM_BUFFER_SIZE)
+    , table_buffer(STREAM_BUFFER_SIZE) {
+    for (std::size_t i = 0; i < var_names.size(); ++i) {
+        size_of_vars += sizeof(uint32_t) + 1 + var_names[i].size();
+    }
+    vars.resize(sizeof(uint32_t));
+    std::memset(vars.data(), 0, vars.size());
+
+    output.rdbuf()->pubsetbuf(output_buffer.data(), output_buffer.size());
+    output.open(output_path.c_str(), std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (output.fail()) {
+        throw std::runtime_error("unable to open " + output_path);
+    }
+    table_file.reset(new TempFile(temp_dir, "mkbom-table"));
+    table.rdbuf()->pubsetbuf(table_buffer.data(), table_buffer.size());
+    table.open(table_file->path().c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (table.fail()) {
+        throw std::runtime_error("unable to open " + table_file->path());
+    }
+
+    /* the header and the variables are written last */
+    std::vector<char> placeholder(dataOffset(), 0);
+    output.write(placeholder.data(), placeholder.size());
+
+    BOMPointer null_pointer;
+    null_pointer.address = htonl(0);
+    null_pointer.length  = htonl(0);
+    table.write((const char*)&null_pointer, sizeof(BOMPointer));
+}
+
+uint32_t BOMStreamWriter::addBlock(const void* data, uint32_t length) {
+    if ((dataOffset() + entry_size + length) > UINT32_MAX) {
+        throw std::runtime_error("the bom file would be larger than 4 GB");
+    }
+    BOMPointer pointer;
+    /* like BOMStorage, only blocks with data get an absolute address */
+    pointer.address = (length != 0) ? htonl(dataOffset() + entry_size) : (uint32_t)entry_size;
+    pointer.length  = htonl(length);
+    table.write((const char*)&pointer, sizeof(BOMPointer));
+    output.write((const char*)data, length);
+    if (output.fail() || table.fail()) {
+        throw std::runtime_error("write error");
+    }
+    stats_count(kCounterBlocks);
+    entry_size += length;
+    return num_block_entries++;
+}
+
+void BOMStreamWriter::addVar(const char* name, const void* data, uint32_t length) {
+    uint32_t count = ntohl(((BOMVars*)vars.data())->count);
+    if ((count >= var_names.size()) || (var_names[count] != name)) {
+        throw std::runtime_error(std::string("unexpected variable ") + name);
+    }
+    uint32_t    index     = htonl(addBlock(data, length));
+    std::size_t name_size = std::strlen(name);
+    std::size_t pos       = vars.size();
+    vars.resize(pos + sizeof(uint32_t) + 1 + name_size);
+    BOMVar* var = (BOMVar*)&vars[pos];
+    var->index  = index;
+    var->length = name_size;
+    std::memcpy(var->name, name, name_size);
+    ((BOMVars*)vars.data())->count = htonl(count + 1);
+}
+
+void BOMStreamWriter::patchBlock(uint32_t id, uint32_t offset, const void* data, uint32_t length) {
+    Patch p;
+    p.id     = id;
+    p.offset = offset;
+    p.data.assign((const char*)data, (const char*)data + length);
+    patches.push_back(p);
+}
+
+void BOMStreamWriter::finish() {
+    if (vars.size() != size_of_vars) {
+        throw std::runtime_error("not all variables were added");
+    }
+    table.close();
+    if (table.fail()) {
+        throw std::runtime_error("write error");
+    }
+
+    /* append the block table and find the addresses of the patched blocks on the way */
+    std::stable_sort(patches.begin(), patches.end(), [](Patch const& a, Patch const& b) { return a.id < b.id; });
+    std::vector<uint32_t> patch_addresses(patches.size());
+    {
+        std::ifstream table_in(table_file->path().c_str(), std::ios::binary | std::ios::in);
+        uint32_t      count = htonl(num_block_entries);
+        output.write((const char*)&count, sizeof(uint32_t));
+        std::size_t p = 0;
+        for (uint32_t id = 0; id < num_block_entries; ++id) {
+            BOMPointer pointer;
+            if (table_in.read((char*)&pointer, sizeof(BOMPointer)).fail()) {
+                throw std::runtime_error("unable to read " + table_file->path());
+            }
+            for (; (p < patches.size()) && (patches[p].id == id); ++p) {
+                patch_addresses[p] = ntohl(pointer.address);
+            }
+            output.write((const char*)&pointer, sizeof(BOMPointer));
+        }
+    }
+    table_file.reset();
+
+    /* an empty free list with the two null pointers mkbom always adds */
+    std::vector<char> free_list(sizeof(uint32_t) + (2 * sizeof(BOMPointer)), 0);
+    output.write(free_list.data(), free_list.size());
+
+    for (std::size_t i = 0; i < patches.size(); ++i) {
+        output.seekp(patch_addresses[i] + patches[i].offset);
+        output.write(patches[i].data.data(), patches[i].data.size());
+    }
+
+    BOMHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "BOMStore", 8);
+    header.version        = htonl(1);
+    header.numberOfBlocks = htonl(num_block_entries - 1);
+    header.indexOffset    = htonl(dataOffset() + entry_size);
+    header.indexLength    = htonl(sizeof(uint32_t) + (num_block_entries * sizeof(BOMPointer)) +
+                                  sizeof(uint32_t) + (2 * sizeof(BOMPointer)));
+    header.varsOffset     = htonl(512);
+    header.varsLength     = htonl(size_of_vars);
+    output.seekp(0);
+    output.write((const char*)&header, sizeof(header));
+    std::vector<char> padding(512 - sizeof(header), 0);
+    output.write(padding.data(), padding.size());
+    output.write(vars.data(), vars.size());
+    output.flush();
+    if (output.fail()) {
+        throw std::runtime_error("write error");
+    }
+}
@@ -0,0 +1,70 @@
+/*
+  bomstreamwriter.hpp - writes the blocks of a bom file to disk as they are added
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "tempfile.hpp"
+
+/* Produces the same file as BOMStorage without keeping it in memory. The names of the
+   variables must be known up front, since the variables are stored in front of the blocks.
+   The blocks are written to the output file right away, the block table goes to a temporary
+   file until finish() appends it. patchBlock() changes are applied by finish() as well.
+   All methods throw std::runtime_error if the file cannot be written. */
+class BOMStreamWriter {
+    private:
+        struct Patch {
+            uint32_t          id;
+            uint32_t          offset;
+            std::vector<char> data;
+        };
+
+        std::fstream             output;
+        std::vector<std::string> var_names;
+        std::vector<char>        vars;
+        uint32_t                 size_of_vars;
+        uint64_t                 entry_size;
+        uint32_t                 num_block_entries;
+        std::unique_ptr<TempFile> table_file;
+        std::ofstream            table;
+        std::vector<Patch>       patches;
+        std::vector<char>        output_buffer;
+        std::vector<char>        table_buffer;
+
+        uint32_t dataOffset() const { return 512 + size_of_vars; }
+
+    public:
+        BOMStreamWriter(std::string const& output_path, std::vector<std::string> const& names,
+                        std::string const& temp_dir);
+
+        uint32_t addBlock(const void* data, uint32_t length);
+        void     addVar(const char* name, const void* data, uint32_t length);
+        void     patchBlock(uint32_t id, uint32_t offset, const void* data, uint32_t length);
+
+        /* writes the block table, the free list, the header and the variables */
+        void finish();
+};
@@ -0,0 +1,242 @@
+/*
+  bomutils.cpp - the interface of libbomutils, the library behind mkbom, lsbom and ls4mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <iterator>
+#include <cstdio>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#include <process.h>
+#else
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#include "binmanifest.hpp"
+#include "bomstorage.hpp"
+#include "bomutils.hpp"
+#include "mappedfile.hpp"
+#include "printnode.hpp"
+#include "stats.hpp"
+#include "streampipe.hpp"
+
+BomWriter::BomWriter(BOMLayout const& l)
+    : layout(l)
+    , builder(tree)
+    , hasEntries(false)
+    , binary(false)
+    , finished(false) {
+    validate_layout(layout);
+}
+
+void BomWriter::checkAdd() {
+    if (finished) {
+        throw std::runtime_error("Entries cannot be added after the bom file was written");
+    }
+    if (binary) {
+        throw std::runtime_error("A binary file list must be the only source of entries");
+    }
+    hasEntries = true;
+}
+
+void BomWriter::checkAddBinary() {
+    if (hasEntries) {
+        throw std::runtime_error("A binary file list must be the only source of entries");
+    }
+    checkAdd();
+    binary = true;
+}
+
+void BomWriter::add(std::string const& path, Node const& n) {
+    checkAdd();
+    builder.add(path, n);
+}
+
+void BomWriter::addFileList(std::istream& input) {
+    if (input.peek() != (unsigned char)BOM_MANIFEST_MAGIC[0]) {
+        checkAdd();
+        read_file_list(input, builder);
+        return;
+    }
+    checkAddBinary();
+    std::vector<char> buffer((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    read_binary_file_list(buffer.data(), buffer.size(), tree);
+}
+
+void BomWriter::addFileList(const char* path) {
+    MappedFile file;
+    file.open(path);
+    if (is_binary_manifest(file.buffer(), file.size()) == false) {
+        file.close();
+        std::ifstream input(path, std::ios::in | std::ios::binary);
+        if (input.fail()) {
+            throw std::runtime_error(std::string("Unable to open file list: ") + path);
+        }
+        addFileList(input);
+        return;
+    }
+    checkAddBinary();
+    read_binary_file_list(file.buffer(), file.size(), tree);
+}
+
+void BomWriter::addDirectory(std::string const& directory, uint32_t uid, uint32_t gid, PathFilter const* filter,
+                             PayloadWriter* payload) {
+    checkAdd();
+    StreamPipe::run([&](std::ostream& output) { print_node(output, directory, uid, gid, kTextManifest, filter, payload); },
+                    [&](std::istream& file_list) { read_file_list(file_list, builder); });
+}
+
+void BomWriter::addArchive(std::istream& archive, uint32_t uid, uint32_t gid, PathFilter const* filter) {
+    checkAdd();
+    StreamPipe::run([&](std::ostream& output) { print_archive(output, archive, uid, gid, filter); },
+                    [&](std::istream& file_list) { read_file_list(file_list, builder); });
+}
+
+void BomWriter::finish() {
+    if (finished) {
+        return;
+    }
+    builder.finish();
+    StatsPhase phase(kPhaseTree);
+    tree.finish();
+    finished = true;
+}
+
+void BomWriter::write(std::ostream& output) {
+    finish();
+    BOMStorage bom;
+    add_tree(bom, tree, layout);
+
+    StatsPhase phase(kPhaseWrite);
+    bom.write(output);
+    if (output.fail()) {
+        throw std::runtime_error("Unable to write the bom file");
+    }
+}
+
+void BomWriter::write(std::string const& output_path) {
+    /* written under a temporary name and renamed over the target, so other links of the old file,
+       such as a build cache entry, are left alone and readers never see a half written file; the
+       counter keeps the names of threads apart that write the same file under different names */
+    static std::atomic<unsigned long> num_writes(0);
+    std::stringstream                 temp;
+#if defined(WINDOWS)
+    temp << output_path << "." << ::_getpid() << "." << num_writes++ << ".tmp";
+#else
+    temp << output_path << "." << ::getpid() << "." << num_writes++ << ".tmp";
+#endif
+    {
+        std::ofstream o_file(temp.str().c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        if (o_file.fail()) {
+            throw std::runtime_error("Unable to open output file: " + output_path);
+        }
+        try {
+            write(o_file);
+            o_file.close();
+            if (o_file.fail()) {
+                throw std::runtime_error("Unable to write the bom file");
+            }
+        } catch (...) {
+            o_file.close();
+            std::remove(temp.str().c_str());
+            throw;
+        }
+    }
+#if defined(WINDOWS)
+    std::remove(output_path.c_str()); // rename does not replace files on Windows
+#endif
+    if (std::rename(temp.str().c_str(), output_path.c_str()) != 0) {
+        std::remove(temp.str().c_str());
+        throw std::runtime_error("Unable to replace output file: " + output_path);
+    }
+}
+
+uint8_t BomPathEntry::type() const { return entry.info->type; }
+uint16_t BomPathEntry::mode() const { return ntohs(entry.info->mode); }
+uint32_t BomPathEntry::uid() const { return ntohl(entry.info->user); }
+uint32_t BomPathEntry::gid() const { return ntohl(entry.info->group); }
+uint32_t BomPathEntry::modtime() const { return ntohl(entry.info->modtime); }
+uint32_t BomPathEntry::size() const { return ntohl(entry.info->size); }
+uint32_t BomPathEntry::checksum() const { return ntohl(entry.info->checksum); }
+uint32_t BomPathEntry::devType() const { return ntohl(entry.info->devType); }
+const char* BomPathEntry::linkName() const { return entry.info->linkName; }
+
+BomReader::BomReader()
+    : leaf(nullptr)
+    , index(0) {}
+
+BomReader::BomReader(std::string const& path)
+    : leaf(nullptr)
+    , index(0) {
+    open(path);
+}
+
+void BomReader::open(std::string const& path) {
+    reader.open(path.c_str());
+    rewind();
+}
+
+void BomReader::close() {
+    reader.close();
+    leaf  = nullptr;
+    index = 0;
+    paths.clear();
+}
+
+void BomReader::rewind() {
+    const BOMTree* tree = reader.tree("Paths");
+    leaf                = tree ? reader.firstLeaf(tree) : nullptr;
+    index               = 0;
+    paths.clear();
+}
+
+bool BomReader::next(BomPathEntry& result) {
+    while (leaf && (index == ntohs(leaf->count))) {
+        leaf  = reader.nextLeaf(leaf);
+        index = 0;
+    }
+    if (leaf == nullptr) {
+        return false;
+    }
+    result.entry = reader.entry(leaf, index++);
+    if (result.entry.parent == 0) {
+        result.path = result.entry.name;
+    } else {
+        /* like lsbom, an entry whose parent is unknown is printed as "/name" */
+        std::unordered_map<uint32_t, std::string>::const_iterator it = paths.find(result.entry.parent);
+        result.path = ((it != paths.end()) ? it->second : std::string()) + "/" + result.entry.name;
+    }
+    paths[result.entry.id] = result.path;
+    return true;
+}
+
+bool BomReader::find(std::string const& path, BomPathEntry& result) const {
+    if (reader.findPath(path, &result.entry) == false) {
+        return false;
+    }
+    result.path = path;
+    return true;
+}
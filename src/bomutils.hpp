@@ -0,0 +1,163 @@
+/*
+  bomutils.hpp - the interface of libbomutils, the library behind mkbom, lsbom and ls4mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <climits>
+#include <cstdint>
+
+#include "bom.h"
+#include "bomreader.hpp"
+#include "crc32.hpp"
+#include "externalbom.hpp"
+#include "nodetree.hpp"
+#include "writebom.hpp"
+
+class PathFilter;
+class PayloadWriter;
+
+/* libbomutils is built as build/lib/libbomutils.a and libbomutils.so (.dll on Windows); link
+   with -lbomutils -lz -pthread and include this header. Every function reports errors by throwing
+   std::runtime_error. Besides the two classes below, the library exports the lower level pieces
+   the tools are made of: calc_crc32, calc_str_crc32 and crc32_update (crc32.hpp), parse_node,
+   read_tree and write_bom (writebom.hpp), write_bom_external (externalbom.hpp), print_node and
+   print_archive (printnode.hpp), the tar and cpio ArchiveReader (archivereader.hpp), the cpio
+   PayloadWriter (payload.hpp) and the block level BOMReader (bomreader.hpp).
+
+   Writing a bom file:
+
+       BomWriter writer;
+       writer.addDirectory("base", 0, 80);
+       writer.write("Bom");
+
+   Listing one:
+
+       BomReader    reader("Bom");
+       BomPathEntry e;
+       while (reader.next(e)) {
+           std::cout << e.path << '\t' << std::oct << e.mode() << std::endl;
+       }
+*/
+
+/* Collects entries in memory and writes them as a bom file. Entries are named by their path in
+   the file list: "." for the top directory and "./usr/bin" for the entries below it. They can be
+   added in any order, as long as the parent directory of every entry is added at some point.
+   Of several entries with the same path the last one wins. */
+class BomWriter {
+    private:
+        BOMLayout   layout;
+        NodeTree    tree;
+        TreeBuilder builder;
+        bool        hasEntries;
+        bool        binary;   // the entries came from a binary file list
+        bool        finished; // the tree is in bom order, no more entries can be added
+
+        BomWriter(BomWriter const&);
+        BomWriter& operator=(BomWriter const&);
+
+        void checkAdd();
+        void checkAddBinary();
+        void finish();
+
+    public:
+        /* throws if the layout cannot be represented in a bom file */
+        explicit BomWriter(BOMLayout const& layout = BOMLayout());
+
+        void add(std::string const& path, Node const& n);
+
+        /* adds a file list in the text or binary format generated by ls4mkbom and lsbom, a binary
+           list must be the only source of entries */
+        void addFileList(std::istream& input);
+        /* the same for a file list given by its path, a binary list is mapped instead of copied */
+        void addFileList(const char* path);
+
+        /* adds the entries of a directory like mkbom does, uid and gid replace the owner of every
+           entry unless they are UINT_MAX, entries excluded by filter are left out. Unless payload
+           is null, the entries are also archived to it (payload.hpp); the caller finishes it. */
+        void addDirectory(std::string const& directory, uint32_t uid = UINT_MAX, uint32_t gid = UINT_MAX,
+                          PathFilter const* filter = nullptr, PayloadWriter* payload = nullptr);
+
+        /* adds the entries of a tar or cpio archive like mkbom -a does, see print_archive */
+        void addArchive(std::istream& archive, uint32_t uid = UINT_MAX, uint32_t gid = UINT_MAX,
+                        PathFilter const* filter = nullptr);
+
+        /* write may be called several times, entries cannot be added after the first call. A file
+           is written under a temporary name next to output_path and then renamed over it, so
+           other hard links of the file it replaces keep their contents. */
+        void write(std::ostream& output);
+        void write(std::string const& output_path);
+
+        /* number of entries, only exact after write because duplicates are dropped then */
+        uint32_t size() const { return tree.size(); }
+};
+
+/* one entry of the Paths tree of a bom file, with the full path lsbom prints for it */
+struct BomPathEntry {
+    std::string path;
+    BOMEntry    entry;
+
+    /* the attributes of entry.info in host byte order */
+    uint8_t     type() const;
+    uint16_t    mode() const;
+    uint32_t    uid() const;
+    uint32_t    gid() const;
+    uint32_t    modtime() const;
+    uint32_t    size() const;
+    uint32_t    checksum() const;
+    uint32_t    devType() const;
+    const char* linkName() const;
+};
+
+/* Iterates over the entries of a bom file in the order of its Paths tree, which is breadth first
+   for files written by mkbom, so every directory comes before its children. */
+class BomReader {
+    private:
+        BOMReader                                 reader;
+        const BOMPaths*                           leaf;
+        unsigned int                              index;
+        std::unordered_map<uint32_t, std::string> paths; // full path by id
+
+        BomReader(BomReader const&);
+        BomReader& operator=(BomReader const&);
+
+    public:
+        BomReader();
+        explicit BomReader(std::string const& path);
+
+        void open(std::string const& path);
+        void close();
+
+        /* starts over at the first entry */
+        void rewind();
+
+        /* returns false after the last entry */
+        bool next(BomPathEntry& result);
+
+        /* finds a path such as "./usr/bin", returns false if it does not exist */
+        bool find(std::string const& path, BomPathEntry& result) const;
+
+        /* the block level view of the file */
+        BOMReader const& blocks() const { return reader; }
+};
@@ -0,0 +1,333 @@
+/*
+  bomverify.cpp - verify an installed tree against a bom file
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "bom.h"
+#include "bomreader.hpp"
+#include "crc32.hpp"
+#include "trace.hpp"
+
+/* 512k read buffer, like calc_crc32 */
+#define BUFFER_SIZE 512 * 1024
+
+/* One path listed in the bom together with the problems found on disk */
+struct VerifyEntry {
+    std::string           path;       // "./usr/bin" like lsbom prints it
+    const BOMPathInfo2*   info;       // network byte order, points into the mapped bom
+    uint32_t              infoLength; // length of the block info points to
+    std::set<std::string> children;   // names listed below a directory
+    std::string           result;     // one line per mismatch
+};
+
+struct VerifyOptions {
+    std::string root;
+    bool        checkOwner;
+    bool        checkExtra;
+};
+
+void usage() {
+    std::cout << "Usage: bomverify [-j threads] [-o] [-x] [-q] bom-file install-root" << std::endl << std::endl;
+    std::cout << "\t-j\tNumber of threads used to stat and checksum the files (default: number of cores)" << std::endl;
+    std::cout << "\t-o\tDo not compare user and group IDs" << std::endl;
+    std::cout << "\t-x\tDo not report files on disk which are not listed in the bom" << std::endl;
+    std::cout << "\t-q\tDo not print the summary" << std::endl;
+}
+
+static void report(VerifyEntry& e, const char* kind, std::string const& expected = "", std::string const& found = "") {
+    e.result += std::string(kind) + "\t" + e.path;
+    if (expected.size() || found.size()) {
+        e.result += "\t" + expected + "\t" + found;
+    }
+    e.result += "\n";
+}
+
+static std::string octal(uint32_t value) {
+    std::stringstream ss;
+    ss << std::oct << value;
+    return ss.str();
+}
+
+static std::string decimal(uint64_t value) {
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+/* like calc_crc32 but returns errors instead of throwing them, the file may change while we read it */
+static bool file_checksum(std::string const& path, uint32_t* checksum, std::string* error) {
+    int f = ::open(path.c_str(), O_RDONLY);
+    if (f < 0) {
+        *error = std::strerror(errno);
+        return false;
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(f, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+    uint32_t             crc    = 0;
+    uint64_t             length = 0;
+    while (true) {
+        ssize_t r = ::read(f, buffer.data(), buffer.size());
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *error = std::strerror(errno);
+            ::close(f);
+            return false;
+        }
+        if (r == 0) {
+            break;
+        }
+        crc = crc32_update(crc, buffer.data(), r);
+        length += r;
+    }
+    ::close(f);
+    *checksum = crc32_finish(crc, length);
+    return true;
+}
+
+static void verify_entry(VerifyEntry& e, VerifyOptions const& options) {
+    std::string fullpath = options.root + "/" + e.path;
+    struct stat s;
+#if defined(WINDOWS)
+    int stat_ret = ::stat(fullpath.c_str(), &s);
+#else
+    int stat_ret = ::lstat(fullpath.c_str(), &s);
+#endif
+    if (stat_ret != 0) {
+        if (errno == ENOENT) {
+            report(e, "missing");
+        } else {
+            report(e, "error", "", std::strerror(errno));
+        }
+        return;
+    }
+
+    const BOMPathInfo2& info = *e.info;
+    bool                type_ok;
+    switch (info.type) {
+        case TYPE_FILE: type_ok = S_ISREG(s.st_mode); break;
+        case TYPE_DIR: type_ok = S_ISDIR(s.st_mode); break;
+#if !defined(WINDOWS)
+        case TYPE_LINK: type_ok = S_ISLNK(s.st_mode); break;
+#endif
+        default: type_ok = ((s.st_mode & S_IFMT) == (ntohs(info.mode) & S_IFMT)); break;
+    }
+    if (type_ok == false) {
+        report(e, "type", octal(ntohs(info.mode) & S_IFMT), octal(s.st_mode & S_IFMT));
+        return;
+    }
+    if ((s.st_mode & 0xffff) != ntohs(info.mode)) {
+        report(e, "mode", octal(ntohs(info.mode)), octal(s.st_mode & 0xffff));
+    }
+    if (options.checkOwner && ((s.st_uid != ntohl(info.user)) || (s.st_gid != ntohl(info.group)))) {
+        report(e, "owner", decimal(ntohl(info.user)) + "/" + decimal(ntohl(info.group)),
+               decimal(s.st_uid) + "/" + decimal(s.st_gid));
+    }
+
+    if (info.type == TYPE_FILE) {
+        /* the size field holds the low 32 bits of the size, mkbom leaves Size64 empty */
+        if ((uint32_t)s.st_size != ntohl(info.size)) {
+            /* the contents cannot match, save reading the file */
+            report(e, "size", decimal(ntohl(info.size)), decimal(s.st_size));
+            return;
+        }
+        uint32_t    checksum;
+        std::string error;
+        if (file_checksum(fullpath, &checksum, &error) == false) {
+            report(e, "error", "", error);
+        } else if (checksum != ntohl(info.checksum)) {
+            report(e, "checksum", decimal(ntohl(info.checksum)), decimal(checksum));
+        }
+    }
+#if !defined(WINDOWS)
+    if (info.type == TYPE_LINK) {
+        char    buffer[PATH_MAX + 1];
+        ssize_t num_bytes = ::readlink(fullpath.c_str(), buffer, PATH_MAX);
+        if (num_bytes < 0) {
+            report(e, "error", "", std::strerror(errno));
+            return;
+        }
+        buffer[num_bytes] = '\0';
+        /* the link name of a malformed bom may not be terminated within its block */
+        std::size_t max_length = (e.infoLength > sizeof(BOMPathInfo2)) ? e.infoLength - sizeof(BOMPathInfo2) : 0;
+        std::string link_name(info.linkName, strnlen(info.linkName, max_length));
+        if (link_name != buffer) {
+            report(e, "link", link_name, buffer);
+        }
+    }
+#endif
+
+    if ((info.type == TYPE_DIR) && options.checkExtra) {
+        DIR* d = ::opendir(fullpath.c_str());
+        if (d == nullptr) {
+            report(e, "error", "", std::strerror(errno));
+            return;
+        }
+        std::vector<std::string> extra;
+        for (struct dirent* dir; (dir = ::readdir(d)) != nullptr;) {
+            /* mkbom leaves out names starting with a dot, which includes . and .. */
+            if ((dir->d_name[0] != '.') && (e.children.find(dir->d_name) == e.children.end())) {
+                extra.push_back(dir->d_name);
+            }
+        }
+        ::closedir(d);
+        std::sort(extra.begin(), extra.end());
+        for (std::vector<std::string>::const_iterator it = extra.begin(); it != extra.end(); ++it) {
+            e.result += "extra\t" + e.path + "/" + *it + "\n";
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int  num_threads = std::thread::hardware_concurrency();
+    bool          quiet       = false;
+    VerifyOptions options;
+    options.checkOwner = true;
+    options.checkExtra = true;
+
+    while (true) {
+        char c = ::getopt(argc, argv, "hj:oxq");
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'j': num_threads = std::atol(optarg); break;
+            case 'o': options.checkOwner = false; break;
+            case 'x': options.checkExtra = false; break;
+            case 'q': quiet = true; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 2;
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        usage();
+        return 2;
+    }
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    options.root = argv[optind + 1];
+    while ((options.root.size() > 1) && (options.root[options.root.size() - 1] == '/')) {
+        options.root.erase(options.root.size() - 1);
+    }
+
+    BOMReader                       reader;
+    std::vector<VerifyEntry>        entries;
+    std::map<uint32_t, std::size_t> index_of_id;
+    try {
+        reader.open(argv[optind]);
+        const BOMTree* paths_tree = reader.tree("Paths");
+        if (paths_tree == nullptr) {
+            throw std::runtime_error("The bom file has no Paths tree");
+        }
+        for (const BOMPaths* leaf = reader.firstLeaf(paths_tree); leaf; leaf = reader.nextLeaf(leaf)) {
+            for (unsigned int i = 0; i < ntohs(leaf->count); ++i) {
+                BOMEntry    bom_entry = reader.entry(leaf, i);
+                VerifyEntry e;
+                e.info       = bom_entry.info;
+                e.infoLength = bom_entry.infoLength;
+                if (bom_entry.parent != 0) {
+                    /* mkbom writes the tree breadth first, so parents always come first */
+                    std::map<uint32_t, std::size_t>::const_iterator it = index_of_id.find(bom_entry.parent);
+                    if (it == index_of_id.end()) {
+                        throw std::runtime_error(std::string("parent of ") + bom_entry.name + " not found");
+                    }
+                    e.path = entries[it->second].path + "/" + bom_entry.name;
+                    entries[it->second].children.insert(bom_entry.name);
+                } else {
+                    e.path = bom_entry.name;
+                }
+                index_of_id[bom_entry.id] = entries.size();
+                entries.push_back(e);
+            }
+        }
+    } catch (std::exception const& e) {
+        std::cerr << std::endl << "Unable to read bom file " << argv[optind] << ": " << e.what() << std::endl;
+        return 2;
+    }
+
+    /* start with the largest files so a single big file does not end up as the last job */
+    std::vector<std::size_t> jobs(entries.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i] = i;
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [&entries](std::size_t a, std::size_t b) {
+        return ntohl(entries[a].info->size) > ntohl(entries[b].info->size);
+    });
+
+    std::atomic<std::size_t> next_job(0);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        workers.push_back(std::thread([&]() {
+            trace_thread_name("verify worker");
+            for (std::size_t j; (j = next_job.fetch_add(1)) < jobs.size();) {
+                verify_entry(entries[jobs[j]], options);
+            }
+        }));
+    }
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+
+    /* print in bom order so the output does not depend on the scheduling */
+    std::size_t num_mismatches = 0;
+    for (std::vector<VerifyEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (it->result.size()) {
+            std::cout << it->result;
+            num_mismatches += std::count(it->result.begin(), it->result.end(), '\n');
+        }
+    }
+    if (quiet == false) {
+        std::cerr << entries.size() << " paths verified, " << num_mismatches << " mismatches" << std::endl;
+    }
+    return (num_mismatches != 0) ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+  boundedqueue.hpp - blocking queue of limited size connecting pipeline stages
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/* push() blocks while the queue holds capacity items, so a fast producer cannot run ahead of
+   its consumer and the memory in flight stays bounded. The producer calls close() when it is
+   done, pop() then returns false once the queue is empty. */
+template <typename T>
+class BoundedQueue {
+    private:
+        std::deque<T>           items;
+        std::size_t             capacity;
+        bool                    closed;
+        std::mutex              mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+
+        BoundedQueue(BoundedQueue const&);
+        BoundedQueue& operator=(BoundedQueue const&);
+
+    public:
+        explicit BoundedQueue(std::size_t max_items)
+            : capacity(max_items)
+            , closed(false) {}
+
+        void push(T&& item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this]() { return items.size() < capacity; });
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+        }
+
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this]() { return (items.empty() == false) || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+        }
+};
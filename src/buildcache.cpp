@@ -0,0 +1,223 @@
+/*
+  buildcache.cpp - reuse the output of an earlier mkbom run with the same inputs
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(WINDOWS)
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+#endif
+
+#include "buildcache.hpp"
+#include "crc32.hpp"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+
+Fingerprint::Fingerprint()
+    : fnv(FNV_OFFSET_BASIS)
+    , crc(0)
+    , length(0) {}
+
+void Fingerprint::add(const void* data, std::size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t       h = fnv;
+    for (std::size_t i = 0; i < size; ++i) {
+        h = (h ^ p[i]) * FNV_PRIME;
+    }
+    fnv = h;
+    crc = crc32_update(crc, p, size);
+    length += size;
+}
+
+void Fingerprint::add(std::string const& s) {
+    add((uint64_t)s.size());
+    add(s.data(), s.size());
+}
+
+void Fingerprint::add(uint64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    add(bytes, sizeof(bytes));
+}
+
+std::string Fingerprint::hex() const {
+    char digits[25];
+    std::snprintf(digits, sizeof(digits), "%016llx%08x", (unsigned long long)fnv,
+                  (unsigned int)crc32_finish(crc, length));
+    return digits;
+}
+
+/* copies the file at from to to, which is replaced */
+static void copy_file(std::string const& from, std::string const& to) {
+    std::ifstream input(from.c_str(), std::ios::in | std::ios::binary);
+    std::ofstream output(to.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (input.fail() || output.fail()) {
+        throw std::runtime_error("Unable to copy " + from + " to " + to);
+    }
+    output << input.rdbuf();
+    output.close();
+    if (output.fail()) {
+        throw std::runtime_error("Unable to copy " + from + " to " + to);
+    }
+}
+
+/* places the file from at to, which must not exist: as a hard link, a reflink or a copy */
+static void link_file(std::string const& from, std::string const& to) {
+#if !defined(WINDOWS)
+    if (::link(from.c_str(), to.c_str()) == 0) {
+        return;
+    }
+#if defined(FICLONE)
+    int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source >= 0) {
+        int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (target >= 0) {
+            bool cloned = (::ioctl(target, FICLONE, source) == 0);
+            ::close(target);
+            ::close(source);
+            if (cloned) {
+                return;
+            }
+            ::unlink(to.c_str());
+        } else {
+            ::close(source);
+        }
+    }
+#endif
+#endif
+    copy_file(from, to);
+}
+
+BuildCache::BuildCache(std::string const& dir)
+    : directory(dir) {
+    while ((directory.size() > 1) && (directory[directory.size() - 1] == '/')) {
+        directory.erase(directory.size() - 1);
+    }
+#if defined(WINDOWS)
+    int ret = ::_mkdir(directory.c_str());
+#else
+    int ret = ::mkdir(directory.c_str(), 0755);
+#endif
+    if ((ret != 0) && (errno != EEXIST)) {
+        throw std::runtime_error("Unable to create cache directory: " + directory);
+    }
+}
+
+bool BuildCache::fetch(std::string const& name, std::string const& output_path) const {
+    std::string entry = directory + "/" + name;
+    struct stat s;
+    if ((::stat(entry.c_str(), &s) != 0) || ((s.st_mode & S_IFMT) != S_IFREG)) {
+        return false;
+    }
+    if ((std::remove(output_path.c_str()) != 0) && (errno != ENOENT)) {
+        throw std::runtime_error("Unable to replace " + output_path);
+    }
+    link_file(entry, output_path);
+    return true;
+}
+
+void BuildCache::store(std::string const& name, std::string const& path) const {
+    std::stringstream temp;
+#if defined(WINDOWS)
+    temp << directory << "/." << name << "." << ::_getpid() << ".tmp";
+#else
+    temp << directory << "/." << name << "." << ::getpid() << ".tmp";
+#endif
+    std::remove(temp.str().c_str());
+    link_file(path, temp.str());
+    std::string entry = directory + "/" + name;
+#if defined(WINDOWS)
+    std::remove(entry.c_str()); // rename does not replace files on Windows
+#endif
+    if (std::rename(temp.str().c_str(), entry.c_str()) != 0) {
+        std::remove(temp.str().c_str());
+        throw std::runtime_error("Unable to add " + path + " to the cache");
+    }
+}
+
+void unlink_shared_output(std::string const& path) {
+#if !defined(WINDOWS)
+    struct stat s;
+    if ((::lstat(path.c_str(), &s) == 0) && S_ISREG(s.st_mode) && (s.st_nlink > 1)) {
+        ::unlink(path.c_str());
+    }
+#endif
+}
+
+ChecksumCache::ChecksumCache()
+    : numHits(0) {}
+
+std::size_t ChecksumCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.size();
+}
+
+uint32_t ChecksumCache::checksum(FileIdentity const& id, std::function<uint32_t()> const& compute) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            std::unordered_map<FileIdentity, Slot, FileIdentityHash>::iterator it = slots.find(id);
+            if (it == slots.end()) {
+                Slot s;
+                s.ready    = false;
+                s.checksum = 0;
+                slots.insert(std::make_pair(id, s));
+                break;
+            }
+            if (it->second.ready) {
+                numHits++;
+                return it->second.checksum;
+            }
+            computed.wait(lock);
+        }
+    }
+    uint32_t result;
+    try {
+        result = compute();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots.erase(id);
+        computed.notify_all();
+        throw;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    slots[id].ready    = true;
+    slots[id].checksum = result;
+    computed.notify_all();
+    return result;
+}
@@ -0,0 +1,129 @@
+/*
+  buildcache.hpp - reuse the output of an earlier mkbom run with the same inputs
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+/* A 96 bit digest of the inputs of a build: FNV-1a and CRC32 of everything that is added. It
+   only has to tell different inputs apart, nobody is expected to forge a collision. */
+class Fingerprint {
+    private:
+        uint64_t fnv;
+        uint32_t crc;
+        uint64_t length;
+
+    public:
+        Fingerprint();
+
+        void add(const void* data, std::size_t size);
+        void add(std::string const& s); // with its length, so that consecutive strings cannot run together
+        void add(uint64_t value);
+
+        /* 24 hexadecimal digits */
+        std::string hex() const;
+};
+
+/* A directory of earlier outputs, named by the fingerprint of their inputs. A cached file is
+   handed out as a hard link where possible, a reflink (copy on write clone) where the file
+   system supports it, and a copy otherwise; files are added to the cache the same way, under a
+   temporary name that is then renamed, so concurrent builds never see half written entries. */
+class BuildCache {
+    private:
+        std::string directory;
+
+    public:
+        /* creates the directory if it does not exist */
+        explicit BuildCache(std::string const& dir);
+
+        /* places the entry name at output_path, returns false if there is no such entry */
+        bool fetch(std::string const& name, std::string const& output_path) const;
+
+        /* adds the file at path as the entry name */
+        void store(std::string const& name, std::string const& path) const;
+};
+
+/* Removes path if it is one of several hard links of a file. Writing an output that a cache hit
+   linked to the cache would otherwise change the cached entry as well. */
+void unlink_shared_output(std::string const& path);
+
+/* what tells the contents of a file apart without reading them: where the file is stored and
+   when it was last changed */
+struct FileIdentity {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t  mtime;
+    int64_t  mtimeNsec;
+    int64_t  ctime;
+    int64_t  ctimeNsec;
+
+    bool operator==(FileIdentity const& o) const {
+        return (dev == o.dev) && (ino == o.ino) && (size == o.size) && (mtime == o.mtime) &&
+               (mtimeNsec == o.mtimeNsec) && (ctime == o.ctime) && (ctimeNsec == o.ctimeNsec);
+    }
+};
+
+struct FileIdentityHash {
+    std::size_t operator()(FileIdentity const& id) const {
+        return (std::size_t)((id.dev * 1099511628211ULL) ^ id.ino ^ (id.mtimeNsec << 20) ^ (id.ctimeNsec << 40));
+    }
+};
+
+/* The checksums of the files several walks in one process have in common, such as the jobs of
+   mkbom --batch: a file reached through several sources or hard links is read only once, even
+   if two threads reach it at the same time. */
+class ChecksumCache {
+    private:
+        struct Slot {
+            bool     ready;
+            uint32_t checksum;
+        };
+
+        std::mutex                                               mutex;
+        std::condition_variable                                  computed;
+        std::unordered_map<FileIdentity, Slot, FileIdentityHash> slots;
+        std::atomic<uint64_t>                                    numHits;
+
+        ChecksumCache(ChecksumCache const&);
+        ChecksumCache& operator=(ChecksumCache const&);
+
+    public:
+        ChecksumCache();
+
+        /* the checksum of the file identified by id, compute is only called if no other thread
+           has computed it or is computing it; if compute throws, the next caller tries again */
+        uint32_t checksum(FileIdentity const& id, std::function<uint32_t()> const& compute);
+
+        /* number of checksums that were not computed again */
+        uint64_t hits() const { return numHits.load(); }
+
+        /* number of files whose checksum is known or being computed */
+        std::size_t size();
+};
@@ -31,64 +31,46 @@
 #include <fcntl.h>
 #endif
 
-#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 #include "crc32.hpp"
 #include "crc32_poly.hpp"
+#include "stats.hpp"
 
 /* 512k default buffer size */
 #define BUFFER_SIZE 512 * 1024
 
-uint32_t calc_crc32(const char* file_path) {
 #if defined(WINDOWS)
-    OFSTRUCT ignore;
-    HFILE    f = OpenFile(file_path, &ignore, OF_READ);
+uint32_t calc_crc32(const char* file_path, ByteSink* sink) {
+    StatsPhase phase(kPhaseChecksum);
+    OFSTRUCT   ignore;
+    HFILE      f = OpenFile(file_path, &ignore, OF_READ);
     if (f == HFILE_ERROR) {
-#else
-    int f = ::open(file_path, O_RDONLY);
-    if (f < 0) {
-#endif
-        std::cerr << "Cannot open file \""
-                  << file_path
-                  << "\". Unable to calculate crc!"
-                  << std::endl;
-        std::exit(1);
+        throw std::runtime_error(std::string("Cannot open file \"") + file_path + "\". Unable to calculate crc!");
     }
 
-#if defined(WINDOWS)
     LARGE_INTEGER li;
     li.QuadPart = 0;
     li.LowPart  = SetFilePointer((HANDLE)f, li.LowPart, &li.HighPart, FILE_END);
     if ((li.LowPart == INVALID_SET_FILE_POINTER) && (GetLastError() != NO_ERROR)) {
-        std::cerr << "IO seek error while calculating crc of file \"" << file_path << "\"!" << std::endl;
-        std::exit(1);
+        CloseHandle((HANDLE)f);
+        throw std::runtime_error(std::string("IO seek error while calculating crc of file \"") + file_path + "\"!");
     }
     int64_t file_length = li.QuadPart;
     li.QuadPart         = 0;
     li.LowPart          = SetFilePointer((HANDLE)f, li.LowPart, &li.HighPart, FILE_BEGIN);
     if ((li.LowPart == INVALID_SET_FILE_POINTER) && (GetLastError() != NO_ERROR)) {
-        std::cerr << "IO seek error while calculating crc of file \"" << file_path << "\"!" << std::endl;
-        std::exit(1);
-    }
-#else
-    off_t file_length = ::lseek(f, 0, SEEK_END);
-    if (file_length < (off_t)0) {
-        std::cerr << "Cannot seek to end of file: " << file_path << std::endl;
-        std::exit(1);
+        CloseHandle((HANDLE)f);
+        throw std::runtime_error(std::string("IO seek error while calculating crc of file \"") + file_path + "\"!");
     }
-    ::lseek(f, 0, SEEK_SET);
-#endif
     
     unsigned int buffer_size = (file_length < BUFFER_SIZE) ? file_length : BUFFER_SIZE;
     uint8_t*     buffer      = new uint8_t[buffer_size];
     if (buffer == nullptr) {
-#if defined(WINDOWS)
         CloseHandle((HANDLE)f);
-#else
-        ::close(f);
-#endif
-        std::cerr << "Not enough memory to calculate crc checksum" << std::endl;
-        std::exit(1);
+        throw std::runtime_error("Not enough memory to calculate crc checksum");
     }
     
     int64_t  file_pos = 0;
@@ -97,61 +79,132 @@ uint32_t calc_crc32(const char* file_path) {
         int bytes = ((file_length - file_pos) < BUFFER_SIZE) ? (file_length - file_pos) : BUFFER_SIZE;
         off_t buf_pos = 0;
         while (buf_pos < bytes) {
-#if defined(WINDOWS)
             DWORD read;
             if (ReadFile((HANDLE)f, &buffer[buf_pos], bytes - buf_pos, &read, NULL) == false) {
-                std::cerr << "IO error while calculating checksum of file \"" << file_path << "\"!"
-                          << std::endl;
                 CloseHandle((HANDLE)f);
-                std::exit(1);
+                delete[] buffer;
+                throw std::runtime_error(std::string("IO error while calculating checksum of file \"") + file_path + "\"!");
             }
             buf_pos += read;
+        }
+        crc = crc32_update(crc, buffer, bytes);
+        if (sink) {
+            try {
+                sink->write(buffer, bytes);
+            } catch (...) {
+                CloseHandle((HANDLE)f);
+                delete[] buffer;
+                throw;
+            }
+        }
+        file_pos += bytes;
+    }
+
+    delete[] buffer;
+    CloseHandle((HANDLE)f);
+    stats_count(kCounterBytesHashed, file_length);
+    return crc32_finish(crc, file_length);
+}
 #else
+/* checksums the open file f and closes it, file_path is only used in error messages */
+static uint32_t calc_crc32_of_descriptor(int f, const char* file_path, ByteSink* sink) {
+    off_t file_length = ::lseek(f, 0, SEEK_END);
+    if (file_length < (off_t)0) {
+        ::close(f);
+        throw std::runtime_error(std::string("Cannot seek to end of file: ") + file_path);
+    }
+    ::lseek(f, 0, SEEK_SET);
+    
+    unsigned int buffer_size = (file_length < BUFFER_SIZE) ? file_length : BUFFER_SIZE;
+    uint8_t*     buffer      = new uint8_t[buffer_size];
+    if (buffer == nullptr) {
+        ::close(f);
+        throw std::runtime_error("Not enough memory to calculate crc checksum");
+    }
+    
+    int64_t  file_pos = 0;
+    uint32_t crc      = 0;
+    while (file_pos < file_length) {
+        int bytes = ((file_length - file_pos) < BUFFER_SIZE) ? (file_length - file_pos) : BUFFER_SIZE;
+        off_t buf_pos = 0;
+        while (buf_pos < bytes) {
             ssize_t r = ::read(f, (void*)&buffer[buf_pos], bytes - buf_pos);
             if (r == 0) {
-                std::cerr << "Unexpected EOF in calculating checksum" << std::endl;
                 ::close(f);
-                std::exit(1);
+                delete[] buffer;
+                throw std::runtime_error("Unexpected EOF in calculating checksum");
             } else if (r < 0) {
-                std::cerr << "IO error (" << r << ") while calculating checksum of file \"" << file_path
-                          << "\"!" << std::endl;
                 ::close(f);
-                std::exit(1);
+                delete[] buffer;
+                std::stringstream ss;
+                ss << "IO error (" << r << ") while calculating checksum of file \"" << file_path << "\"!";
+                throw std::runtime_error(ss.str());
             } else {
                 buf_pos += r;
             }
-#endif
         }
-        for (int i = 0; i < bytes; ++i) {
-            crc = crc_table[buffer[i] ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
+        crc = crc32_update(crc, buffer, bytes);
+        if (sink) {
+            try {
+                sink->write(buffer, bytes);
+            } catch (...) {
+                ::close(f);
+                delete[] buffer;
+                throw;
+            }
         }
         file_pos += bytes;
     }
-    while (file_length > 0) {
-        crc = crc_table[(((uint64_t)file_length) & 0xFF) ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
-        file_length >>= 8;
-    }
 
     delete[] buffer;
-#if defined(WINDOWS)
-    CloseHandle((HANDLE)f);
-#else
     ::close(f);
-#endif
-    /* invert all bits */
-    return crc ^ 0xffffffff;
+    stats_count(kCounterBytesHashed, file_length);
+    return crc32_finish(crc, file_length);
+}
+
+static void cannot_open(const char* file_path) {
+    throw std::runtime_error(std::string("Cannot open file \"") + file_path + "\". Unable to calculate crc!");
+}
+
+uint32_t calc_crc32(const char* file_path, ByteSink* sink) {
+    StatsPhase phase(kPhaseChecksum);
+    int        f = ::open(file_path, O_RDONLY);
+    if (f < 0) {
+        cannot_open(file_path);
+    }
+    return calc_crc32_of_descriptor(f, file_path, sink);
+}
+
+uint32_t calc_crc32_at(int dir_fd, const char* name, const char* file_path, ByteSink* sink) {
+    StatsPhase phase(kPhaseChecksum);
+    int        f = ::openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (f < 0) {
+        cannot_open(file_path);
+    }
+    return calc_crc32_of_descriptor(f, file_path, sink);
 }
+#endif
 
 uint32_t calc_str_crc32(const char* str) {
-    std::size_t   num_bytes = std::strlen(str);
-    uint32_t      crc       = 0;
-    for (std::size_t i = 0; i < num_bytes; ++i) {
-        crc = crc_table[str[i] ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
+    StatsPhase  phase(kPhaseChecksum);
+    std::size_t num_bytes = std::strlen(str);
+    stats_count(kCounterBytesHashed, num_bytes);
+    return crc32_finish(crc32_update(0, (const uint8_t*)str, num_bytes), num_bytes);
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* buffer, std::size_t length) {
+    for (std::size_t i = 0; i < length; ++i) {
+        crc = crc_table[buffer[i] ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
     }
-    while (num_bytes > 0) {
-        crc = crc_table[(((uint64_t)num_bytes) & 0xFF) ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
-        num_bytes >>= 8;
+    return crc;
+}
+
+uint32_t crc32_finish(uint32_t crc, uint64_t length) {
+    /* the length is appended to the data, least significant byte first */
+    while (length > 0) {
+        crc = crc_table[(length & 0xFF) ^ ((crc >> 24) & 0xFF)] ^ (crc << 8);
+        length >>= 8;
     }
-    
+    /* invert all bits */
     return crc ^ 0xffffffff;
 }
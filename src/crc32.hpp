@@ -22,7 +22,26 @@
 */
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
-uint32_t calc_crc32(const char* file_path);
+/* receives the contents of a file in the buffer calc_crc32 checksums them from,
+   so that a second consumer does not have to read the file again */
+class ByteSink {
+    public:
+        virtual ~ByteSink() {}
+        virtual void write(const uint8_t* data, std::size_t length) = 0;
+};
+
+uint32_t calc_crc32(const char* file_path, ByteSink* sink = nullptr);
 uint32_t calc_str_crc32(const char* str);
+#if !defined(WINDOWS)
+/* checksums the file name in the directory dir_fd without following a symbolic link,
+   file_path is only used in error messages */
+uint32_t calc_crc32_at(int dir_fd, const char* name, const char* file_path, ByteSink* sink = nullptr);
+#endif
+
+/* Incremental interface: start with crc = 0, feed all data through crc32_update and pass the
+   total number of bytes to crc32_finish to obtain the same value as calc_crc32 */
+uint32_t crc32_update(uint32_t crc, const uint8_t* buffer, std::size_t length);
+uint32_t crc32_finish(uint32_t crc, uint64_t length);
@@ -20,11 +20,17 @@
   Initial work done by Joseph Coffland and Julian Devlin.
   Numerous further improvements by Baron Roberts.
 */
+#include <algorithm>
 #include <iostream>
 #include <cstring>
-#include <fstream>
 #include <string>
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
 #include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <getopt.h>
 
 #if defined(WINDOWS)
 #include <winsock2.h>
@@ -33,262 +39,649 @@
 #endif
 
 #include "bom.h"
+#include "bomreader.hpp"
 
-void print_paths(BOMPaths* paths, char* buffer, BOMBlockTable* block_table, unsigned int id) {
-    paths->isLeaf   = ntohs(paths->isLeaf);
-    paths->count    = ntohs(paths->count);
-    paths->forward  = ntohl(paths->forward);
-    paths->backward = ntohl(paths->backward);
-    
-    std::cout << std::endl;
-    std::cout << "path id=" << id << std::endl;
-    std::cout << "paths->isLeaf = " << paths->isLeaf << std::endl;
-    std::cout << "paths->count = " << paths->count << std::endl;
-    std::cout << "paths->forward = " << paths->forward << std::endl;
-    std::cout << "paths->backward = " << paths->backward << std::endl;
-    
-    for (unsigned int i = 0; i < paths->count; ++i) {
-        BOMPointer& ptr  = block_table->blockPointers[ntohl(paths->indices[i].index1)];
-        BOMFile&    file = *((BOMFile*)&buffer[ptr.address]);
-        std::cout << "path->indices[" << i << "].index0 = " << ntohl(paths->indices[i].index0) << std::endl;
-        std::cout << "path->indices[" << i << "].index1.parent = " << ntohl(file.parent) << std::endl;
-        std::cout << "path->indices[" << i << "].index1.name = " << file.name << std::endl;
-    }
-    
-    if (paths->isLeaf == htons(0)) {
-        BOMPointer& child_ptr   = block_table->blockPointers[ntohl(paths->indices[0].index0)];
-        BOMPaths*   child_paths = (BOMPaths*)&buffer[child_ptr.address];
-        print_paths(child_paths, buffer, block_table, ntohl(paths->indices[0].index0));
-    }
-    
-    if (paths->forward) {
-        BOMPointer& sibling_ptr   = block_table->blockPointers[paths->forward];
-        BOMPaths*   sibling_paths = (BOMPaths*)&buffer[sibling_ptr.address];
-        print_paths(sibling_paths, buffer, block_table, paths->forward);
+/* a range of block ids selected with -b, last is inclusive */
+struct BlockRange {
+    uint32_t first;
+    uint32_t last;
+};
+
+/* The bom file is only read through the read-only mapping of BOMReader, every value is converted
+   when it is printed. Output lines end with '\n' instead of std::endl, so that dumping a large
+   file is not slowed down by a flush per line. */
+
+/* returns the block as a tree node, or nullptr if it is too short to hold one, which is how mkbom
+   stores the root of an empty tree */
+static const BOMPaths* paths_block(BOMReader const& reader, uint32_t id) {
+    if (reader.blockLength(id) < sizeof(BOMPaths)) {
+        return nullptr;
+    }
+    uint32_t        length;
+    const BOMPaths* paths = (const BOMPaths*)reader.lookup(id, &length);
+    if (length < sizeof(BOMPaths) + (uint64_t)ntohs(paths->count) * sizeof(BOMPathIndices)) {
+        return nullptr;
+    }
+    return paths;
+}
+
+/* prints the nodes of a tree level by level, each level from left to right along the forward
+   pointers, without recursion so the depth of the tree and the number of leaves do not matter */
+void print_paths(BOMReader const& reader, uint32_t id) {
+    uint32_t const max_nodes = reader.numberOfBlockPointers();
+    for (uint32_t depth = 0; id != 0; ++depth) {
+        if (depth > max_nodes) {
+            throw std::runtime_error("The tree contains a cycle");
+        }
+        uint32_t first_child = 0;
+        uint32_t num_nodes   = 0;
+        for (uint32_t node = id; node != 0; ++num_nodes) {
+            if (num_nodes > max_nodes) {
+                throw std::runtime_error("The forward pointers of the tree contain a cycle");
+            }
+            std::cout << '\n';
+            std::cout << "path id=" << node << '\n';
+            const BOMPaths* paths = paths_block(reader, node);
+            if (paths == nullptr) {
+                std::cout << "(block too short for a tree node)" << '\n';
+                break;
+            }
+            uint16_t count = ntohs(paths->count);
+            std::cout << "paths->isLeaf = " << ntohs(paths->isLeaf) << '\n';
+            std::cout << "paths->count = " << count << '\n';
+            std::cout << "paths->forward = " << ntohl(paths->forward) << '\n';
+            std::cout << "paths->backward = " << ntohl(paths->backward) << '\n';
+
+            for (unsigned int i = 0; i < count; ++i) {
+                const BOMFile* file = (const BOMFile*)reader.lookup(ntohl(paths->indices[i].index1));
+                std::cout << "path->indices[" << i << "].index0 = " << ntohl(paths->indices[i].index0) << '\n';
+                std::cout << "path->indices[" << i << "].index1.parent = " << ntohl(file->parent) << '\n';
+                std::cout << "path->indices[" << i << "].index1.name = " << file->name << '\n';
+            }
+
+            if ((node == id) && (paths->isLeaf == htons(0)) && (count != 0)) {
+                first_child = ntohl(paths->indices[0].index0);
+            }
+            node = ntohl(paths->forward);
+        }
+        id = first_child;
     }
 }
 
-void print_tree(BOMTree* tree, char* buffer, BOMBlockTable* block_table) {
-    tree->version   = ntohl(tree->version);
-    tree->child     = ntohl(tree->child);
-    tree->blockSize = ntohl(tree->blockSize);
-    tree->pathCount = ntohl(tree->pathCount);
+void print_tree(BOMReader const& reader, uint32_t id) {
+    uint32_t       length;
+    const BOMTree* tree = (const BOMTree*)reader.lookup(id, &length);
+    if (length < sizeof(BOMTree)) {
+        throw std::runtime_error("Tree block is too short");
+    }
     std::string type(tree->tree, 4);
-    
-    std::cout << "tree->tree = " << type << std::endl;
-    std::cout << "tree->version = " << tree->version << std::endl;
-    std::cout << "tree->child = " << tree->child << std::endl;
-    std::cout << "tree->blockSize = " << tree->blockSize << std::endl;
-    std::cout << "tree->pathCount = " << tree->pathCount << std::endl;
-    std::cout << "tree->unknown3 = " << (int)tree->unknown3 << std::endl;
-    BOMPointer& child_ptr = block_table->blockPointers[tree->child];
-    BOMPaths*   paths     = (BOMPaths*)&buffer[child_ptr.address];
-    print_paths(paths, buffer, block_table, tree->child);
+
+    std::cout << "tree->tree = " << type << '\n';
+    std::cout << "tree->version = " << ntohl(tree->version) << '\n';
+    std::cout << "tree->child = " << ntohl(tree->child) << '\n';
+    std::cout << "tree->blockSize = " << ntohl(tree->blockSize) << '\n';
+    std::cout << "tree->pathCount = " << ntohl(tree->pathCount) << '\n';
+    std::cout << "tree->unknown3 = " << (int)tree->unknown3 << '\n';
+    print_paths(reader, ntohl(tree->child));
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: dumpbom bomfile" << std::endl;
-        return 1;
+void print_info(BOMReader const& reader, uint32_t id) {
+    uint32_t       length;
+    const BOMInfo* info = (const BOMInfo*)reader.lookup(id, &length);
+    if ((length < sizeof(BOMInfo)) ||
+        (length < sizeof(BOMInfo) + (uint64_t)ntohl(info->numberOfInfoEntries) * sizeof(BOMInfoEntry))) {
+        throw std::runtime_error("BomInfo block is too short");
+    }
+    uint32_t num_entries = ntohl(info->numberOfInfoEntries);
+    std::cout << "info->version = " << ntohl(info->version) << '\n';
+    std::cout << "info->numberOfPaths = " << ntohl(info->numberOfPaths) << '\n';
+    std::cout << "info->numberOfInfoEntries = " << num_entries << '\n';
+    for (unsigned int i = 0; i < num_entries; ++i) {
+        std::cout << "info->entries[" << i << "].unknown0 = " << ntohl(info->entries[i].unknown0) << '\n';
+        std::cout << "info->entries[" << i << "].unknown1 = " << ntohl(info->entries[i].unknown1) << '\n';
+        std::cout << "info->entries[" << i << "].unknown2 = " << ntohl(info->entries[i].unknown2) << '\n';
+        std::cout << "info->entries[" << i << "].unknown3 = " << ntohl(info->entries[i].unknown3) << '\n';
+    }
+}
+
+void print_vindex(BOMReader const& reader, uint32_t id) {
+    uint32_t         length;
+    const BOMVIndex* vindex = (const BOMVIndex*)reader.lookup(id, &length);
+    if (length < sizeof(BOMVIndex)) {
+        throw std::runtime_error("VIndex block is too short");
     }
-    
-    char*          buffer;
-    std::streampos file_length;
-    {
-        std::ifstream bom_file(argv[1], std::ios::binary | std::ios::in);
-        
-        bom_file.seekg(0, std::ios::end);
-        file_length = bom_file.tellg();
-        bom_file.seekg(0);
-        
-        buffer = new char[file_length];
-        bom_file.read(buffer, file_length);
-        
-        if (bom_file.fail()) {
-            std::cerr << "Unable to read bomfile" << std::endl;
-            return 1;
+    std::cout << "vindex->unknown0 = " << ntohl(vindex->unknown0) << '\n';
+    std::cout << "vindex->indexToVTree = " << ntohl(vindex->indexToVTree) << '\n';
+    std::cout << "vindex->unknown2 = " << ntohl(vindex->unknown2) << '\n';
+    std::cout << "vindex->unknown3 = " << (int)vindex->unknown3 << '\n';
+    std::cout << '\n';
+    print_tree(reader, ntohl(vindex->indexToVTree));
+}
+
+void print_raw(BOMReader const& reader, uint32_t id) {
+    uint32_t    length;
+    const char* block = reader.lookup(id, &length);
+    unsigned int i;
+    for (i = 0; i < length / sizeof(uint32_t); ++i) {
+        uint32_t value;
+        std::memcpy(&value, block + (i * sizeof(uint32_t)), sizeof(uint32_t));
+        std::cout << "0x" << std::setbase(16) << std::setw(8) << std::setfill('0') << ntohl(value)
+                  << std::setbase(10) << '\n';
+    }
+    i *= sizeof(uint32_t);
+    for (; i < length; ++i) {
+        std::cout << "0x" << std::setbase(16) << std::setw(2) << std::setfill('0') << (int)block[i] << '\n';
+    }
+}
+
+/* the section of one variable, as printed for every variable by default */
+void print_var(BOMReader const& reader, std::string const& name, uint32_t index) {
+    std::cout << '\n'
+              << "\"" << name << "\" (file offset: 0x" << std::setbase(16) << reader.blockAddress(index)
+              << std::setbase(10) << " length: " << reader.blockLength(index) << " )" << '\n';
+    std::cout << "-----------------------------------------------------" << '\n';
+    if ((name == "Paths") || (name == "HLIndex") || (name == "Size64")) {
+        print_tree(reader, index);
+    } else if (name == "BomInfo") {
+        print_info(reader, index);
+    } else if (name == "VIndex") {
+        print_vindex(reader, index);
+    } else {
+        print_raw(reader, index);
+    }
+}
+
+/* the name and block index of every variable, in the order they are stored */
+std::vector<std::pair<std::string, uint32_t>> read_vars(BOMReader const& reader) {
+    const char* data        = reader.buffer();
+    uint32_t    vars_offset = ntohl(((const BOMHeader*)data)->varsOffset);
+    uint64_t    offset      = vars_offset + sizeof(uint32_t);
+    uint32_t    count       = ntohl(((const BOMVars*)(data + vars_offset))->count);
+    std::vector<std::pair<std::string, uint32_t>> vars;
+    for (uint32_t i = 0; i < count; ++i) {
+        const BOMVar* var = (const BOMVar*)(data + offset);
+        if ((offset + sizeof(BOMVar) > reader.size()) || (offset + sizeof(BOMVar) + var->length > reader.size())) {
+            throw std::runtime_error("Truncated variable list");
         }
-        
-        bom_file.close();
-    }
-    
-    std::cout << argv[1] << std::endl;
-    std::cout << "file_length = " << file_length << std::endl;
-    
-    std::cout << "Header:" << std::endl;
-    std::cout << "-----------------------------------------------------" << std::endl;
-    
-    BOMHeader* header      = (BOMHeader*)buffer;
-    header->version        = ntohl(header->version);
-    header->numberOfBlocks = ntohl(header->numberOfBlocks);
-    header->indexOffset    = ntohl(header->indexOffset);
-    header->indexLength    = ntohl(header->indexLength);
-    header->varsOffset     = ntohl(header->varsOffset);
-    header->varsLength     = ntohl(header->varsLength);
-    
-    BOMBlockTable* block_table              = (BOMBlockTable*)&buffer[header->indexOffset];
-    block_table->numberOfBlockTablePointers = ntohl(block_table->numberOfBlockTablePointers);
-    int numberOfNonNullEntries              = 0;
-    
-    for (unsigned int i = 0; i < block_table->numberOfBlockTablePointers; ++i) {
-        if (block_table->blockPointers[i].address != 0) {
+        vars.push_back(std::make_pair(std::string(var->name, var->length), ntohl(var->index)));
+        offset += sizeof(BOMVar) + var->length;
+    }
+    return vars;
+}
+
+void print_header(BOMReader const& reader, const char* path) {
+    const BOMHeader* header      = (const BOMHeader*)reader.buffer();
+    uint32_t const   num_blocks  = reader.numberOfBlockPointers();
+    int              numberOfNonNullEntries = 0;
+    for (uint32_t i = 0; i < num_blocks; ++i) {
+        if (reader.blockAddress(i) != 0) {
             numberOfNonNullEntries++;
-            block_table->blockPointers[i].address = ntohl(block_table->blockPointers[i].address);
-            block_table->blockPointers[i].length  = ntohl(block_table->blockPointers[i].length);
         }
     }
-    
-    {
-        std::string magic(header->magic, 8);
-        std::cout << "magic = \"" << magic << "\"" << std::endl;
-        std::cout << "version = " << header->version << std::endl;
-        std::cout << "numberOfBlocks = " << header->numberOfBlocks << std::endl;
-        std::cout << "indexOffset = " << header->indexOffset << std::endl;
-        std::cout << "indexLength = " << header->indexLength << std::endl;
-        std::cout << "varsOffset = " << header->varsOffset << std::endl;
-        std::cout << "varsLength = " << header->varsLength << std::endl;
-        std::cout << "(calculated number of blocks = " << numberOfNonNullEntries << ")" << std::endl;
-    }
-    
-    std::cout << std::endl << "Index Table:" << std::endl;
-    std::cout << "-----------------------------------------------------" << std::endl;
-    
-    std::cout << "numberOfBlockTableEntries = " << block_table->numberOfBlockTablePointers << std::endl;
-#if 0
-  for ( unsigned int i=0; i < block_table->numberOfBlockTablePointers; ++i ) {
-    if ( block_table->blockPointers[i].address != 0 ) {
-      std::cout << "{" << std::endl;
-      std::cout << "\tid = " << i << std::endl;
-      std::cout << "\taddress = " << std::setbase(16) << "0x" << block_table->blockPointers[i].address << std::setbase(10) << std::endl;
-      std::cout << "\tlength = " << block_table->blockPointers[i].length << std::endl;
-      std::cout << "}," << std::endl;
-    }
-  }
-#endif
-    
-    uint32_t free_list_pos = header->indexOffset + sizeof(uint32_t) +
-                             (block_table->numberOfBlockTablePointers * sizeof(BOMPointer));
-    BOMFreeList* free_list              = (BOMFreeList*)&buffer[free_list_pos];
-    free_list->numberOfFreeListPointers = ntohl(free_list->numberOfFreeListPointers);
-    std::cout << std::endl << "Free List:" << std::endl;
-    std::cout << "-----------------------------------------------------" << std::endl;
-    std::cout << "numberOfFreeListPointers = " << free_list->numberOfFreeListPointers << std::endl;
-    for (unsigned int i = 0; i < free_list->numberOfFreeListPointers; ++i) {
-        free_list->freelistPointers[i].address = ntohl(free_list->freelistPointers[i].address);
-        free_list->freelistPointers[i].length  = ntohl(free_list->freelistPointers[i].length);
-    }
-#if 0
-  for ( unsigned int i=0; i < free_list->numberOfFreeListPointers; ++i ) {
-    std::cout << "{" << std::endl;
-    std::cout << "\tid = " << i << std::endl;
-    std::cout << "\taddress = " << std::setbase(16) << "0x" << free_list->freelistPointers[i].address << std::setbase(10) << std::endl;
-    std::cout << "\tlength = " << free_list->freelistPointers[i].length << std::endl;
-    std::cout << "}," << std::endl;
-  }
-#endif
-    
-    std::cout << std::endl << "Variables:" << std::endl;
-    std::cout << "-----------------------------------------------------" << std::endl;
-    
-    int var_count;
-    {
-        BOMVars*     vars         = (BOMVars*)&buffer[header->varsOffset];
-        unsigned int total_length = 0;
-        vars->count               = ntohl(vars->count);
-        total_length += sizeof(uint32_t);
-        BOMVar* var = &vars->first[0];
-        var_count   = vars->count;
-        for (int i = 0; i < var_count; ++i) {
-            var->index = ntohl(var->index);
-            total_length += sizeof(uint32_t);
-            total_length += var->length + 1;
-            var = (BOMVar*)&buffer[header->varsOffset + total_length];
+
+    std::cout << path << '\n';
+    std::cout << "file_length = " << reader.size() << '\n';
+
+    std::cout << "Header:" << '\n';
+    std::cout << "-----------------------------------------------------" << '\n';
+    std::string magic(header->magic, 8);
+    std::cout << "magic = \"" << magic << "\"" << '\n';
+    std::cout << "version = " << ntohl(header->version) << '\n';
+    std::cout << "numberOfBlocks = " << ntohl(header->numberOfBlocks) << '\n';
+    std::cout << "indexOffset = " << ntohl(header->indexOffset) << '\n';
+    std::cout << "indexLength = " << ntohl(header->indexLength) << '\n';
+    std::cout << "varsOffset = " << ntohl(header->varsOffset) << '\n';
+    std::cout << "varsLength = " << ntohl(header->varsLength) << '\n';
+    std::cout << "(calculated number of blocks = " << numberOfNonNullEntries << ")" << '\n';
+
+    std::cout << '\n' << "Index Table:" << '\n';
+    std::cout << "-----------------------------------------------------" << '\n';
+    std::cout << "numberOfBlockTableEntries = " << num_blocks << '\n';
+
+    uint64_t free_list_pos = ntohl(header->indexOffset) + sizeof(uint32_t) + ((uint64_t)num_blocks * sizeof(BOMPointer));
+    std::cout << '\n' << "Free List:" << '\n';
+    std::cout << "-----------------------------------------------------" << '\n';
+    if (free_list_pos + sizeof(uint32_t) > reader.size()) {
+        throw std::runtime_error("Truncated free list");
+    }
+    const BOMFreeList* free_list = (const BOMFreeList*)(reader.buffer() + free_list_pos);
+    std::cout << "numberOfFreeListPointers = " << ntohl(free_list->numberOfFreeListPointers) << '\n';
+}
+
+void print_var_list(std::vector<std::pair<std::string, uint32_t>> const& vars) {
+    std::cout << '\n' << "Variables:" << '\n';
+    std::cout << "-----------------------------------------------------" << '\n';
+    unsigned int total_length = sizeof(uint32_t);
+    for (std::size_t i = 0; i < vars.size(); ++i) {
+        total_length += sizeof(uint32_t) + vars[i].first.size() + 1;
+    }
+    std::cout << "vars->count = " << vars.size() << '\n';
+    std::cout << "( calculated length = " << total_length << ")" << '\n';
+    for (std::size_t i = 0; i < vars.size(); ++i) {
+        if (i != 0) {
+            std::cout << ",";
         }
-        
-        std::cout << "vars->count = " << vars->count << std::endl;
-        std::cout << "( calculated length = " << total_length << ")" << std::endl;
-        var          = &vars->first[0];
-        total_length = sizeof(uint32_t);
-        
-        for (int i = 0; i < var_count; ++i) {
-            if (i != 0) {
-                std::cout << ",";
+        std::cout << "\"" << vars[i].first << "\"";
+    }
+    std::cout << '\n';
+}
+
+/* prints the block table entries of a range and the contents of the blocks */
+void print_blocks(BOMReader const& reader, BlockRange const& range) {
+    uint32_t last = std::min(range.last, reader.numberOfBlockPointers() - 1);
+    for (uint32_t id = range.first; (id <= last) && (id < reader.numberOfBlockPointers()); ++id) {
+        uint32_t address = reader.blockAddress(id);
+        uint32_t length  = reader.blockLength(id);
+        std::cout << "{" << '\n';
+        std::cout << "\tid = " << id << '\n';
+        std::cout << "\taddress = " << std::setbase(16) << "0x" << address << std::setbase(10) << '\n';
+        std::cout << "\tlength = " << length << '\n';
+        if ((address != 0) && (length != 0)) {
+            const unsigned char* block = (const unsigned char*)reader.lookup(id);
+            for (uint32_t i = 0; i < length; i += 16) {
+                std::cout << "\t" << std::setbase(16) << std::setw(8) << std::setfill('0') << i << ":";
+                for (uint32_t j = i; (j < i + 16) && (j < length); ++j) {
+                    std::cout << ' ' << std::setw(2) << (unsigned int)block[j];
+                }
+                std::cout << std::setbase(10) << '\n';
             }
-            total_length += sizeof(uint32_t);
-            total_length += var->length + 1;
-            std::string name(var->name, var->length);
-            std::cout << "\"" << name << "\"";
-            var = (BOMVar*)&buffer[header->varsOffset + total_length];
         }
-        std::cout << std::endl;
+        std::cout << "}," << '\n';
     }
+}
 
-    unsigned int total_length = sizeof(uint32_t);
-    for (int i = 0; i < var_count; ++i) {
-        BOMVar* var = (BOMVar*)&buffer[header->varsOffset + total_length];
-        total_length += sizeof(uint32_t) + 1 + var->length;
-        std::string      name(var->name, var->length);
-        BOMPointer& ptr = block_table->blockPointers[var->index];
-        std::cout << std::endl
-                  << "\"" << name << "\" (file offset: 0x" << std::setbase(16) << ptr.address << std::setbase(10)
-                  << " length: " << ptr.length << " )" << std::endl;
-        std::cout << "-----------------------------------------------------" << std::endl;
-        if ((name == "Paths") || (name == "HLIndex") || (name == "Size64")) {
-            BOMTree* tree = (BOMTree*)&buffer[ptr.address];
-            print_tree(tree, buffer, block_table);
-        } else if (name == "BomInfo") {
-            BOMInfo* info             = (BOMInfo*)&buffer[ptr.address];
-            info->version             = ntohl(info->version);
-            info->numberOfPaths       = ntohl(info->numberOfPaths);
-            info->numberOfInfoEntries = ntohl(info->numberOfInfoEntries);
-            for (unsigned int i = 0; i < info->numberOfInfoEntries; ++i) {
-                info->entries[i].unknown0 = ntohl(info->entries[i].unknown0);
-                info->entries[i].unknown1 = ntohl(info->entries[i].unknown1);
-                info->entries[i].unknown2 = ntohl(info->entries[i].unknown2);
-                info->entries[i].unknown3 = ntohl(info->entries[i].unknown3);
+/* parses "first", "first-last" or "first-" */
+bool parse_range(const char* arg, BlockRange& range) {
+    char* end;
+    range.first = std::strtoul(arg, &end, 10);
+    if (end == arg) {
+        return false;
+    }
+    if (*end == '\0') {
+        range.last = range.first;
+        return true;
+    }
+    if (*end != '-') {
+        return false;
+    }
+    const char* last = end + 1;
+    if (*last == '\0') {
+        range.last = UINT32_MAX;
+        return true;
+    }
+    range.last = std::strtoul(last, &end, 10);
+    return (*end == '\0') && (range.last >= range.first);
+}
+
+/* what a block is used for, as found by print_stats */
+typedef enum {
+    kBlockUnreferenced, // not reachable from any variable
+    kBlockPathsLeaf,
+    kBlockPathsBranch,
+    kBlockInfo1,        // BOMPathInfo1 of a Paths entry
+    kBlockInfo2,        // BOMPathInfo2 of a Paths entry
+    kBlockFileName,     // BOMFile, the parent and name of a Paths entry
+    kBlockOtherTree,    // nodes and entries of the trees besides Paths
+    kBlockOther,        // variables and tree headers
+    kNumBlockKinds } block_kind_t;
+
+static const char* block_kind_names[kNumBlockKinds] = { "unreferenced", "paths leaves", "paths branches", "info1",
+                                                        "info2",        "file names",   "other trees",    "other" };
+
+/* block sizes of one kind, bucket i counts the sizes from 2^(i-1) + 1 to 2^i, bucket 0 empty blocks */
+struct BlockSizeStats {
+    uint64_t count;
+    uint64_t bytes;
+    uint32_t min;
+    uint32_t max;
+    uint64_t buckets[33];
+
+    BlockSizeStats()
+        : count(0)
+        , bytes(0)
+        , min(UINT32_MAX)
+        , max(0)
+        , buckets() {}
+
+    void add(uint32_t length) {
+        unsigned int bucket = 0;
+        while ((bucket < 32) && ((uint64_t)1 << bucket) < length) {
+            ++bucket;
+        }
+        buckets[length ? bucket : 0]++;
+        count++;
+        bytes += length;
+        min = std::min(min, length);
+        max = std::max(max, length);
+    }
+};
+
+/* the shape of the Paths tree */
+struct PathsShape {
+    uint32_t depth;
+    uint64_t entries;
+    uint64_t leaves;
+    uint64_t branches;
+    uint32_t minLeafCount;
+    uint32_t maxLeafCount;
+    uint64_t leafCapacity; // entries that would fit into all leaves at the block size of the tree
+    uint64_t chainLength;  // sum of the number of ancestors of every entry
+    uint32_t maxChainLength;
+
+    PathsShape()
+        : depth(0)
+        , entries(0)
+        , leaves(0)
+        , branches(0)
+        , minLeafCount(UINT32_MAX)
+        , maxLeafCount(0)
+        , leafCapacity(0)
+        , chainLength(0)
+        , maxChainLength(0) {}
+};
+
+/* marks a block, returns false if it was already marked */
+static bool mark(std::vector<uint8_t>& kinds, uint32_t id, block_kind_t kind) {
+    if ((id == 0) || (id >= kinds.size()) || (kinds[id] != kBlockUnreferenced)) {
+        return false;
+    }
+    kinds[id] = kind;
+    return true;
+}
+
+/* visits every node of a tree once, level by level like print_paths, and marks the nodes and the
+   blocks their entries point to; shape is only set for the Paths tree */
+static void scan_tree(BOMReader const& reader, uint32_t tree_id, std::vector<uint8_t>& kinds, PathsShape* shape) {
+    mark(kinds, tree_id, kBlockOther);
+    uint32_t       length;
+    const BOMTree* tree = (const BOMTree*)reader.lookup(tree_id, &length);
+    if (length < sizeof(BOMTree)) {
+        return;
+    }
+    uint32_t capacity = (ntohl(tree->blockSize) > sizeof(BOMPaths))
+                            ? (ntohl(tree->blockSize) - sizeof(BOMPaths)) / sizeof(BOMPathIndices)
+                            : 0;
+    std::unordered_map<uint32_t, uint32_t> chain; // number of ancestors by id
+    uint32_t const                         max_nodes = reader.numberOfBlockPointers();
+    uint32_t                               id        = ntohl(tree->child);
+    for (uint32_t depth = 0; id != 0; ++depth) {
+        if (depth > max_nodes) {
+            throw std::runtime_error("The tree contains a cycle");
+        }
+        uint32_t first_child = 0;
+        uint32_t num_nodes   = 0;
+        for (uint32_t node = id; node != 0; ++num_nodes) {
+            if (num_nodes > max_nodes) {
+                throw std::runtime_error("The forward pointers of the tree contain a cycle");
+            }
+            const BOMPaths* paths = paths_block(reader, node);
+            if (paths == nullptr) {
+                mark(kinds, node, shape ? kBlockPathsLeaf : kBlockOtherTree);
+                break;
+            }
+            bool     leaf  = (paths->isLeaf != htons(0));
+            uint16_t count = ntohs(paths->count);
+            mark(kinds, node, shape ? (leaf ? kBlockPathsLeaf : kBlockPathsBranch) : kBlockOtherTree);
+            if (shape) {
+                shape->depth = depth + 1;
+                if (leaf) {
+                    shape->leaves++;
+                    shape->entries += count;
+                    shape->minLeafCount = std::min<uint32_t>(shape->minLeafCount, count);
+                    shape->maxLeafCount = std::max<uint32_t>(shape->maxLeafCount, count);
+                    shape->leafCapacity += capacity;
+                } else {
+                    shape->branches++;
+                }
+            }
+            for (unsigned int i = 0; i < count; ++i) {
+                uint32_t index0 = ntohl(paths->indices[i].index0);
+                uint32_t index1 = ntohl(paths->indices[i].index1);
+                if (shape == nullptr) {
+                    if (leaf) {
+                        mark(kinds, index0, kBlockOtherTree);
+                    }
+                    mark(kinds, index1, kBlockOtherTree);
+                    continue;
+                }
+                mark(kinds, index1, kBlockFileName);
+                if (leaf == false) {
+                    continue;
+                }
+                if (mark(kinds, index0, kBlockInfo1)) {
+                    uint32_t            info1_length;
+                    const BOMPathInfo1* info1 = (const BOMPathInfo1*)reader.lookup(index0, &info1_length);
+                    if (info1_length >= sizeof(BOMPathInfo1)) {
+                        mark(kinds, ntohl(info1->index), kBlockInfo2);
+                        uint32_t       file_length;
+                        const BOMFile* file = (const BOMFile*)reader.lookup(index1, &file_length);
+                        uint32_t       ancestors = 0;
+                        if ((file_length >= sizeof(BOMFile)) && (file->parent != 0)) {
+                            std::unordered_map<uint32_t, uint32_t>::const_iterator it = chain.find(ntohl(file->parent));
+                            ancestors = (it != chain.end()) ? it->second + 1 : 1;
+                        }
+                        chain[ntohl(info1->id)] = ancestors;
+                        shape->chainLength += ancestors;
+                        shape->maxChainLength = std::max(shape->maxChainLength, ancestors);
+                    }
+                }
             }
-            std::cout << "info->version = " << info->version << std::endl;
-            std::cout << "info->numberOfPaths = " << info->numberOfPaths << std::endl;
-            std::cout << "info->numberOfInfoEntries = " << info->numberOfInfoEntries << std::endl;
-            for (unsigned int i = 0; i < info->numberOfInfoEntries; ++i) {
-                std::cout << "info->entries[" << i << "].unknown0 = " << info->entries[i].unknown0
-                          << std::endl;
-                std::cout << "info->entries[" << i << "].unknown1 = " << info->entries[i].unknown1
-                          << std::endl;
-                std::cout << "info->entries[" << i << "].unknown2 = " << info->entries[i].unknown2
-                          << std::endl;
-                std::cout << "info->entries[" << i << "].unknown3 = " << info->entries[i].unknown3
-                          << std::endl;
+            if ((node == id) && (leaf == false) && (count != 0)) {
+                first_child = ntohl(paths->indices[0].index0);
             }
+            node = ntohl(paths->forward);
+        }
+        id = first_child;
+    }
+}
+
+static void print_row(const char* name, uint64_t value, const char* unit = nullptr) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << value;
+    if (unit) {
+        std::cout << ' ' << unit;
+    }
+    std::cout << '\n';
+}
+
+/* prints the block size histograms, the space accounting and the shape of the Paths tree */
+void print_stats(BOMReader const& reader, std::vector<std::pair<std::string, uint32_t>> const& vars) {
+    uint32_t const       num_blocks = reader.numberOfBlockPointers();
+    std::vector<uint8_t> kinds(num_blocks, kBlockUnreferenced);
+    PathsShape           shape;
+    bool                 has_paths = false;
+    for (std::size_t i = 0; i < vars.size(); ++i) {
+        std::string const& name  = vars[i].first;
+        uint32_t           index = vars[i].second;
+        if ((name == "Paths") || (name == "HLIndex") || (name == "Size64")) {
+            has_paths = has_paths || (name == "Paths");
+            scan_tree(reader, index, kinds, (name == "Paths") ? &shape : nullptr);
         } else if (name == "VIndex") {
-            BOMVIndex* vindex    = (BOMVIndex*)&buffer[ptr.address];
-            vindex->unknown0     = ntohl(vindex->unknown0);
-            vindex->indexToVTree = ntohl(vindex->indexToVTree);
-            vindex->unknown2     = ntohl(vindex->unknown2);
-            // vindex->unknown3 is a byte so conversion not needed
-            std::cout << "vindex->unknown0 = " << vindex->unknown0 << std::endl;
-            std::cout << "vindex->indexToVTree = " << vindex->indexToVTree << std::endl;
-            std::cout << "vindex->unknown2 = " << vindex->unknown2 << std::endl;
-            std::cout << "vindex->unknown3 = " << (int)vindex->unknown3 << std::endl;
-            std::cout << std::endl;
-            BOMPointer& v_ptr = block_table->blockPointers[vindex->indexToVTree];
-            BOMTree*    tree  = (BOMTree*)&buffer[v_ptr.address];
-            print_tree(tree, buffer, block_table);
+            mark(kinds, index, kBlockOther);
+            uint32_t         length;
+            const BOMVIndex* vindex = (const BOMVIndex*)reader.lookup(index, &length);
+            if (length >= sizeof(BOMVIndex)) {
+                scan_tree(reader, ntohl(vindex->indexToVTree), kinds, nullptr);
+            }
         } else {
-            unsigned int i;
-            uint32_t*    raw = (uint32_t*)&buffer[ptr.address];
-            for (i = 0; i < ptr.length / sizeof(uint32_t); ++i) {
-                std::cout << "0x" << std::setbase(16) << std::setw(8) << std::setfill('0') << ntohl(raw[i])
-                          << std::setbase(10) << std::endl;
+            mark(kinds, index, kBlockOther);
+        }
+    }
+
+    BlockSizeStats sizes[kNumBlockKinds];
+    uint64_t       block_bytes = 0;
+    for (uint32_t i = 1; i < num_blocks; ++i) {
+        if ((reader.blockAddress(i) == 0) && (reader.blockLength(i) == 0)) {
+            continue;
+        }
+        sizes[kinds[i]].add(reader.blockLength(i));
+        block_bytes += reader.blockLength(i);
+    }
+
+    std::cout << "Blocks:" << '\n';
+    std::cout << "  " << std::left << std::setw(16) << "kind" << std::right << std::setw(10) << "count"
+              << std::setw(12) << "bytes" << std::setw(10) << "min" << std::setw(10) << "max" << std::setw(10)
+              << "avg" << '\n';
+    for (unsigned int k = 0; k < kNumBlockKinds; ++k) {
+        BlockSizeStats const& s = sizes[k];
+        std::cout << "  " << std::left << std::setw(16) << block_kind_names[k] << std::right << std::setw(10)
+                  << s.count << std::setw(12) << s.bytes << std::setw(10) << (s.count ? s.min : 0) << std::setw(10)
+                  << s.max << std::setw(10) << std::fixed << std::setprecision(1)
+                  << (s.count ? (double)s.bytes / s.count : 0.) << '\n';
+    }
+    for (unsigned int k = 0; k < kNumBlockKinds; ++k) {
+        BlockSizeStats const& s = sizes[k];
+        if (s.count == 0) {
+            continue;
+        }
+        std::cout << '\n' << "Sizes of " << block_kind_names[k] << ":" << '\n';
+        for (unsigned int b = 0; b < 33; ++b) {
+            if (s.buckets[b] == 0) {
+                continue;
+            }
+            uint64_t low  = (b == 0) ? 0 : (b == 1) ? 1 : ((uint64_t)1 << (b - 1)) + 1;
+            uint64_t high = (b == 0) ? 0 : ((uint64_t)1 << b);
+            std::cout << "  " << std::setw(10) << low << " - " << std::left << std::setw(10) << high << std::right
+                      << std::setw(10) << s.buckets[b] << '\n';
+        }
+    }
+
+    const BOMHeader* header       = (const BOMHeader*)reader.buffer();
+    uint64_t const   vars_length  = ntohl(header->varsLength);
+    uint64_t const   index_length = ntohl(header->indexLength);
+    /* the header is padded to 512 bytes before the variables */
+    uint64_t const   used         = 512 + vars_length + index_length + block_bytes;
+    uint64_t         free_bytes   = 0;
+    uint32_t         free_ranges  = 0;
+    uint64_t const   free_list_pos =
+        ntohl(header->indexOffset) + sizeof(uint32_t) + ((uint64_t)num_blocks * sizeof(BOMPointer));
+    if (free_list_pos + sizeof(uint32_t) <= reader.size()) {
+        const BOMFreeList* free_list = (const BOMFreeList*)(reader.buffer() + free_list_pos);
+        uint32_t           n         = ntohl(free_list->numberOfFreeListPointers);
+        for (uint32_t i = 0; (i < n) && (free_list_pos + sizeof(uint32_t) + (i + 1) * sizeof(BOMPointer) <= reader.size()); ++i) {
+            uint32_t length = ntohl(free_list->freelistPointers[i].length);
+            if (length != 0) {
+                free_ranges++;
+                free_bytes += length;
             }
-            i *= sizeof(uint32_t);
-            for (; i < ptr.length; ++i) {
-                std::cout << "0x" << std::setbase(16) << std::setw(2) << std::setfill('0')
-                          << (int)buffer[ptr.address + i] << std::endl;
+        }
+    }
+    uint64_t const gaps = (reader.size() > used) ? reader.size() - used : 0;
+
+    std::cout << '\n' << "Space:" << '\n';
+    print_row("file", reader.size(), "bytes");
+    print_row("header", 512, "bytes");
+    print_row("variables", vars_length, "bytes");
+    print_row("block table", index_length, "bytes");
+    print_row("live blocks", block_bytes - sizes[kBlockUnreferenced].bytes, "bytes");
+    print_row("dead blocks", sizes[kBlockUnreferenced].bytes, "bytes");
+    print_row("free list", free_bytes, "bytes");
+    print_row("free list ranges", free_ranges);
+    print_row("unaccounted gaps", (gaps > free_bytes) ? gaps - free_bytes : 0, "bytes");
+
+    std::cout << '\n' << "Paths tree:" << '\n';
+    if (has_paths == false) {
+        std::cout << "  (no Paths variable)" << '\n';
+        return;
+    }
+    print_row("depth", shape.depth, "levels");
+    print_row("entries", shape.entries);
+    print_row("leaves", shape.leaves);
+    print_row("branches", shape.branches);
+    print_row("min entries/leaf", shape.leaves ? shape.minLeafCount : 0);
+    print_row("max entries/leaf", shape.maxLeafCount);
+    std::cout << "  " << std::left << std::setw(20) << "avg entries/leaf" << std::right << std::fixed
+              << std::setprecision(1) << (shape.leaves ? (double)shape.entries / shape.leaves : 0.) << '\n';
+    std::cout << "  " << std::left << std::setw(20) << "leaf fill" << std::right << std::fixed << std::setprecision(1)
+              << (shape.leafCapacity ? 100. * shape.entries / shape.leafCapacity : 0.) << " %" << '\n';
+    std::cout << "  " << std::left << std::setw(20) << "avg parent chain" << std::right << std::fixed
+              << std::setprecision(2) << (shape.entries ? (double)shape.chainLength / shape.entries : 0.) << '\n';
+    print_row("max parent chain", shape.maxChainLength);
+}
+
+void usage() {
+    std::cout << "Usage: dumpbom [-v variable] [-b first[-last]] [--stats] bomfile" << std::endl << std::endl;
+    std::cout << "\t-v\tOnly dump the variable with this name, may be repeated" << std::endl;
+    std::cout << "\t-b\tOnly dump the block table entries and contents of a range of block ids, may be repeated" << std::endl;
+    std::cout << "\t--stats\tPrint block size histograms, dead and free space and the shape of the paths tree instead" << std::endl;
+    std::cout << std::endl << "Without -v and -b the header, the variable list and every variable are dumped." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> selected_vars;
+    std::vector<BlockRange>  selected_blocks;
+    bool                     print_statistics = false;
+
+    static const struct option long_options[] = {
+        { "stats", no_argument, nullptr, 'S' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    while (true) {
+        char c = ::getopt_long(argc, argv, "hv:b:", long_options, nullptr);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+            case 'v': selected_vars.push_back(optarg); break;
+            case 'b': {
+                BlockRange range;
+                if (parse_range(optarg, range) == false) {
+                    std::cerr << "Invalid block range: " << optarg << std::endl;
+                    return 1;
+                }
+                selected_blocks.push_back(range);
+                break;
             }
+            case 'S': print_statistics = true; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
         }
     }
-    
-    delete[] buffer;
+
+    if ((argc - optind) != 1) {
+        usage();
+        return 1;
+    }
+
+    try {
+        BOMReader reader;
+        reader.open(argv[optind]);
+        std::vector<std::pair<std::string, uint32_t>> vars = read_vars(reader);
+
+        if (print_statistics) {
+            print_stats(reader, vars);
+            std::cout << std::flush;
+            return 0;
+        }
+        if (selected_vars.empty() && selected_blocks.empty()) {
+            print_header(reader, argv[optind]);
+            print_var_list(vars);
+            for (std::size_t i = 0; i < vars.size(); ++i) {
+                print_var(reader, vars[i].first, vars[i].second);
+            }
+        }
+        for (std::size_t i = 0; i < selected_vars.size(); ++i) {
+            std::size_t v = 0;
+            while ((v < vars.size()) && (vars[v].first != selected_vars[i])) {
+                ++v;
+            }
+            if (v == vars.size()) {
+                std::cout.flush();
+                std::cerr << "No variable named \"" << selected_vars[i] << "\"" << std::endl;
+                return 1;
+            }
+            print_var(reader, vars[v].first, vars[v].second);
+        }
+        for (std::size_t i = 0; i < selected_blocks.size(); ++i) {
+            print_blocks(reader, selected_blocks[i]);
+        }
+    } catch (std::exception const& e) {
+        std::cout.flush();
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << std::flush;
     return 0;
-}
\ No newline at end of file
+}
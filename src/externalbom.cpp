@@ -0,0 +1,469 @@
+/*
+  externalbom.cpp - builds a bom file from a file list that does not fit into memory
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#include "binmanifest.hpp"
+#include "bomstreamwriter.hpp"
+#include "externalbom.hpp"
+#include "pathstree.hpp"
+#include "stats.hpp"
+#include "tempfile.hpp"
+
+/* every open run is read through a buffer of this size, so at most
+   memoryBudget / RUN_BUFFER_SIZE runs are merged at once */
+#define RUN_BUFFER_SIZE (64 * 1024)
+#define MIN_MERGE_WAYS  2
+
+/* one line of the file list and the keys it is sorted by */
+struct ManifestRecord {
+    uint32_t    depth; // number of slashes in path
+    uint64_t    seq;   // line number, the last of several lines for the same path wins
+    std::string path;
+    Node        node;
+};
+
+using run_list_t = std::vector<std::unique_ptr<TempFile>>;
+
+/* an error in the file list itself, reported without the output path */
+class FileListError : public std::runtime_error {
+    public:
+        explicit FileListError(std::string const& what)
+            : std::runtime_error(what) {}
+};
+
+/* compares like strcmp, except that '/' sorts before every other character,
+   which orders paths like the lists of their components */
+static int compare_paths(std::string const& a, std::string const& b) {
+    std::size_t n = std::min(a.size(), b.size());
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned int ca = (a[i] == '/') ? 0 : (unsigned char)a[i];
+        unsigned int cb = (b[i] == '/') ? 0 : (unsigned char)b[i];
+        if (ca != cb) {
+            return (ca < cb) ? -1 : 1;
+        }
+    }
+    return (a.size() < b.size()) ? -1 : ((a.size() > b.size()) ? 1 : 0);
+}
+
+/* The order of the Paths tree: breadth first, the children of each directory sorted by name.
+   Sorting by depth and then by the components of the path gives exactly that order. */
+static bool record_less(ManifestRecord const& a, ManifestRecord const& b) {
+    if (a.depth != b.depth) {
+        return a.depth < b.depth;
+    }
+    int c = compare_paths(a.path, b.path);
+    if (c != 0) {
+        return c < 0;
+    }
+    return a.seq < b.seq;
+}
+
+static std::size_t record_memory(ManifestRecord const& r) {
+    return sizeof(ManifestRecord) + r.path.capacity() + r.node.linkName.capacity();
+}
+
+/* Runs are only read back by this process, so their records are stored in host byte order */
+class RunWriter {
+    private:
+        std::string       file_path;
+        std::ofstream     file;
+        std::vector<char> buffer;
+
+        template <typename T>
+        void put(T value) { file.write((const char*)&value, sizeof(T)); }
+
+        void putString(std::string const& s) {
+            put<uint32_t>(s.size());
+            file.write(s.data(), s.size());
+        }
+
+    public:
+        explicit RunWriter(std::string const& path)
+            : file_path(path)
+            , buffer(RUN_BUFFER_SIZE) {
+            file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            file.open(path.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+            if (file.fail()) {
+                throw std::runtime_error("unable to open " + path);
+            }
+        }
+
+        void write(ManifestRecord const& r) {
+            put<uint32_t>(r.depth);
+            put<uint64_t>(r.seq);
+            put<uint8_t>(r.node.type);
+            put<uint32_t>(r.node.mode);
+            put<uint32_t>(r.node.uid);
+            put<uint32_t>(r.node.gid);
+            put<uint32_t>(r.node.size);
+            put<uint32_t>(r.node.checksum);
+            put<uint32_t>(r.node.linkNameLength);
+            putString(r.path);
+            putString(r.node.linkName);
+        }
+
+        void close() {
+            file.close();
+            if (file.fail()) {
+                throw std::runtime_error("unable to write " + file_path);
+            }
+        }
+};
+
+class RunReader {
+    private:
+        std::ifstream     file;
+        std::vector<char> buffer;
+
+        template <typename T>
+        bool get(T& value) { return file.read((char*)&value, sizeof(T)).good(); }
+
+        bool getString(std::string& s) {
+            uint32_t length;
+            if (get(length) == false) {
+                return false;
+            }
+            s.resize(length);
+            return file.read(&s[0], length).good();
+        }
+
+    public:
+        ManifestRecord current;
+
+        explicit RunReader(std::string const& path)
+            : buffer(RUN_BUFFER_SIZE) {
+            file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            file.open(path.c_str(), std::ios::binary | std::ios::in);
+            if (file.fail()) {
+                throw std::runtime_error("unable to open " + path);
+            }
+        }
+
+        /* reads the next record into current, returns false at the end of the run */
+        bool next() {
+            uint8_t type;
+            if (get(current.depth) == false) {
+                return false;
+            }
+            if ((get(current.seq) && get(type) && get(current.node.mode) && get(current.node.uid) &&
+                 get(current.node.gid) && get(current.node.size) && get(current.node.checksum) &&
+                 get(current.node.linkNameLength) && getString(current.path) &&
+                 getString(current.node.linkName)) == false) {
+                throw std::runtime_error("truncated run file");
+            }
+            current.node.type = (node_enum_t)type;
+            return true;
+        }
+};
+
+/* sorts the buffered records and moves them to a new run */
+static void spill_run(std::vector<ManifestRecord>& records, run_list_t& runs, std::string const& dir) {
+    std::sort(records.begin(), records.end(), record_less);
+    runs.emplace_back(new TempFile(dir, "mkbom-run"));
+    RunWriter run(runs.back()->path());
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        run.write(records[i]);
+    }
+    run.close();
+    records.clear();
+}
+
+/* hands the records of the runs to sink in sorted order; sink may take the contents of the record */
+template <typename Sink>
+static void merge_runs(run_list_t::const_iterator begin, run_list_t::const_iterator end, Sink sink) {
+    std::vector<std::unique_ptr<RunReader>> readers;
+    auto greater = [&readers](std::size_t a, std::size_t b) {
+        return record_less(readers[b]->current, readers[a]->current);
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(greater)> heap(greater);
+    for (run_list_t::const_iterator it = begin; it != end; ++it) {
+        readers.emplace_back(new RunReader((*it)->path()));
+        if (readers.back()->next()) {
+            heap.push(readers.size() - 1);
+        }
+    }
+    while (heap.empty() == false) {
+        std::size_t i = heap.top();
+        heap.pop();
+        sink(readers[i]->current);
+        if (readers[i]->next()) {
+            heap.push(i);
+        }
+    }
+}
+
+/* merges groups of runs until at most ways runs are left */
+static void reduce_runs(run_list_t& runs, std::size_t ways, std::string const& dir) {
+    while (runs.size() > ways) {
+        run_list_t merged;
+        for (std::size_t i = 0; i < runs.size(); i += ways) {
+            std::size_t end = std::min(runs.size(), i + ways);
+            if ((end - i) == 1) {
+                merged.push_back(std::move(runs[i]));
+                continue;
+            }
+            merged.emplace_back(new TempFile(dir, "mkbom-run"));
+            RunWriter run(merged.back()->path());
+            merge_runs(runs.begin() + i, runs.begin() + end, [&run](ManifestRecord& r) { run.write(r); });
+            run.close();
+            for (std::size_t j = i; j < end; ++j) {
+                runs[j].reset();
+            }
+        }
+        runs.swap(merged);
+    }
+}
+
+/* The entries arrive level by level in the order of the tree, so the parents of one level are
+   the directories of the previous level in the same order. These are kept in a file and read
+   back alongside the next level, which finds every parent with a single forward scan. */
+class ParentFinder {
+    private:
+        std::unique_ptr<TempFile> files[2];
+        std::ofstream             writer;
+        std::ifstream             reader;
+        std::vector<char>         writer_buffer;
+        std::vector<char>         reader_buffer;
+        unsigned int              current;
+        uint32_t                  depth;
+        bool                      started;
+        std::string               parent_path;
+        uint32_t                  parent_id;
+        bool                      parent_valid;
+
+        bool readParent() {
+            uint32_t length;
+            if (reader.read((char*)&parent_id, sizeof(uint32_t)).fail() ||
+                reader.read((char*)&length, sizeof(uint32_t)).fail()) {
+                return false;
+            }
+            parent_path.resize(length);
+            return reader.read(&parent_path[0], length).good();
+        }
+
+    public:
+        explicit ParentFinder(std::string const& dir)
+            : writer_buffer(RUN_BUFFER_SIZE)
+            , reader_buffer(RUN_BUFFER_SIZE)
+            , current(0)
+            , depth(0)
+            , started(false)
+            , parent_id(0)
+            , parent_valid(false) {
+            files[0].reset(new TempFile(dir, "mkbom-level"));
+            files[1].reset(new TempFile(dir, "mkbom-level"));
+            writer.rdbuf()->pubsetbuf(writer_buffer.data(), writer_buffer.size());
+            reader.rdbuf()->pubsetbuf(reader_buffer.data(), reader_buffer.size());
+        }
+
+        void startLevel(uint32_t d) {
+            bool has_previous = started && (d == depth + 1);
+            if (writer.is_open()) {
+                writer.close();
+                if (writer.fail()) {
+                    throw std::runtime_error("unable to write " + files[current]->path());
+                }
+            }
+            if (reader.is_open()) {
+                reader.close();
+            }
+            reader.clear();
+            if (has_previous) {
+                reader.open(files[current]->path().c_str(), std::ios::binary | std::ios::in);
+                current ^= 1;
+            }
+            writer.clear();
+            writer.open(files[current]->path().c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+            if (writer.fail()) {
+                throw std::runtime_error("unable to open " + files[current]->path());
+            }
+            depth        = d;
+            started      = true;
+            parent_valid = has_previous && readParent();
+        }
+
+        void addDirectory(std::string const& path, uint32_t id) {
+            uint32_t length = path.size();
+            writer.write((const char*)&id, sizeof(uint32_t));
+            writer.write((const char*)&length, sizeof(uint32_t));
+            writer.write(path.data(), length);
+        }
+
+        /* the parents must be looked up in ascending order */
+        bool find(std::string const& path, uint32_t& id) {
+            while (parent_valid) {
+                int c = compare_paths(parent_path, path);
+                if (c == 0) {
+                    id = parent_id;
+                    return true;
+                }
+                if (c > 0) {
+                    return false;
+                }
+                parent_valid = readParent();
+            }
+            return false;
+        }
+};
+
+/* adds the sorted records to the Paths tree, of several records for one path only the last */
+class TreeEmitter {
+    private:
+        PathsTreeWriter<BOMStreamWriter>& paths;
+        ParentFinder                      parents;
+        uint32_t                          depth;
+        bool                              started;
+        ManifestRecord                    pending;
+        bool                              has_pending;
+
+        void emit(ManifestRecord const& r) {
+            if ((started == false) || (r.depth != depth)) {
+                parents.startLevel(r.depth);
+                depth   = r.depth;
+                started = true;
+            }
+            std::size_t slash  = r.path.rfind('/');
+            uint32_t    parent = 0;
+            std::size_t begin  = (slash == std::string::npos) ? 0 : slash + 1;
+            if (((slash != std::string::npos) && (parents.find(r.path.substr(0, slash), parent) == false)) ||
+                (begin == r.path.size())) {
+                throw FileListError("Parent directory of file/folder \"" + r.path + "\" does not appear in list");
+            }
+            paths.add(parent, r.path.c_str() + begin, r.node.type, r.node.mode, r.node.uid, r.node.gid,
+                      r.node.size, r.node.checksum, r.node.linkName.c_str());
+            if (r.node.type == kDirectoryNode) {
+                parents.addDirectory(r.path, paths.size());
+            }
+        }
+
+    public:
+        TreeEmitter(PathsTreeWriter<BOMStreamWriter>& p, std::string const& dir)
+            : paths(p)
+            , parents(dir)
+            , depth(0)
+            , started(false)
+            , has_pending(false) {}
+
+        /* takes the contents of r */
+        void add(ManifestRecord& r) {
+            if (has_pending && ((pending.depth != r.depth) || (compare_paths(pending.path, r.path) != 0))) {
+                emit(pending);
+            }
+            std::swap(pending, r);
+            has_pending = true;
+        }
+
+        void finish() {
+            if (has_pending) {
+                emit(pending);
+            }
+        }
+};
+
+void write_bom_external(std::istream& lsbom_file, std::string const& output_path,
+                        BOMLayout const& layout, ExternalSortOptions const& options) {
+    validate_layout(layout);
+    if (layout.clustered) {
+        throw std::runtime_error("The clustered layout cannot be used with a memory budget");
+    }
+    if (lsbom_file.peek() == (unsigned char)BOM_MANIFEST_MAGIC[0]) {
+        throw std::runtime_error("Binary file lists cannot be used with a memory budget, convert them with manifestconv -t");
+    }
+    std::string const dir  = options.tempDir.empty() ? default_temp_dir() : options.tempDir;
+    std::size_t const ways = std::max<uint64_t>(MIN_MERGE_WAYS, options.memoryBudget / RUN_BUFFER_SIZE);
+
+    try {
+        run_list_t                  runs;
+        std::vector<ManifestRecord> records;
+        uint64_t                    num_lines = 0;
+        {
+            StatsPhase  phase(kPhaseParse);
+            uint64_t    used = 0;
+            std::string line;
+            while (std::getline(lsbom_file, line)) {
+                records.emplace_back();
+                ManifestRecord& r = records.back();
+                try {
+                    parse_node(line, r.path, r.node);
+                } catch (std::runtime_error const& e) {
+                    throw FileListError(e.what());
+                }
+                r.depth = std::count(r.path.begin(), r.path.end(), '/');
+                r.seq   = num_lines++;
+                used += record_memory(r);
+                if (used >= options.memoryBudget) {
+                    spill_run(records, runs, dir);
+                    used = 0;
+                }
+            }
+            if (runs.size() && records.size()) {
+                spill_run(records, runs, dir);
+            }
+        }
+        {
+            StatsPhase phase(kPhaseTree);
+            if (runs.empty()) {
+                std::sort(records.begin(), records.end(), record_less);
+            } else {
+                reduce_runs(runs, ways, dir);
+            }
+        }
+
+        std::vector<std::string> var_names = { "BomInfo", "Paths", "HLIndex", "VIndex", "Size64" };
+        BOMStreamWriter          bom(output_path, var_names, dir);
+        {
+            StatsPhase phase(kPhaseEmit);
+            /* the number of entries is only known after removing duplicates, it is patched below */
+            add_bom_info(bom, (num_lines != 0) ? 1 : 0);
+            PathsTreeWriter<BOMStreamWriter> paths(bom, layout);
+            TreeEmitter                      emitter(paths, dir);
+            if (runs.empty()) {
+                for (std::size_t i = 0; i < records.size(); ++i) {
+                    emitter.add(records[i]);
+                }
+            } else {
+                merge_runs(runs.begin(), runs.end(), [&emitter](ManifestRecord& r) { emitter.add(r); });
+            }
+            emitter.finish();
+            paths.finish();
+            /* BomInfo is the first block */
+            uint32_t number_of_paths = htonl(paths.size() + 1);
+            bom.patchBlock(1, BOM_INFO_NUMBER_OF_PATHS_OFFSET, &number_of_paths, sizeof(uint32_t));
+            add_index_trees(bom, layout);
+        }
+        StatsPhase phase(kPhaseWrite);
+        bom.finish();
+    } catch (FileListError const&) {
+        throw;
+    } catch (std::runtime_error const& e) {
+        throw std::runtime_error("Unable to write " + output_path + ": " + e.what());
+    }
+}
@@ -0,0 +1,45 @@
+/*
+  externalbom.hpp - builds a bom file from a file list that does not fit into memory
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "writebom.hpp"
+
+struct ExternalSortOptions {
+    uint64_t    memoryBudget; // Bytes of parsed entries kept in memory before they are spilled to disk
+    std::string tempDir;      // Directory of the spill files
+
+    ExternalSortOptions()
+        : memoryBudget(256 * 1024 * 1024) {}
+};
+
+/* Does what write_bom does for a text file list, but keeps at most about memoryBudget bytes
+   of it in memory. The entries are sorted into runs on disk, the runs are merged into the
+   order of the Paths tree, and the blocks are written out as they are created. The output is
+   identical to that of write_bom. Clustered layouts and binary file lists are not supported.
+   Throws std::runtime_error if the file list is invalid or a file cannot be written. */
+void write_bom_external(std::istream& lsbom_file, std::string const& output_path,
+                        BOMLayout const& layout, ExternalSortOptions const& options);
@@ -0,0 +1,109 @@
+/*
+  idnames.cpp - user and group names of the ids lsbom prints
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#if !defined(WINDOWS)
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+#endif
+
+#include "idnames.hpp"
+
+/* the buffer getpwuid_r and getgrgid_r start with, it grows as long as they report ERANGE */
+#define ID_LOOKUP_BUFFER_SIZE 1024
+
+IdNames::IdNames(id_kind_t k)
+    : kind(k)
+    , fromFile(false)
+    , lastId(0)
+    , lastName(nullptr) {}
+
+std::string IdNames::lookup(uint32_t id) const {
+#if !defined(WINDOWS)
+    std::vector<char> buffer(ID_LOOKUP_BUFFER_SIZE);
+    while (true) {
+        const char* name = nullptr;
+        int         ret;
+        if (kind == kUserNames) {
+            struct passwd  pw;
+            struct passwd* result = nullptr;
+            ret                   = ::getpwuid_r(id, &pw, buffer.data(), buffer.size(), &result);
+            if ((ret == 0) && result) {
+                name = result->pw_name;
+            }
+        } else {
+            struct group  gr;
+            struct group* result = nullptr;
+            ret                  = ::getgrgid_r(id, &gr, buffer.data(), buffer.size(), &result);
+            if ((ret == 0) && result) {
+                name = result->gr_name;
+            }
+        }
+        if (name) {
+            return name;
+        }
+        if (ret != ERANGE) {
+            break;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+#endif
+    return std::to_string(id);
+}
+
+void IdNames::load(std::string const& path) {
+    std::ifstream input(path.c_str());
+    if (input.fail()) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    names.clear();
+    lastName = nullptr;
+    fromFile = true;
+    std::string line;
+    for (unsigned int number = 1; std::getline(input, line); ++number) {
+        if ((line.empty() == false) && (line[line.size() - 1] == '\r')) {
+            line.erase(line.size() - 1);
+        }
+        /* comments, and the +/- entries of NIS compat files, which refer to other databases */
+        if (line.empty() || (line[0] == '#') || (line[0] == '+') || (line[0] == '-')) {
+            continue;
+        }
+        std::size_t first  = line.find(':');
+        std::size_t second = (first == std::string::npos) ? first : line.find(':', first + 1);
+        if ((first == 0) || (second == std::string::npos)) {
+            throw std::runtime_error("Syntax error in line " + std::to_string(number) + " of " + path);
+        }
+        std::size_t   end   = line.find(':', second + 1);
+        std::string   field = line.substr(second + 1, (end == std::string::npos) ? end : end - second - 1);
+        char*         rest;
+        unsigned long id    = std::strtoul(field.c_str(), &rest, 10);
+        if (field.empty() || (*rest != '\0') || (id > UINT32_MAX)) {
+            throw std::runtime_error("Invalid id in line " + std::to_string(number) + " of " + path);
+        }
+        names.insert(std::make_pair((uint32_t)id, line.substr(0, first)));
+    }
+}
@@ -0,0 +1,70 @@
+/*
+  idnames.hpp - user and group names of the ids lsbom prints
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+typedef enum {
+    kUserNames,
+    kGroupNames,
+} id_kind_t;
+
+/* The names of user or group ids, each looked up once per run. By default the system databases
+   are asked through getpwuid_r and getgrgid_r, so directory services behind NSS see one request
+   per distinct id, not one per entry. After load(), only the file is used, which also works on
+   systems without those databases. Ids without a name are given as numbers. */
+class IdNames {
+    private:
+        id_kind_t                                 kind;
+        bool                                      fromFile;
+        std::unordered_map<uint32_t, std::string> names;
+        uint32_t                                  lastId; // most entries share their owner with the one before
+        std::string const*                        lastName;
+
+        IdNames(IdNames const&);
+        IdNames& operator=(IdNames const&);
+
+        std::string lookup(uint32_t id) const;
+
+    public:
+        explicit IdNames(id_kind_t kind);
+
+        /* Reads a file in the format of /etc/passwd or /etc/group: the name, a password and the id,
+           separated by colons, followed by fields that are ignored. The first name of an id wins.
+           Throws std::runtime_error if the file cannot be read or a line is malformed. */
+        void load(std::string const& path);
+
+        std::string const& name(uint32_t id) {
+            if ((lastName == nullptr) || (id != lastId)) {
+                std::unordered_map<uint32_t, std::string>::iterator it = names.find(id);
+                if (it == names.end()) {
+                    it = names.insert(std::make_pair(id, fromFile ? std::to_string(id) : lookup(id))).first;
+                }
+                lastId   = id;
+                lastName = &it->second;
+            }
+            return *lastName;
+        }
+};
@@ -23,22 +23,47 @@
 #include <iostream>
 #include <climits>
 #include <unistd.h>
+#include <getopt.h>
+#include <string>
+#include <stdexcept>
 #include <cstdint>
 #include <cstdlib>
 #include "printnode.hpp"
+#include "pathfilter.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 void usage() {
-    std::cout << "Usage: ls4mkbom [-u uid] [-g gid] path" << std::endl << std::endl;
+    std::cout << "Usage: ls4mkbom [-u uid] [-g gid] [-b] [-x file] [--exclude=pattern] [--stats[=file]] [--trace=file] path" << std::endl << std::endl;
     std::cout << "\t-u\tForce user ID to the specified value" << std::endl;
     std::cout << "\t-g\tForce group ID to the specified value" << std::endl;
+    std::cout << "\t-b\tWrite the file list in the binary format, which mkbom -i reads faster" << std::endl;
+    std::cout << "\t-x\tRead gitignore style exclusion patterns from file, may be repeated" << std::endl;
+    std::cout << "\t--exclude\tExclude paths matching a gitignore style pattern, may be repeated" << std::endl;
+    std::cout << "\t--stats\tReport the time spent in each phase and some counters on stderr, or as JSON to file" << std::endl;
+    std::cout << "\t--trace\tWrite a Chrome trace of every directory read, stat and checksum to file" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     uint32_t uid = UINT_MAX;
     uint32_t gid = UINT_MAX;
     
+    manifest_format_t format = kTextManifest;
+    PathFilter        filter;
+    
+    std::string stats_path;
+    std::string trace_path;
+    
+    static const struct option long_options[] = {
+        { "stats", optional_argument, nullptr, 'S' },
+        { "trace", required_argument, nullptr, 'T' },
+        { "exclude-from", required_argument, nullptr, 'x' },
+        { "exclude", required_argument, nullptr, 'E' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    
     while (true) {
-        char c = ::getopt(argc, argv, "hu:g:");
+        char c = ::getopt_long(argc, argv, "hu:g:bx:", long_options, nullptr);
         if (c == -1) {
             break;
         }
@@ -46,17 +71,52 @@ int main(int argc, char* argv[]) {
         switch (c) {
             case 'u': uid = std::atol(optarg); break;
             case 'g': gid = std::atol(optarg); break;
+            case 'b': format = kBinaryManifest; break;
+            case 'x':
+                try {
+                    filter.load(optarg);
+                } catch (std::exception const& e) {
+                    std::cerr << std::endl << "Unable to read exclusion patterns: " << e.what() << std::endl;
+                    return 1;
+                }
+                break;
+            case 'E': filter.add(optarg); break;
+            case 'S':
+                stats_enabled = true;
+                stats_path    = optarg ? optarg : "";
+                break;
+            case 'T':
+                trace_enabled = true;
+                trace_path    = optarg;
+                break;
             case 'h': usage(); return 0;
             case ':':
             case '?': usage(); return 1;
         }
     }
+    trace_thread_name("main");
     
     if (optind == argc) {
         usage();
         return 1;
     }
     
-    print_node(std::cout, argv[optind], uid, gid);
+    try {
+        print_node(std::cout, argv[optind], uid, gid, format, filter.empty() ? nullptr : &filter);
+    } catch (std::exception const& e) {
+        std::cout.flush();
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (stats_enabled) {
+        std::cout.flush();
+        if (stats_output(stats_path, "ls4mkbom") == false) {
+            return 1;
+        }
+    }
+    if (trace_enabled && (trace_write(trace_path) == false)) {
+        std::cerr << std::endl << "Unable to write trace to " << trace_path << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -24,8 +24,9 @@
 
 #include <iostream>
 #include <iomanip>
-#include <fstream>
-#include <map>
+#include <string>
+#include <stdexcept>
+#include <vector>
 
 // NOTE: Windows does not have several of these headers
 #include <cstring>
@@ -38,6 +39,10 @@
 #include <unistd.h> // For getopt
 #include <cctype>
 
+#include "bomutils.hpp"
+#include "idnames.hpp"
+#include "xar.hpp"
+
 // Pass -D to enable debug outputs
 #define DEBUG(level, msg)                                                                          \
     if (level <= debug) {                                                                          \
@@ -53,29 +58,15 @@ enum {
     LIST_ALL   = 0x1f,
 };
 
-static int            debug = 0;
-static char*          data;
-static BOMBlockTable* indexHeader;
-
-char* lookup(int i, uint32_t* length = 0) {
-    BOMPointer* index = indexHeader->blockPointers + ntohl(i);
-    if (length) {
-        *length = ntohl(index->length);
-    }
-    uint32_t addr = ntohl(index->address);
-    DEBUG(2, "@ index=0x" << std::hex << ntohl(i) << " addr=0x"
-                          << std::hex << std::setw(4) << std::setfill('0') << addr << " len="
-                          << std::dec << ntohl(index->length));
-    return data + addr;
-}
+static int debug = 0;
 
 void short_usage() {
-    std::cout << "Usage: lsbom [-h] [-s] [-f] [-d] [-l] [-b] [-c] [-m] [-x]\n"
+    std::cout << "Usage: lsbom [-h] [-s] [-f] [-d] [-l] [-b] [-c] [-m] [-x] [-U passwd-file] [-G group-file]\n"
               << "\t"
 #if 0
                   "[--arch archVal] "
 #endif
-                  "[-p parameters] bom ..."
+                  "[-p parameters] bom|pkg ..."
               << std::endl;
 }
 
@@ -97,6 +88,8 @@ void usage() {
                  "\t-c              list character devices\n"
                  "\t-m              print modified times\n"
                  "\t-x              suppress modes for directories and symlinks\n"
+                 "\t-U passwd-file  take the user names of U and ? from a file in the format of /etc/passwd\n"
+                 "\t-G group-file   take the group names of G and ? from a file in the format of /etc/group\n"
 #if 0
                  "\t--arch archVal  print info for architecture archVal (\"ppc\", "
                  "\"i386\", \"hppa\", \"sparc\", etc)\n"
@@ -138,9 +131,11 @@ int main(int argc, char* argv[]) {
     bool pathsOnly           = false;
     int  listType            = 0;
     char params[16]          = "";
+    IdNames users(kUserNames);
+    IdNames groups(kGroupNames);
     
     while (true) {
-        char c = getopt(argc, argv, "hsfdlbcmxp:D::");
+        char c = getopt(argc, argv, "hsfdlbcmxp:U:G:D::");
         if (c == -1) {
             break;
         }
@@ -155,6 +150,14 @@ int main(int argc, char* argv[]) {
             case 'c': listType |= LIST_CDEVS; break;
             case 'm': std::strcat(params, "T"); break;
             case 'x': suppressDirSimModes = true; break;
+            case 'U':
+            case 'G':
+                try {
+                    (c == 'U' ? users : groups).load(optarg);
+                } catch (std::exception const& e) {
+                    error(e.what());
+                }
+                break;
             case 'a': usage_error("--arch not supported"); break;
             case 'p':
                 if (15 < std::strlen(optarg)) {
@@ -191,266 +194,204 @@ int main(int argc, char* argv[]) {
         suppressDevSize = true;
     }
     
+    /* a product archive is listed one component after the other */
+    std::vector<std::string> boms;
     for (int i = optind; i < argc; i++) {
-        std::ifstream f(argv[i], std::ios::in | std::ios::binary);
-        
-        if (!f.is_open()) {
-            std::cerr << "Unable to open file: \"" << argv[i] << "\"" << std::endl;
-            return 1;
-        }
-        // Get file length
-        f.seekg(0, std::ios::end);
-        std::streampos length = f.tellg();
-        f.seekg(0);
-        // on unix we need an extra check as fstreams will happily open directories
-        if ((int)length == -1) {
-            std::cerr << "Unable to open file: \"" << argv[i] << "\"" << std::endl;
-            return 1;
-        }
-        
-        // Allocate space
-        data = new char[length];
-        
-        // Read data
-        f.read(data, length);
-        
-        if (f.fail()) {
-            std::cerr << "Failed to read BOM file" << std::endl;
-            return 1;
-        }
-        
-        f.close();
-        
-        BOMHeader* header = (BOMHeader*)data;
-        
-        if (std::string(header->magic, 8) != "BOMStore") {
-            std::cerr << "Not a BOM file: " << argv[i] << std::endl;
-            return 1;
-        }
-        
-        indexHeader = (BOMBlockTable*)(data + ntohl(header->indexOffset));
-        
-        // Process vars
-        BOMVars* vars = (BOMVars*)(data + ntohl(header->varsOffset));
-        char*    ptr  = (char*)vars->first;
-        for (unsigned i = 0; i < ntohl(vars->count); i++) {
-            BOMVar* var = (BOMVar*)ptr;
-            
-            uint32_t varDataLength;
-            char*    varData      = lookup(var->index, &varDataLength);
-            BOMTree* tree         = (BOMTree*)varData;
-            std::string   name    = std::string(var->name, var->length);
-            
-            DEBUG(2, "BOMVar 0x" << std::hex << ntohl(var->index) << ' ' << name << ':');
-            
-            if (name == "Paths") {
-                BOMPaths* paths = (BOMPaths*)lookup(tree->child);
-                
-                typedef std::map<uint32_t, std::string> filenames_t;
-                typedef std::map<uint32_t, uint32_t> parents_t;
-                
-                filenames_t filenames;
-                parents_t parents;
-                
-                while (paths->isLeaf == htons(0)) {
-                    paths = (BOMPaths*)lookup(paths->indices[0].index0);
+        try {
+            std::vector<XarFile> components;
+            if (is_xar_file(argv[i])) {
+                components = find_package_boms(argv[i]);
+            }
+            if (components.size() > 1) {
+                for (std::size_t j = 0; j < components.size(); ++j) {
+                    boms.push_back(std::string(argv[i]) + ":" + components[j].path);
                 }
+                continue;
+            }
+        } catch (std::exception const&) {
+            /* reported when the package is opened */
+        }
+        boms.push_back(argv[i]);
+    }
+
+    for (std::size_t i = 0; i < boms.size(); i++) {
+        try {
+            BomReader    reader(boms[i]);
+            BomPathEntry e;
+            while (reader.next(e)) {
+                std::string const&  filename = e.path;
+                const BOMPathInfo2* info2    = e.entry.info;
+                uint32_t            length2  = e.entry.infoLength;
                 
-                while (paths) {
-                    for (unsigned j = 0; j < ntohs(paths->count); j++) {
-                        uint32_t index0 = paths->indices[j].index0;
-                        uint32_t index1 = paths->indices[j].index1;
-                        
-                        BOMFile*      file  = (BOMFile*)lookup(index1);
-                        BOMPathInfo1* info1 = (BOMPathInfo1*)lookup(index0);
-                        uint32_t      length2;
-                        BOMPathInfo2* info2 = (BOMPathInfo2*)lookup(info1->index, &length2);
-                        
-                        // Compute full name
-                        std::string filename      = file->name;
-                        filenames[info1->id] = filename;
-                        if (file->parent) {
-                            parents[info1->id] = file->parent;
+                // Check type
+                switch (info2->type) {
+                    case TYPE_FILE:
+                        if (!(LIST_FILES & listType)) {
+                            continue;
                         }
-                        
-                        parents_t::iterator it = parents.find(info1->id);
-                        while (it != parents.end()) {
-                            filename = filenames[it->second] + "/" + filename;
-                            it       = parents.find(it->second);
+                        break;
+                    case TYPE_DIR:
+                        if (!(LIST_DIRS & listType)) {
+                            continue;
                         }
+                        break;
+                    case TYPE_LINK:
+                        if (!(LIST_LINKS & listType)) {
+                            continue;
+                        }
+                        break;
+                    case TYPE_DEV: {
+                        uint16_t mode    = ntohs(info2->mode);
+                        bool     isBlock = mode & 0x4000;
+                        if (isBlock && !(LIST_BDEVS & listType)) {
+                            continue;
+                        }
+                        if (!isBlock && !(LIST_CDEVS & listType)) {
+                            continue;
+                        }
+                        break;
+                    }
+                }
+                if (pathsOnly) {
+                    std::cout << filename << '\n';
+                } else {
+                    // Print requested parameters
+                    bool printed = true;
+                    for (unsigned j = 0; params[j]; j++) {
+                        if (j && printed) {
+                            std::cout << '\t';
+                        }
+                        printed = true;
                         
-                        // Check type
-                        switch (info2->type) {
-                            case TYPE_FILE:
-                                if (!(LIST_FILES & listType)) {
-                                    continue;
+                        switch (params[j]) {
+                            case 'f': std::cout << filename; continue;
+                            case 'F': std::cout << '"' << filename << '"'; continue;
+                            case 'g': std::cout << std::dec << ntohl(info2->group); continue;
+                            case 'G': std::cout << groups.name(ntohl(info2->group)); continue;
+                            case 'u': std::cout << std::dec << ntohl(info2->user); continue;
+                            case 'U': std::cout << users.name(ntohl(info2->user)); continue;
+                            case '/':
+                                std::cout << std::dec << ntohl(info2->user) << '/'
+                                          << ntohl(info2->group);
+                                continue;
+                            case '?':
+                                std::cout << users.name(ntohl(info2->user)) << '/'
+                                          << groups.name(ntohl(info2->group));
+                                continue;
+                            
+                            default:
+                                if (!suppressDirSimModes ||
+                                    (info2->type != TYPE_DIR && info2->type != TYPE_LINK)) {
+                                    switch (params[j]) {
+                                        case 'm':
+                                            std::cout << std::oct << ntohs(info2->mode);
+                                            continue;
+                                        case 'M':
+                                            error("Symbolic mode not yet supported");
+                                            break;
+                                    }
                                 }
-                                break;
-                            case TYPE_DIR:
-                                if (!(LIST_DIRS & listType)) {
-                                    continue;
+                                
+                                if (info2->type == TYPE_FILE || info2->type == TYPE_LINK) {
+                                    switch (params[j]) {
+                                        case 't':
+                                            std::cout << std::dec << ntohl(info2->modtime);
+                                            continue;
+                                        case 'T':
+                                            error("Formatted mod time not yet supported");
+                                            break;
+                                        case 'c':
+                                            std::cout << std::dec << ntohl(info2->checksum);
+                                            continue;
+                                    }
                                 }
-                                break;
-                            case TYPE_LINK:
-                                if (!(LIST_LINKS & listType)) {
-                                    continue;
+                                
+                                if (info2->type != TYPE_DIR &&
+                                    (!suppressDevSize || info2->type != TYPE_DEV)) {
+                                    switch (params[j]) {
+                                        case 's':
+                                            std::cout << std::dec << ntohl(info2->size);
+                                            continue;
+                                        case 'S':
+                                            error("Formatted size not yet supported");
+                                            break;
+                                    }
                                 }
-                                break;
-                            case TYPE_DEV: {
-                                uint16_t mode    = ntohs(info2->mode);
-                                bool     isBlock = mode & 0x4000;
-                                if (isBlock && !(LIST_BDEVS & listType)) {
-                                    continue;
+                                
+                                if (info2->type == TYPE_LINK) {
+                                    switch (params[j]) {
+                                        case 'l': std::cout << info2->linkName; continue;
+                                        case 'L':
+                                            std::cout << '"' << info2->linkName << '"';
+                                            continue;
+                                    }
                                 }
-                                if (!isBlock && !(LIST_CDEVS & listType)) {
-                                    continue;
+                                
+                                if (info2->type == TYPE_DEV) {
+                                    uint32_t devType = ntohl(info2->devType);
+                                    
+                                    switch (params[j]) {
+                                        case '0': std::cout << std::dec << devType; continue;
+                                        case '1': std::cout << std::dec << (devType >> 24); continue;
+                                        case '2': std::cout << std::dec << (devType & 0xff); continue;
+                                    }
                                 }
-                                break;
-                            }
                         }
-                        if (pathsOnly) {
-                            std::cout << filename << '\n';
-                        } else {
-                            // Print requested parameters
-                            bool printed = true;
-                            for (unsigned j = 0; params[j]; j++) {
-                                if (j && printed) {
-                                    std::cout << '\t';
+                        
+                        printed = false;
+                    }
+                }
+                std::cout << '\n';
+                
+                DEBUG(1, "id=0x" << std::hex << e.entry.id << ' ' << "parent=0x"
+                                 << e.entry.parent << ' ' << "type=" << std::dec
+                                 << (unsigned)info2->type << ' ' << "unknown0=" << std::dec
+                                 << (unsigned)info2->unknown0 << ' ' << "architecture=0x"
+                                 << std::hex << ntohs(info2->architecture) << ' '
+                                 << "unknown1=" << std::dec << (unsigned)info2->unknown1 << ' '
+                                 << "length2=" << std::dec << length2);
+                
+                if (3 < debug) {
+                    for (unsigned k = 0; k < length2; k++) {
+                        if (k) {
+                            if (k % 16 == 0 || k == length2 - 1) {
+                                unsigned len = k % 16;
+                                if (!len) {
+                                    len = 16;
                                 }
-                                printed = true;
                                 
-                                switch (params[j]) {
-                                    case 'f': std::cout << filename; continue;
-                                    case 'F': std::cout << '"' << filename << '"'; continue;
-                                    case 'g': std::cout << std::dec << ntohl(info2->group); continue;
-                                    case 'G': error("Group name not yet supported"); break;
-                                    case 'u': std::cout << std::dec << ntohl(info2->user); continue;
-                                    case 'U': error("User name not yet supported"); break;
-                                    case '/':
-                                        std::cout << std::dec << ntohl(info2->user) << '/'
-                                                  << ntohl(info2->group);
-                                        continue;
-                                    case '?': error("User/group name not yet supported"); break;
-                                    
-                                    default:
-                                        if (!suppressDirSimModes ||
-                                            (info2->type != TYPE_DIR && info2->type != TYPE_LINK)) {
-                                            switch (params[j]) {
-                                                case 'm':
-                                                    std::cout << std::oct << ntohs(info2->mode);
-                                                    continue;
-                                                case 'M':
-                                                    error("Symbolic mode not yet supported");
-                                                    break;
-                                            }
-                                        }
-                                        
-                                        if (info2->type == TYPE_FILE || info2->type == TYPE_LINK) {
-                                            switch (params[j]) {
-                                                case 't':
-                                                    std::cout << std::dec << ntohl(info2->modtime);
-                                                    continue;
-                                                case 'T':
-                                                    error("Formatted mod time not yet supported");
-                                                    break;
-                                                case 'c':
-                                                    std::cout << std::dec << ntohl(info2->checksum);
-                                                    continue;
-                                            }
-                                        }
-                                        
-                                        if (info2->type != TYPE_DIR &&
-                                            (!suppressDevSize || info2->type != TYPE_DEV)) {
-                                            switch (params[j]) {
-                                                case 's':
-                                                    std::cout << std::dec << ntohl(info2->size);
-                                                    continue;
-                                                case 'S':
-                                                    error("Formatted size not yet supported");
-                                                    break;
-                                            }
-                                        }
-                                        
-                                        if (info2->type == TYPE_LINK) {
-                                            switch (params[j]) {
-                                                case 'l': std::cout << info2->linkName; continue;
-                                                case 'L':
-                                                    std::cout << '"' << info2->linkName << '"';
-                                                    continue;
-                                            }
-                                        }
-                                        
-                                        if (info2->type == TYPE_DEV) {
-                                            uint32_t devType = ntohl(info2->devType);
-                                            
-                                            switch (params[j]) {
-                                                case '0': std::cout << std::dec << devType; continue;
-                                                case '1': std::cout << std::dec << (devType >> 24); continue;
-                                                case '2': std::cout << std::dec << (devType & 0xff); continue;
-                                            }
-                                        }
+                                if (len < 16) {
+                                    for (unsigned l = 0; l < 16 - len; l++) {
+                                        std::cout << "     ";
+                                    }
+                                    std::cout << ' ';
                                 }
                                 
-                                printed = false;
-                            }
-                        }
-                        std::cout << '\n';
-                        
-                        DEBUG(1, "id=0x" << std::hex << ntohl(info1->id) << ' ' << "parent=0x"
-                                         << ntohl(file->parent) << ' ' << "type=" << std::dec
-                                         << (unsigned)info2->type << ' ' << "unknown0=" << std::dec
-                                         << (unsigned)info2->unknown0 << ' ' << "architecture=0x"
-                                         << std::hex << ntohs(info2->architecture) << ' '
-                                         << "unknown1=" << std::dec << (unsigned)info2->unknown1 << ' '
-                                         << "length2=" << std::dec << length2);
-                        
-                        if (3 < debug) {
-                            for (unsigned k = 0; k < length2; k++) {
-                                if (k) {
-                                    if (k % 16 == 0 || k == length2 - 1) {
-                                        unsigned len = k % 16;
-                                        if (!len) {
-                                            len = 16;
-                                        }
-                                        
-                                        if (len < 16) {
-                                            for (unsigned l = 0; l < 16 - len; l++) {
-                                                std::cout << "     ";
-                                            }
-                                            std::cout << ' ';
-                                        }
-                                        
-                                        for (unsigned l = k - len; l < k; l++) {
-                                            if (l % 8 == 0) {
-                                                std::cout << ' ';
-                                            }
-                                            
-                                            unsigned char c = ((unsigned char*)info2)[l];
-                                            if (std::isprint(c)) {
-                                                std::cout << (char)c;
-                                            } else {
-                                                std::cout << '.';
-                                            }
-                                        }
-                                        std::cout << '\n';
-                                    } else if (k % 8 == 0) {
+                                for (unsigned l = k - len; l < k; l++) {
+                                    if (l % 8 == 0) {
                                         std::cout << ' ';
                                     }
+                                    
+                                    unsigned char c = ((unsigned char*)info2)[l];
+                                    if (std::isprint(c)) {
+                                        std::cout << (char)c;
+                                    } else {
+                                        std::cout << '.';
+                                    }
                                 }
-                                std::cout << "0x" << std::setfill('0') << std::setw(2) << std::hex
-                                          << (unsigned)((unsigned char*)info2)[k] << ' ';
+                                std::cout << '\n';
+                            } else if (k % 8 == 0) {
+                                std::cout << ' ';
                             }
                         }
-                    }
-                    
-                    if (paths->forward == htonl(0)) {
-                        paths = 0;
-                    } else {
-                        paths = (BOMPaths*)lookup(paths->forward);
+                        std::cout << "0x" << std::setfill('0') << std::setw(2) << std::hex
+                                  << (unsigned)((unsigned char*)info2)[k] << ' ';
                     }
                 }
             }
-            ptr += sizeof(BOMVar) + var->length;
+        } catch (std::exception const& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
         }
     }
     
@@ -0,0 +1,125 @@
+/*
+  manifestconv.cpp - convert file lists between the text and the binary format
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "binmanifest.hpp"
+#include "mappedfile.hpp"
+
+void usage() {
+    std::cout << "Usage: manifestconv [-t | -b] source target" << std::endl << std::endl;
+    std::cout << "\t-t\tWrite the text format generated by ls4mkbom and lsbom" << std::endl;
+    std::cout << "\t-b\tWrite the binary format generated by ls4mkbom -b" << std::endl;
+    std::cout << std::endl << "By default the file list is converted to the other format. Use - for standard input or output." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    enum { kDetect, kText, kBinary } target_format = kDetect;
+    
+    while (true) {
+        char c = ::getopt(argc, argv, "htb");
+        if (c == -1) {
+            break;
+        }
+        
+        switch (c) {
+            case 't': target_format = kText; break;
+            case 'b': target_format = kBinary; break;
+            case 'h': usage(); return 0;
+            case ':':
+            case '?': usage(); return 1;
+        }
+    }
+    
+    if ((argc - optind) != 2) {
+        usage();
+        return 1;
+    }
+    
+    std::string       source(argv[optind]);
+    std::string       target(argv[optind + 1]);
+    std::ofstream     output_file;
+    MappedFile        input_file;
+    std::vector<char> buffer;
+    if (source != "-") {
+        try {
+            input_file.open(source.c_str());
+        } catch (std::exception const&) {
+            std::cerr << std::endl << "Unable to open file list: " << source << std::endl;
+            return 1;
+        }
+    } else {
+        buffer.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+    const char*       data          = (source != "-") ? input_file.buffer() : buffer.data();
+    std::size_t       length        = (source != "-") ? input_file.size() : buffer.size();
+    bool              binary_source = is_binary_manifest(data, length);
+    if (target_format == kDetect) {
+        target_format = binary_source ? kText : kBinary;
+    }
+    
+    if (target != "-") {
+        output_file.open(target.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+        if (output_file.fail()) {
+            std::cerr << std::endl << "Unable to open output file: " << target << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& output = (target != "-") ? output_file : std::cout;
+    
+    try {
+        if (binary_source) {
+            BinaryManifestReader reader;
+            reader.open(data, length);
+            if (target_format == kText) {
+                binary_to_text_manifest(reader, output);
+            } else {
+                output.write(data, length);
+            }
+        } else {
+            std::string text(data, length);
+            buffer.clear();
+            std::istringstream text_input(text);
+            if (target_format == kBinary) {
+                text_to_binary_manifest(text_input, output);
+            } else {
+                output << text;
+            }
+        }
+    } catch (std::exception const& e) {
+        std::cerr << std::endl << "Invalid binary file list: " << e.what() << std::endl;
+        return 1;
+    }
+    output.flush();
+    if (output.fail()) {
+        std::cerr << std::endl << "Unable to write " << target << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+  manifestwriter.hpp - buffered writer for the file lists printed by ls4mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+/* Collects the lines of a file list in a large buffer and only hands it to the stream when the
+   buffer is full or the writer is flushed, instead of flushing the stream after every line.
+   Numbers are formatted by hand to avoid the stream manipulators. */
+class ManifestWriter {
+    private:
+        std::ostream&     output;
+        std::vector<char> buffer;
+        std::size_t       used;
+
+        ManifestWriter(ManifestWriter const&);
+        ManifestWriter& operator=(ManifestWriter const&);
+
+        void reserve(std::size_t n) {
+            if (used + n > buffer.size()) {
+                flush();
+                if (n > buffer.size()) {
+                    buffer.resize(n);
+                }
+            }
+        }
+
+        ManifestWriter& number(uint64_t value, unsigned int base) {
+            char  digits[24];
+            char* end = digits + sizeof(digits);
+            char* p   = end;
+            do {
+                *--p = '0' + (value % base);
+                value /= base;
+            } while (value != 0);
+            return write(p, end - p);
+        }
+
+    public:
+        explicit ManifestWriter(std::ostream& o, std::size_t size = 256 * 1024)
+            : output(o)
+            , buffer(size)
+            , used(0) {}
+
+        ~ManifestWriter() { flush(); }
+
+        ManifestWriter& write(const char* data, std::size_t length) {
+            reserve(length);
+            std::memcpy(&buffer[used], data, length);
+            used += length;
+            return *this;
+        }
+
+        ManifestWriter& put(char c) {
+            reserve(1);
+            buffer[used++] = c;
+            return *this;
+        }
+
+        ManifestWriter& string(std::string const& s) { return write(s.data(), s.size()); }
+        ManifestWriter& string(const char* s) { return write(s, std::strlen(s)); }
+        ManifestWriter& decimal(uint64_t value) { return number(value, 10); }
+        ManifestWriter& octal(uint64_t value) { return number(value, 8); }
+
+        void flush() {
+            if (used != 0) {
+                output.write(&buffer[0], used);
+                used = 0;
+            }
+        }
+};
@@ -0,0 +1,123 @@
+/*
+  mappedfile.cpp - read-only view of a file, mapped where possible
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#if !defined(WINDOWS)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+MappedFile::MappedFile()
+    : data(nullptr)
+    , length(0)
+    , mapped(false)
+    , mapping(nullptr)
+    , mappingLength(0) {}
+
+MappedFile::~MappedFile() { close(); }
+
+void MappedFile::close() {
+    if (data != nullptr) {
+#if !defined(WINDOWS)
+        if (mapped) {
+            ::munmap((void*)mapping, mappingLength);
+        } else
+#endif
+        {
+            delete[] data;
+        }
+    }
+    data          = nullptr;
+    length        = 0;
+    mapped        = false;
+    mapping       = nullptr;
+    mappingLength = 0;
+}
+
+void MappedFile::open(const char* path, uint64_t offset, uint64_t range) {
+    close();
+#if !defined(WINDOWS)
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Unable to open file: \"") + path + "\"");
+    }
+    struct stat s;
+    if ((::fstat(fd, &s) != 0) || (S_ISREG(s.st_mode) == false)) {
+        ::close(fd);
+        throw std::runtime_error(std::string("Unable to open file: \"") + path + "\"");
+    }
+    if ((range == UINT64_MAX) && (offset <= (uint64_t)s.st_size)) {
+        range = s.st_size - offset;
+    }
+    if ((offset > (uint64_t)s.st_size) || (range > (uint64_t)s.st_size - offset)) {
+        ::close(fd);
+        throw std::runtime_error(std::string("Truncated file: ") + path);
+    }
+    length = range;
+    if (length != 0) {
+        /* mappings start at a page boundary */
+        uint64_t start = offset - offset % ::sysconf(_SC_PAGESIZE);
+        void*    p     = ::mmap(nullptr, length + (offset - start), PROT_READ, MAP_SHARED, fd, start);
+        if (p != MAP_FAILED) {
+            mapping       = (const char*)p;
+            mappingLength = length + (offset - start);
+            data          = mapping + (offset - start);
+            mapped        = true;
+        }
+    }
+    ::close(fd);
+    if (data == nullptr)
+#endif
+    {
+        std::ifstream f(path, std::ios::in | std::ios::binary);
+        if (!f.is_open()) {
+            throw std::runtime_error(std::string("Unable to open file: \"") + path + "\"");
+        }
+        f.seekg(0, std::ios::end);
+        std::streampos file_length = f.tellg();
+        if ((int)file_length == -1) {
+            throw std::runtime_error(std::string("Unable to open file: \"") + path + "\"");
+        }
+        if ((range == UINT64_MAX) && (offset <= (uint64_t)file_length)) {
+            range = (uint64_t)file_length - offset;
+        }
+        if ((offset > (uint64_t)file_length) || (range > (uint64_t)file_length - offset)) {
+            throw std::runtime_error(std::string("Truncated file: ") + path);
+        }
+        f.seekg(offset);
+        char* buf = new char[range];
+        f.read(buf, range);
+        if (f.fail()) {
+            delete[] buf;
+            throw std::runtime_error(std::string("Unable to read file: ") + path);
+        }
+        data   = buf;
+        length = range;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+  mappedfile.hpp - read-only view of a file, mapped where possible
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <cstdint>
+
+/* A read-only view of a range of a file. The range is mapped where possible and read into memory
+   otherwise, e.g. on Windows. Throws std::runtime_error if the file cannot be opened or is
+   shorter than the range. */
+class MappedFile {
+    private:
+        const char* data;
+        uint64_t    length;
+        bool        mapped;
+        const char* mapping;        // the mapped pages, data may start after the first
+        uint64_t    mappingLength;
+
+        MappedFile(MappedFile const&);
+        MappedFile& operator=(MappedFile const&);
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /* range bytes at offset of the file at path, UINT64_MAX is up to the end */
+        void open(const char* path, uint64_t offset = 0, uint64_t range = UINT64_MAX);
+        void close();
+
+        const char* buffer() const { return data; }
+        uint64_t    size() const { return length; }
+};
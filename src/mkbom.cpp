@@ -30,515 +30,452 @@
 #include <iterator>
 #include <algorithm>
 #include <iomanip>
+#include <memory>
 #include <cmath>
+#include <thread>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <libgen.h>
 #include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
 #if defined(WINDOWS)
 #include <winsock2.h>
 #else
 #include <arpa/inet.h>
 #include <unistd.h>
 #endif
+#include <getopt.h>
 #include <cstring>
 
 #include "bom.h"
+#include "batch.hpp"
+#include "bomutils.hpp"
+#include "buildcache.hpp"
 #include "printnode.hpp"
+#include "pathfilter.hpp"
+#include "payload.hpp"
+#include "stats.hpp"
+#include "streampipe.hpp"
+#include "trace.hpp"
+#include "watch.hpp"
 
-typedef enum {
-    kNullNode,
-    kFileNode,
-    kDirectoryNode,
-    kSymbolicLinkNode,
-    kRootNode } node_enum_t;
+/* changes whenever the output for the same inputs changes */
+#define CACHE_VERSION        "mkbom 1"
+#define CACHE_BOM_SUFFIX     ".bom"
+#define CACHE_PAYLOAD_SUFFIX ".payload"
 
-struct Node;
-
-using stringnode_map_t = std::map<std::string, Node>;
-using stringvec_t = std::vector<std::string>;
-
-using map_iterator_t = std::map<std::string, Node>::iterator;
-using map_citerator_t = std::map<std::string, Node>::const_iterator;
-using vec_citerator_t = std::vector<std::string>::const_iterator;
-
-using node_stackpair_t = std::pair<uint32_t, const Node*>;
-using node_stack_t = std::vector<node_stackpair_t>;
-
-
-struct Node {
-    stringnode_map_t  children;
-    node_enum_t       type;
-    uint32_t          mode;
-    uint32_t          uid;
-    uint32_t          gid;
-    uint32_t          size;
-    uint32_t          checksum;
-    uint32_t          linkNameLength;
-    std::string       linkName;
-    
-    Node()
-        : type(kNullNode)
-        , mode(0)
-        , uid(0)
-        , gid(0)
-        , size(0)
-        , checksum(0)
-        , linkNameLength(0) {}
-};
-
-class BOMStorage {
-    
-    private:
-        uint32_t   size_of_header;
-        BOMHeader* header;
-        
-        uint32_t size_of_vars;
-        uint32_t num_vars;
-        BOMVars* vars;
-        
-        uint32_t       size_of_block_table;
-        uint32_t       num_block_entries;
-        BOMBlockTable* block_table;
-        
-        uint32_t     size_of_free_list;
-        uint32_t     num_free_list_entries;
-        BOMFreeList* free_list;
-        
-        uint32_t entry_size;
-        char*    entries;
-    
-    public:
-        BOMStorage() {
-            size_of_header = 512;
-            header         = (BOMHeader*)std::malloc(size_of_header);
-            
-            num_block_entries   = 1;
-            size_of_block_table = sizeof(uint32_t) + (num_block_entries * sizeof(BOMPointer));
-            block_table         = (BOMBlockTable*)std::malloc(size_of_block_table);
-            
-            size_of_free_list     = sizeof(uint32_t) + (2 * sizeof(BOMPointer));
-            free_list             = (BOMFreeList*)std::malloc(size_of_free_list);
-            num_free_list_entries = 0;
-            
-            num_vars     = 0;
-            size_of_vars = sizeof(uint32_t);
-            vars         = (BOMVars*)std::malloc(size_of_vars);
-            
-            entry_size = 0;
-            entries    = nullptr;
-            
-            std::memset(header, 0, size_of_header);
-            std::memcpy(header->magic, "BOMStore", 8);
-            header->version        = htonl(1);
-            header->numberOfBlocks = htonl(0);
-            header->indexOffset    = htonl(size_of_header + size_of_vars + entry_size);
-            header->indexLength    = htonl(size_of_block_table + size_of_free_list);
-            header->varsOffset     = htonl(size_of_header);
-            header->varsLength     = htonl(size_of_vars);
-            
-            block_table->numberOfBlockTablePointers = htonl(num_block_entries);
-            block_table->blockPointers[0].address   = htonl(0);
-            block_table->blockPointers[0].length    = htonl(0);
-            
-            vars->count = htonl(0);
-            
-            free_list->numberOfFreeListPointers = htonl(num_free_list_entries);
-            for (unsigned int i = 0; i < 2; ++i) {
-                free_list->freelistPointers[i].address = htonl(0);
-                free_list->freelistPointers[i].length  = htonl(0);
-            }
-        }
-        
-        void* getBlock(uint32_t id) { return &entries[block_table->blockPointers[id].address]; }
-        
-        int addBlock(const void* data, uint32_t length) {
-            if (entries == nullptr) {
-                entries = (char*)std::malloc(length);
-            } else {
-                entries = (char*)std::realloc(entries, length + entry_size);
-            }
-            std::memcpy(&entries[entry_size], data, length);
-            size_of_block_table = sizeof(uint32_t) + ((num_block_entries + 1) * sizeof(BOMPointer));
-            block_table         = (BOMBlockTable*)std::realloc(block_table, size_of_block_table);
-            block_table->blockPointers[num_block_entries].address = entry_size; // This will be converted to the right value later on.
-            block_table->blockPointers[num_block_entries].length = htonl(length);
-            num_block_entries++;
-            entry_size += length;
-            block_table->numberOfBlockTablePointers = htonl(num_block_entries);
-            
-            /* update header */
-            header->numberOfBlocks = htonl(ntohl(header->numberOfBlocks) + 1);
-            header->indexLength    = htonl(size_of_block_table + size_of_free_list);
-            return num_block_entries - 1;
-        }
-        
-        void addVar(const char* name, const void* data, uint32_t length) {
-            unsigned int new_size = sizeof(uint32_t) + 1 + std::strlen(name);
-            
-            vars        = (BOMVars*)std::realloc(vars, size_of_vars + new_size);
-            BOMVar* var = (BOMVar*)&(((char*)vars)[size_of_vars]);
-            size_of_vars += new_size;
-            var->index  = htonl(addBlock(data, length));
-            var->length = std::strlen(name);
-            std::memcpy(var->name, name, std::strlen(name));
-            vars->count = htonl(ntohl(vars->count) + 1);
-            
-            /* update header */
-            header->indexOffset = htonl(size_of_header + size_of_vars + entry_size);
-            header->varsLength  = htonl(size_of_vars);
-        }
-        
-        void write(std::ofstream& bom_file) {
-            bom_file.write((char*)header, size_of_header);
-            bom_file.write((char*)vars, size_of_vars);
-            if (entries != nullptr) {
-                bom_file.write((char*)entries, entry_size);
-            }
-            BOMBlockTable* temp = (BOMBlockTable*)std::malloc(size_of_block_table);
-            std::memcpy(temp, block_table, size_of_block_table);
-            for (unsigned int i = 0; i < ntohl(temp->numberOfBlockTablePointers); ++i) {
-                if (temp->blockPointers[i].length != 0) {
-                    temp->blockPointers[i].address = htonl(temp->blockPointers[i].address + size_of_header + size_of_vars);
-                }
-            }
-            bom_file.write((char*)temp, size_of_block_table);
-            std::free((void*)temp);
-            bom_file.write((char*)free_list, size_of_free_list);
-        }
-        
-        ~BOMStorage() {
-            if (entries != nullptr) {
-                std::free((void*)entries);
-            }
-            std::free((void*)vars);
-            std::free((void*)free_list);
-            std::free((void*)block_table);
-            std::free((void*)header);
-        }
-};
-
-uint32_t dec_octal_to_int(uint32_t dec_rep_octal) {
-    uint32_t retval = 0;
-    for (unsigned int n = 1; dec_rep_octal; n *= 8) {
-        unsigned int digit = dec_rep_octal - ((dec_rep_octal / 10) * 10);
-        if (digit > 7) {
-            throw std::runtime_error("argument not in dec oct rep");
-        }
-        retval += digit * n;
-        dec_rep_octal /= 10;
+/* an archive stands for its contents by its size, times and inode number */
+static void add_file_metadata(Fingerprint& fingerprint, const char* path) {
+    struct stat s;
+    if (::stat(path, &s) != 0) {
+        throw std::runtime_error(std::string("Unable to find path: ") + path);
     }
-    return retval;
+    fingerprint.add((uint64_t)s.st_size);
+    fingerprint.add((uint64_t)s.st_mtime);
+    fingerprint.add((uint64_t)s.st_ctime);
+    fingerprint.add((uint64_t)s.st_ino);
+    fingerprint.add((uint64_t)s.st_dev);
+#if defined(__linux__)
+    fingerprint.add(((uint64_t)s.st_mtim.tv_nsec << 32) | s.st_ctim.tv_nsec);
+#endif
 }
 
-void write_bom(std::istream& lsbom_file, std::string const& output_path) {
-    Node         root;
-    unsigned int num;
-    root.type = kRootNode;
-    {
-        stringnode_map_t all_nodes;
-        std::string            line;
-        while (std::getline(lsbom_file, line)) {
-            Node                     n;
-            std::string              name;
-            stringvec_t elements;
-            {
-                std::stringstream ss(line);
-                std::getline(ss, name, '\t');
-                if (ss.good() == false) {
-                    std::cerr << std::endl << "Syntax error in lsbom input" << std::endl;
-                    std::exit(1);
-                }
-                {
-                    std::string rest;
-                    std::getline(ss, rest);
-                    std::size_t it = rest.find("/");
-                    if (it != std::string::npos) {
-                        rest[it] = ' ';
-                    }
-                    std::stringstream item_stream(rest);
-                    std::copy(std::istream_iterator<std::string>(item_stream),
-                              std::istream_iterator<std::string>(),
-                              std::back_inserter(elements));
-                }
-            }
-            n.mode           = dec_octal_to_int(std::atol(elements[0].c_str()));
-            n.uid            = std::atol(elements[1].c_str());
-            n.gid            = std::atol(elements[2].c_str());
-            n.size           = 0;
-            n.checksum       = 0;
-            n.linkNameLength = 0;
-            if ((n.mode & 0xF000) == 0x4000) {
-                n.type = kDirectoryNode;
-            } else if ((n.mode & 0xF000) == 0x8000) {
-                n.type     = kFileNode;
-                n.size     = std::atol(elements[3].c_str());
-                n.checksum = std::atol(elements[4].c_str());
-            } else if ((n.mode & 0xF000) == 0xA000) {
-                n.type           = kSymbolicLinkNode;
-                n.size           = std::atol(elements[3].c_str());
-                n.checksum       = std::atol(elements[4].c_str());
-                n.linkNameLength = elements[5].size() + 1;
-                n.linkName       = elements[5];
-            } else {
-                std::cerr << std::endl << "Node type not supported" << std::endl;
-                std::exit(1);
-            }
-            all_nodes[name] = n;
-        }
-        /* create tree */
-        for (map_citerator_t it = all_nodes.begin(); it != all_nodes.end(); ++it) {
-            stringvec_t path_elements;
-            {
-                std::stringstream ss(it->first);
-                for (std::string element; std::getline(ss, element, '/'); path_elements.push_back(element)) {}
-            }
-            Node*       parent = &root;
-            std::string full_path;
-            for (vec_citerator_t jt = path_elements.begin(); jt != path_elements.end(); ++jt) {
-                full_path += *jt;
-                /* search for this path element */
-                map_iterator_t kt;
-                if ((kt = parent->children.find(*jt)) == parent->children.end()) {
-                    /* this node was not found in the parent, we must create it */
-                    // std::map<std::string, Node>::const_iterator lt;
-                    map_citerator_t lt;
-                    if ((lt = all_nodes.find(full_path)) == all_nodes.end()) {
-                        std::cerr << std::endl
-                                  << "Parent directory of file/folder \"" << full_path
-                                  << "\" does not appear in list" << std::endl;
-                        std::exit(1);
-                    }
-                    parent->children[*jt] = lt->second;
-                    kt                    = parent->children.find(*jt);
-                }
-                parent = &kt->second;
-                full_path += "/";
-            }
-        }
-        num = all_nodes.size();
+#if !defined(WINDOWS)
+/* whether path, which does not have to exist yet, lies inside directory, after resolving both */
+static bool inside_directory(std::string const& path, std::string const& directory) {
+    std::vector<char> parent(path.begin(), path.end());
+    parent.push_back('\0');
+    char* resolved_directory = ::realpath(directory.c_str(), nullptr);
+    char* resolved_parent    = ::realpath(::dirname(parent.data()), nullptr);
+    bool  result             = false;
+    if (resolved_directory && resolved_parent) {
+        std::string d(resolved_directory);
+        std::string p(resolved_parent);
+        std::string prefix = (d == "/") ? d : d + "/";
+        result             = (p == d) || (p.compare(0, prefix.size(), prefix) == 0);
     }
-    
-    BOMStorage bom;
-    {
-        unsigned int bom_info_size = (sizeof(uint32_t) * 3) + (((num != 0) ? 1 : 0) * sizeof(BOMInfoEntry));
-        BOMInfo* info = (BOMInfo*)std::malloc(bom_info_size);
-        std::memset(info, 0, bom_info_size);
-        info->version             = htonl(1);
-        info->numberOfPaths       = htonl(num + 1);
-        info->numberOfInfoEntries = htonl((num != 0) ? 1 : 0);
-        if (num != 0) {
-            // info->entries[0].unknown2 = htonl( 57826303 ); /* ???? */
-            info->entries[0].unknown2 = htonl(0); /* ???? */
-        }
-        bom.addVar("BomInfo", info, bom_info_size);
-        std::free(info);
-    }
-    
-    {
-        BOMTree tree;
-        std::memcpy(tree.tree, "tree", 4);
-        tree.version   = htonl(1);
-        tree.blockSize = htonl(4096);
-        tree.pathCount = htonl(num);
-        tree.unknown3  = 0; /* ?? */
-        
-        unsigned int num_paths = std::ceil(static_cast<double>(num) / 256.);
-        /* split the paths into several paths */
-        unsigned int path_size = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (num_paths * sizeof(BOMPathIndices));
-        BOMPaths* root_paths = (BOMPaths*)std::malloc(path_size);
-        root_paths->isLeaf   = htons(0);
-        root_paths->count    = htons(num_paths);
-        root_paths->forward  = 0;
-        root_paths->backward = 0;
-        
-        node_stack_t stack;
-        
-        stack.push_back(node_stackpair_t(0, &root));
-        unsigned int j                 = 0;
-        unsigned int k                 = 0;
-        unsigned int current_path      = 0;
-        unsigned int current_path_size = 0;
-        unsigned int last_file_info    = 0;
-        unsigned int last_paths_id     = 0;
-        BOMPaths*    paths             = nullptr;
-        while (stack.size() != 0) {
-            const Node& arg    = *stack[0].second;
-            uint32_t    parent = stack[0].first;
-            stack.erase(stack.begin());
-            for (map_citerator_t it = arg.children.begin(); it != arg.children.end(); ++it) {
-                Node const& node = it->second;
-                std::string s    = it->first;
-                
-                if (k == 0) {
-                    unsigned int new_paths_id = 0;
-                    if (paths != nullptr) {
-                        new_paths_id = bom.addBlock(paths, current_path_size);
-                        root_paths->indices[current_path].index0 = htonl(new_paths_id);
-                        if (last_paths_id != 0) {
-                            BOMPaths* prev_paths = (BOMPaths*)bom.getBlock(last_paths_id);
-                            prev_paths->forward  = htonl(new_paths_id);
-                        }
-                        root_paths->indices[current_path].index1 = last_file_info;
-                        paths                                    = nullptr;
-                        current_path++;
-                    }
-                    unsigned int next_num = 256 < (num - j) ? 256 : (num - j);
-                    current_path_size     = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (next_num * sizeof(BOMPathIndices));
-                    paths           = (BOMPaths*)std::malloc(current_path_size);
-                    paths->isLeaf   = htons(1);
-                    paths->count    = htons(next_num);
-                    paths->forward  = 0;
-                    paths->backward = htonl(new_paths_id);
-                    last_paths_id   = new_paths_id;
-                }
-                
-                unsigned int  bom_path_info2_size = sizeof(BOMPathInfo2) + node.linkNameLength;
-                BOMPathInfo2* info2               = (BOMPathInfo2*)std::malloc(bom_path_info2_size);
-                if (node.type == kDirectoryNode) {
-                    info2->type = TYPE_DIR;
-                } else if (node.type == kFileNode) {
-                    info2->type = TYPE_FILE;
-                } else {
-                    info2->type = TYPE_LINK;
-                }
-                info2->unknown0       = 1;
-                info2->architecture   = htons(3); /* ?? */
-                info2->mode           = htons(node.mode);
-                info2->user           = htonl(node.uid);
-                info2->group          = htonl(node.gid);
-                info2->modtime        = 0;
-                info2->size           = htonl(node.size);
-                info2->unknown1       = 1;
-                info2->checksum       = htonl(node.checksum);
-                info2->linkNameLength = htonl(node.linkNameLength);
-                std::strcpy(info2->linkName, node.linkName.c_str());
-                
-                BOMPathInfo1 info1;
-                info1.id                 = htonl(j + 1);
-                info1.index              = htonl(bom.addBlock(info2, bom_path_info2_size));
-                paths->indices[k].index0 = htonl(bom.addBlock(&info1, sizeof(BOMPathInfo1)));
-                
-                std::free((void*)info2);
-                
-                unsigned int bom_file_size = sizeof(uint32_t) + 1 + s.size();
-                BOMFile*     f             = (BOMFile*)std::malloc(bom_file_size);
-                f->parent                  = htonl(parent);
-                std::strcpy(f->name, s.c_str());
-                paths->indices[k].index1 = last_file_info = htonl(bom.addBlock(f, bom_file_size));
-                std::free((void*)f);
-                
-                stack.push_back(node_stackpair_t(j + 1, &node));
-                j++;
-                k = (k + 1) % 256;
-            }
-        }
-        if (num_paths > 1) {
-            root_paths->indices[current_path].index0 = ((BOMPaths*)bom.getBlock(last_paths_id))->forward = htonl(bom.addBlock(paths, current_path_size));
-            root_paths->indices[current_path].index1 = last_file_info;
-            tree.child                               = htonl(bom.addBlock(root_paths, path_size));
-        } else {
-            tree.child = htonl(bom.addBlock(paths, current_path_size));
-        }
-        std::free((void*)paths);
-        std::free((void*)root_paths);
-        bom.addVar("Paths", &tree, sizeof(BOMTree));
-    }
-    
-    {
-        unsigned int path_size  = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2);
-        BOMPaths*    empty_path = (BOMPaths*)std::malloc(path_size);
-        empty_path->isLeaf      = htons(1);
-        empty_path->count       = htons(0);
-        empty_path->forward     = htonl(0);
-        empty_path->backward    = htonl(0);
-        
-        BOMTree tree;
-        std::memcpy(tree.tree, "tree", 4);
-        tree.version   = htonl(1);
-        tree.blockSize = htonl(4096);
-        tree.pathCount = htonl(0);
-        tree.unknown3  = 0;
-        
-        tree.child = htonl(bom.addBlock(empty_path, path_size));
-        bom.addVar("HLIndex", &tree, sizeof(BOMTree));
-        
-        BOMVIndex vindex;
-        vindex.unknown0     = htonl(1);
-        tree.child          = htonl(bom.addBlock(empty_path, path_size));
-        tree.blockSize      = htonl(128);
-        vindex.indexToVTree = htonl(bom.addBlock(&tree, sizeof(BOMTree)));
-        vindex.unknown2     = htonl(0);
-        vindex.unknown3     = 0;
-        bom.addVar("VIndex", &vindex, sizeof(BOMVIndex));
-        
-        tree.blockSize = htonl(4096);
-        tree.child     = htonl(bom.addBlock(empty_path, path_size));
-        bom.addVar("Size64", &tree, sizeof(BOMTree));
-        
-        std::free((void*)empty_path);
+    std::free(resolved_directory);
+    std::free(resolved_parent);
+    return result;
+}
+#endif
+
+/* writes what --stats and --trace collected, returns false if that fails */
+static bool report_run(std::string const& stats_path, std::string const& trace_path) {
+    if (stats_enabled && (stats_output(stats_path, "mkbom") == false)) {
+        return false;
     }
-    
-    std::ofstream o_file(output_path.c_str(), std::ios::binary | std::ios::out);
-    if (o_file.fail()) {
-        std::cerr << std::endl << "Unable to open output file: " << output_path << std::endl;
-        std::exit(1);
+    if (trace_enabled && (trace_write(trace_path) == false)) {
+        std::cerr << std::endl << "Unable to write trace to " << trace_path << std::endl;
+        return false;
     }
-    bom.write(o_file);
+    return true;
 }
 
 void usage() {
-    std::cout << "Usage: mkbom [i] [-u uid] [-g gid] source target-bom-file" << std::endl << std::endl;
-    std::cout << "\t-i\tTreat source as a file in the format generated by ls4mkbom and lsbom" << std::endl;
+    std::cout << "Usage: mkbom [-i | -a] [-u uid] [-g gid] [-f fanout] [-b blocksize] [-c] [-x file] [--exclude=pattern] [-M megabytes [-t dir]] [-p payload-file [-z level]] [--cache=dir] [--watch[=ms]] [--stats[=file]] [--trace=file] source target-bom-file" << std::endl;
+    std::cout << "       mkbom --batch=job-file [-j threads] [-u uid] [-g gid] [-f fanout] [-b blocksize] [-c] [-x file] [--exclude=pattern] [--stats[=file]] [--trace=file]" << std::endl << std::endl;
+    std::cout << "\t-i\tTreat source as a file in the text or binary format generated by ls4mkbom and lsbom, - for stdin" << std::endl;
+    std::cout << "\t-a\tTreat source as a tar or cpio archive, optionally gzip compressed, - for stdin" << std::endl;
     std::cout << "\t-u\tForce user ID to the specified value (incompatible with -i)" << std::endl;
     std::cout << "\t-g\tForce group ID to the specified value (incompatible with -i)" << std::endl;
+    std::cout << "\t-f\tNumber of paths stored in each leaf of the paths tree (default: 256)" << std::endl;
+    std::cout << "\t-b\tBlock size of the paths tree (default: 4096)" << std::endl;
+    std::cout << "\t-c\tStore the blocks of each leaf contiguously in the order they are read" << std::endl;
+    std::cout << "\t-x\tRead gitignore style exclusion patterns from file (incompatible with -i), may be repeated" << std::endl;
+    std::cout << "\t--exclude\tExclude paths matching a gitignore style pattern (incompatible with -i), may be repeated" << std::endl;
+    std::cout << "\t-M\tKeep at most about this many megabytes of the file list in memory and sort the rest on disk" << std::endl;
+    std::cout << "\t-t\tDirectory for the temporary files of -M (default: $TMPDIR or /tmp)" << std::endl;
+    std::cout << "\t-p\tAlso write the files as a cpio archive, the Payload of an installer package (incompatible with -i)" << std::endl;
+    std::cout << "\t-z\tCompression level of the payload, 0 for an uncompressed archive (default: 6, gzip)" << std::endl;
+    std::cout << "\t--cache\tReuse the output of an earlier run with the same inputs and options from dir, and add new outputs to it" << std::endl;
+    std::cout << "\t--watch\tKeep running and rewrite the bom whenever source changes, ms after the last change (default: 50)" << std::endl;
+    std::cout << "\t--batch\tBuild the boms listed in job-file, one source, target-bom-file, uid and gid per line separated by tabs, - for stdin" << std::endl;
+    std::cout << "\t-j\tNumber of boms --batch builds at the same time (default: the number of processors)" << std::endl;
+    std::cout << "\t--stats\tReport the time spent in each phase and some counters on stderr, or as JSON to file" << std::endl;
+    std::cout << "\t--trace\tWrite a Chrome trace of every directory read, stat and checksum to file" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     uint32_t uid              = UINT_MAX;
     uint32_t gid              = UINT_MAX;
     bool     isFileListSource = false;
+    bool     isArchiveSource  = false;
+    
+    BOMLayout           layout;
+    ExternalSortOptions external;
+    bool                useExternal = false;
+    PathFilter          filter;
+    std::string stats_path;
+    std::string trace_path;
+    std::string payload_path;
+    int         payload_level = PAYLOAD_DEFAULT_LEVEL;
+    std::string cache_dir;
+    bool        watch       = false;
+    long        debounce_ms = WATCH_DEFAULT_DEBOUNCE_MS;
+    std::string batch_path;
+    long        num_threads = std::thread::hardware_concurrency();
+    
+    static const struct option long_options[] = {
+        { "stats", optional_argument, nullptr, 'S' },
+        { "trace", required_argument, nullptr, 'T' },
+        { "exclude-from", required_argument, nullptr, 'x' },
+        { "exclude", required_argument, nullptr, 'E' },
+        { "cache", required_argument, nullptr, 'C' },
+        { "watch", optional_argument, nullptr, 'W' },
+        { "batch", required_argument, nullptr, 'B' },
+        { nullptr, 0, nullptr, 0 }
+    };
     
     while (true) {
-        char c = ::getopt(argc, argv, "hiu:g:");
+        char c = ::getopt_long(argc, argv, "hiau:g:f:b:cM:t:x:p:z:j:", long_options, nullptr);
         if (c == -1) {
             break;
         }
         
         switch (c) {
             case 'i': isFileListSource = true; break;
+            case 'a': isArchiveSource = true; break;
             case 'u': uid = std::atol(optarg); break;
             case 'g': gid = std::atol(optarg); break;
+            case 'f': layout.pathsPerLeaf = std::atol(optarg); break;
+            case 'b': layout.blockSize = std::atol(optarg); break;
+            case 'c': layout.clustered = true; break;
+            case 'M':
+                useExternal           = true;
+                external.memoryBudget = std::strtoull(optarg, nullptr, 10) * 1024 * 1024;
+                break;
+            case 't': external.tempDir = optarg; break;
+            case 'x':
+                try {
+                    filter.load(optarg);
+                } catch (std::exception const& e) {
+                    std::cerr << std::endl << "Unable to read exclusion patterns: " << e.what() << std::endl;
+                    return 1;
+                }
+                break;
+            case 'E': filter.add(optarg); break;
+            case 'p': payload_path = optarg; break;
+            case 'z':
+                /* the default, PAYLOAD_DEFAULT_LEVEL, cannot be given explicitly */
+                payload_level = std::atoi(optarg);
+                if ((payload_level < 0) || (payload_level > 9)) {
+                    std::cerr << std::endl << "The compression level of -z must be between 0 and 9" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'C': cache_dir = optarg; break;
+            case 'B': batch_path = optarg; break;
+            case 'j': num_threads = std::atol(optarg); break;
+            case 'W':
+                watch = true;
+                if (optarg) {
+                    char* end;
+                    errno       = 0;
+                    debounce_ms = std::strtol(optarg, &end, 10);
+                    if ((end == optarg) || (*end != '\0') || (errno != 0) || (debounce_ms < 0) ||
+                        (debounce_ms > INT_MAX)) {
+                        std::cerr << std::endl << "The delay of --watch must be a number of milliseconds" << std::endl;
+                        return 1;
+                    }
+                }
+                break;
+            case 'S':
+                stats_enabled = true;
+                stats_path    = optarg ? optarg : "";
+                break;
+            case 'T':
+                trace_enabled = true;
+                trace_path    = optarg;
+                break;
             case 'h': usage(); return 0;
             case ':':
             case '?': usage(); return 1;
         }
     }
+    trace_thread_name("main");
     
-    if ((argc - optind) != 2) {
+    if ((argc - optind) != (batch_path.empty() ? 2 : 0)) {
         usage();
         return 1;
     }
     
-    if (isFileListSource) {
-        std::ifstream file_list(argv[optind]);
-        if (file_list.fail()) {
-            std::cerr << std::endl << "Unable to open file list: " << argv[optind] << std::endl;
+    try {
+        validate_layout(layout);
+    } catch (std::exception const& e) {
+        std::cerr << std::endl << "Invalid tree layout: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    if (useExternal && (external.memoryBudget == 0)) {
+        std::cerr << std::endl << "The memory budget of -M must be at least one megabyte" << std::endl;
+        return 1;
+    }
+    if (isFileListSource && ((uid != UINT_MAX) || (gid != UINT_MAX))) {
+        std::cerr << std::endl << "The -u and -g options cannot be used with -i" << std::endl;
+        return 1;
+    }
+    if (isFileListSource && (filter.empty() == false)) {
+        std::cerr << std::endl << "Exclusion patterns cannot be used with -i" << std::endl;
+        return 1;
+    }
+    if (isFileListSource && (payload_path.empty() == false)) {
+        std::cerr << std::endl << "The -p option cannot be used with -i" << std::endl;
+        return 1;
+    }
+    if (isFileListSource && isArchiveSource) {
+        std::cerr << std::endl << "The -i and -a options cannot be used together" << std::endl;
+        return 1;
+    }
+    if (isArchiveSource && (payload_path.empty() == false)) {
+        std::cerr << std::endl << "The -p option cannot be used with -a" << std::endl;
+        return 1;
+    }
+    if (isArchiveSource && (cache_dir.empty() == false) && (std::string(argv[optind]) == "-")) {
+        std::cerr << std::endl << "The --cache option needs an archive file, not standard input" << std::endl;
+        return 1;
+    }
+    if (watch && (isFileListSource || isArchiveSource)) {
+        std::cerr << std::endl << "The --watch option needs a directory as source" << std::endl;
+        return 1;
+    }
+    if (watch && (useExternal || (payload_path.empty() == false) || (cache_dir.empty() == false))) {
+        std::cerr << std::endl << "The --watch option cannot be used with -M, -p or --cache" << std::endl;
+        return 1;
+    }
+#if !defined(WINDOWS)
+    if (watch && inside_directory(argv[optind + 1], argv[optind])) {
+        std::cerr << std::endl << "The --watch option needs a target outside of the watched directory" << std::endl;
+        return 1;
+    }
+#endif
+    if ((batch_path.empty() == false) && (isFileListSource || isArchiveSource || useExternal || watch ||
+                                          (payload_path.empty() == false) || (cache_dir.empty() == false))) {
+        std::cerr << std::endl << "The --batch option cannot be used with -i, -a, -M, -p, --cache or --watch" << std::endl;
+        return 1;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (useExternal && layout.clustered) {
+        std::cerr << std::endl << "The -c and -M options cannot be used together" << std::endl;
+        return 1;
+    }
+    
+    if (batch_path.empty() == false) {
+        unsigned int num_failed;
+        try {
+            std::vector<BatchJob> jobs;
+            if (batch_path == "-") {
+                read_jobs(std::cin, uid, gid, jobs);
+            } else {
+                std::ifstream job_file(batch_path.c_str());
+                if (job_file.fail()) {
+                    std::cerr << std::endl << "Unable to open job file: " << batch_path << std::endl;
+                    return 1;
+                }
+                read_jobs(job_file, uid, gid, jobs);
+            }
+            num_failed = run_batch(jobs, layout, filter.empty() ? nullptr : &filter, num_threads, std::cout);
+        } catch (std::exception const& e) {
+            std::cerr << std::endl << e.what() << std::endl;
             return 1;
         }
-        if ((uid != UINT_MAX) || (gid != UINT_MAX)) {
-            std::cerr << std::endl << "The -u and -g options cannot be used with -i" << std::endl;
+        if (report_run(stats_path, trace_path) == false) {
             return 1;
         }
-        write_bom(file_list, std::string(argv[optind + 1]));
-    } else {
-        std::string buffer;
-        {
-            std::stringstream ss;
-            print_node(ss, std::string(argv[optind]), uid, gid);
-            buffer = ss.str();
+        return (num_failed == 0) ? 0 : 1;
+    }
+
+    try {
+        std::string const output_path(argv[optind + 1]);
+        bool const        from_stdin = (std::string(argv[optind]) == "-");
+
+        /* with -i and --cache the file list is read ahead to compute its fingerprint */
+        std::unique_ptr<BuildCache> cache;
+        std::string                 cache_key;
+        std::string                 file_list_bytes;
+        bool                        cached = false;
+        if (cache_dir.empty() == false) {
+            if (from_stdin && isFileListSource) {
+                std::ios::sync_with_stdio(false);
+                file_list_bytes.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+            } else if (isFileListSource) {
+                std::ifstream file_list(argv[optind], std::ios::in | std::ios::binary);
+                if (file_list.fail()) {
+                    std::cerr << std::endl << "Unable to open file list: " << argv[optind] << std::endl;
+                    return 1;
+                }
+                file_list_bytes.assign(std::istreambuf_iterator<char>(file_list), std::istreambuf_iterator<char>());
+            }
+            Fingerprint fingerprint;
+            fingerprint.add(std::string(CACHE_VERSION));
+            fingerprint.add(((uint64_t)layout.blockSize << 32) | layout.pathsPerLeaf);
+            fingerprint.add((uint64_t)layout.clustered);
+            fingerprint.add(((uint64_t)uid << 32) | gid);
+            fingerprint.add(filter.signature());
+            fingerprint.add(payload_path.empty() ? std::string("") : std::string("payload ") + std::to_string(payload_level));
+            if (isFileListSource) {
+                fingerprint.add(std::string("file list"));
+                fingerprint.add(file_list_bytes);
+            } else if (isArchiveSource) {
+                fingerprint.add(std::string("archive"));
+                add_file_metadata(fingerprint, argv[optind]);
+            } else {
+                fingerprint.add(std::string("directory"));
+                fingerprint_node(fingerprint, argv[optind], uid, gid, filter.empty() ? nullptr : &filter);
+            }
+            cache.reset(new BuildCache(cache_dir));
+            cache_key = fingerprint.hex();
+            cached    = cache->fetch(cache_key + CACHE_BOM_SUFFIX, output_path) &&
+                        (payload_path.empty() || cache->fetch(cache_key + CACHE_PAYLOAD_SUFFIX, payload_path));
+        }
+        if (cached == false) {
+            unlink_shared_output(output_path);
+            if (payload_path.empty() == false) {
+                unlink_shared_output(payload_path);
+            }
         }
-        std::stringstream file_list(buffer);
-        write_bom(file_list, std::string(argv[optind + 1]));
+
+        if (cached) {
+            /* the outputs are linked from the cache */
+        } else if (watch) {
+            watch_directory(argv[optind], output_path, uid, gid, filter.empty() ? nullptr : &filter, layout,
+                            debounce_ms);
+        } else if (isFileListSource) {
+            std::ifstream      file_list;
+            std::istringstream read_ahead(file_list_bytes);
+            if ((from_stdin == false) && (cache == nullptr)) {
+                file_list.open(argv[optind], std::ios::in | std::ios::binary);
+                if (file_list.fail()) {
+                    std::cerr << std::endl << "Unable to open file list: " << argv[optind] << std::endl;
+                    return 1;
+                }
+            }
+            if (from_stdin) {
+                /* only cerr is used besides cin, and unsynchronized reads are much faster */
+                std::ios::sync_with_stdio(false);
+            }
+            std::istream& input = cache ? read_ahead : (from_stdin ? std::cin : file_list);
+            if (useExternal) {
+                write_bom_external(input, output_path, layout, external);
+            } else if (file_list.is_open()) {
+                /* a binary file list is mapped rather than copied */
+                file_list.close();
+                BomWriter writer(layout);
+                writer.addFileList(argv[optind]);
+                writer.write(output_path);
+            } else {
+                BomWriter writer(layout);
+                writer.addFileList(input);
+                writer.write(output_path);
+            }
+        } else if (isArchiveSource) {
+            std::ifstream archive;
+            if (from_stdin == false) {
+                archive.open(argv[optind], std::ios::in | std::ios::binary);
+                if (archive.fail()) {
+                    std::cerr << std::endl << "Unable to open archive: " << argv[optind] << std::endl;
+                    return 1;
+                }
+            } else {
+                std::ios::sync_with_stdio(false);
+            }
+            std::istream&     input = from_stdin ? std::cin : archive;
+            PathFilter const* pf    = filter.empty() ? nullptr : &filter;
+            if (useExternal) {
+                /* the file list is sorted while the archive is read, it is never held as a whole */
+                StreamPipe::run([&](std::ostream& output) { print_archive(output, input, uid, gid, pf); },
+                                [&](std::istream& file_list) {
+                                    write_bom_external(file_list, output_path, layout, external);
+                                });
+            } else {
+                BomWriter writer(layout);
+                writer.addArchive(input, uid, gid, pf);
+                writer.write(output_path);
+            }
+        } else {
+            /* the payload is written by the same walk that checksums the files */
+            std::unique_ptr<PayloadWriter> payload;
+            if (payload_path.empty() == false) {
+                payload.reset(new PayloadWriter(payload_path, payload_level));
+            }
+            if (useExternal) {
+                /* the file list is sorted while the directory is walked, it is never held as a whole */
+                StreamPipe::run(
+                    [&](std::ostream& output) {
+                        print_node(output, std::string(argv[optind]), uid, gid, kTextManifest,
+                                   filter.empty() ? nullptr : &filter, payload.get());
+                    },
+                    [&](std::istream& file_list) { write_bom_external(file_list, output_path, layout, external); });
+                if (payload) {
+                    payload->finish();
+                }
+            } else {
+                BomWriter writer(layout);
+                writer.addDirectory(argv[optind], uid, gid, filter.empty() ? nullptr : &filter, payload.get());
+                if (payload) {
+                    payload->finish();
+                }
+                writer.write(output_path);
+            }
+        }
+        if (cache && (cached == false)) {
+            try {
+                cache->store(cache_key + CACHE_BOM_SUFFIX, output_path);
+                if (payload_path.empty() == false) {
+                    cache->store(cache_key + CACHE_PAYLOAD_SUFFIX, payload_path);
+                }
+            } catch (std::exception const& e) {
+                /* the output is complete anyway */
+                std::cerr << std::endl << e.what() << std::endl;
+            }
+        }
+    } catch (std::exception const& e) {
+        std::cerr << std::endl << e.what() << std::endl;
+        return 1;
     }
-    return 0;
+    return report_run(stats_path, trace_path) ? 0 : 1;
 }
@@ -0,0 +1,207 @@
+/*
+  nodetree.cpp - compact in-memory tree of the entries of a bom file
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include "nodetree.hpp"
+
+const uint32_t NodeTree::kRoot;
+const uint32_t NodeTree::kNoLink;
+
+NodeTree::NodeTree()
+    : string_table(1024, 0)
+    , num_strings(0) {}
+
+static uint32_t hash_string(const char* s, std::size_t length) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for (std::size_t i = 0; i < length; ++i) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+void NodeTree::grow_string_table() {
+    std::vector<uint32_t> table(string_table.size() * 2, 0);
+    uint32_t              mask = table.size() - 1;
+    for (std::vector<uint32_t>::const_iterator it = string_table.begin(); it != string_table.end(); ++it) {
+        if (*it != 0) {
+            const char* s = &arena[*it - 1];
+            uint32_t    h = hash_string(s, std::strlen(s)) & mask;
+            while (table[h] != 0) {
+                h = (h + 1) & mask;
+            }
+            table[h] = *it;
+        }
+    }
+    string_table.swap(table);
+}
+
+uint32_t NodeTree::intern(const char* s, std::size_t length) {
+    uint32_t mask = string_table.size() - 1;
+    uint32_t h    = hash_string(s, length) & mask;
+    for (; string_table[h] != 0; h = (h + 1) & mask) {
+        const char* candidate = &arena[string_table[h] - 1];
+        if ((std::strncmp(candidate, s, length) == 0) && (candidate[length] == '\0')) {
+            return string_table[h] - 1;
+        }
+    }
+    if ((uint64_t)arena.size() + length + 2 > UINT32_MAX) {
+        throw std::runtime_error("Names of the file list exceed 4 GB");
+    }
+    uint32_t offset = arena.size();
+    arena.insert(arena.end(), s, s + length);
+    arena.push_back('\0');
+    string_table[h] = offset + 1;
+    /* keep the table at most half full */
+    if (++num_strings * 2 > string_table.size()) {
+        grow_string_table();
+    }
+    return offset;
+}
+
+uint32_t NodeTree::add(uint32_t parent, const char* name, std::size_t name_length, Node const& n) {
+    if ((parent != kRoot) && (parent >= size())) {
+        throw std::runtime_error("Parent of \"" + std::string(name, name_length) + "\" does not exist");
+    }
+    if (size() == kRoot - 1) {
+        throw std::runtime_error("Too many entries");
+    }
+    parents.push_back(parent);
+    names.push_back(intern(name, name_length));
+    types.push_back(0);
+    modes.push_back(0);
+    uids.push_back(0);
+    gids.push_back(0);
+    sizes.push_back(0);
+    checksums.push_back(0);
+    link_names.push_back(kNoLink);
+    set(size() - 1, n);
+    return size() - 1;
+}
+
+void NodeTree::set(uint32_t i, Node const& n) {
+    types[i]      = n.type;
+    modes[i]      = n.mode;
+    uids[i]       = n.uid;
+    gids[i]       = n.gid;
+    sizes[i]      = n.size;
+    checksums[i]  = n.checksum;
+    link_names[i] = (n.type == kSymbolicLinkNode) ? intern(n.linkName.data(), n.linkName.size()) : kNoLink;
+}
+
+template <typename T>
+void NodeTree::permute(std::vector<T>& column, std::vector<uint32_t> const& order) {
+    std::vector<T> result(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        result[i] = column[order[i]];
+    }
+    column.swap(result);
+}
+
+void NodeTree::finish() {
+    uint32_t const n = size();
+
+    /* group the entries by parent: the children of entry i are children[begin[i + 1]] up to
+       children[begin[i + 2]], the top level entries (i = kRoot) start at begin[0] */
+    std::vector<uint32_t> begin(n + 2, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+        begin[parents[i] + 2]++;
+    }
+    for (uint32_t i = 1; i < n + 2; ++i) {
+        begin[i] += begin[i - 1];
+    }
+    std::vector<uint32_t> children(n);
+    {
+        std::vector<uint32_t> next(begin);
+        for (uint32_t i = 0; i < n; ++i) {
+            children[next[parents[i] + 1]++] = i;
+        }
+    }
+
+    /* sort every directory by name, entries with the same name by the order they were added */
+    std::vector<bool> dropped(n, false);
+    for (uint32_t p = 0; p < n + 1; ++p) {
+        std::vector<uint32_t>::iterator first = children.begin() + begin[p];
+        std::vector<uint32_t>::iterator last  = children.begin() + begin[p + 1];
+        std::sort(first, last, [this](uint32_t a, uint32_t b) {
+            int c = std::strcmp(&arena[names[a]], &arena[names[b]]);
+            return (c < 0) || ((c == 0) && (a < b));
+        });
+        for (std::vector<uint32_t>::iterator it = first; (it != last) && (it + 1 != last); ++it) {
+            if (names[*it] == names[*(it + 1)]) {
+                dropped[*it] = true;
+            }
+        }
+    }
+
+    /* breadth first order; the children of consecutive entries end up next to each other */
+    std::vector<uint32_t> order;
+    order.reserve(n);
+    std::vector<uint32_t> new_begin(1, 0);
+    for (uint32_t k = 0; k == 0 || k <= order.size(); ++k) {
+        uint32_t p = (k == 0) ? 0 : order[k - 1] + 1;
+        for (uint32_t c = begin[p]; c < begin[p + 1]; ++c) {
+            if (dropped[children[c]] == false) {
+                order.push_back(children[c]);
+            } else if (begin[children[c] + 2] != begin[children[c] + 1]) {
+                throw std::runtime_error("Duplicate entry \"" + std::string(&arena[names[children[c]]]) +
+                                         "\" with children");
+            }
+        }
+        new_begin.push_back(order.size());
+    }
+    std::vector<uint32_t>().swap(children);
+    std::vector<uint32_t>().swap(begin);
+
+    /* translate the parents to the new positions before moving the columns */
+    std::vector<uint32_t> position(n, kRoot);
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = i;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        parents[i] = (parents[i] == kRoot) ? kRoot : position[parents[i]];
+    }
+    std::vector<uint32_t>().swap(position);
+
+    permute(parents, order);
+    permute(names, order);
+    permute(types, order);
+    permute(modes, order);
+    permute(uids, order);
+    permute(gids, order);
+    permute(sizes, order);
+    permute(checksums, order);
+    permute(link_names, order);
+    child_begin.swap(new_begin);
+}
+
+uint64_t NodeTree::memoryUsage() const {
+    return arena.capacity() + (string_table.capacity() + parents.capacity() + names.capacity() + modes.capacity() +
+                               uids.capacity() + gids.capacity() + sizes.capacity() + checksums.capacity() +
+                               link_names.capacity() + child_begin.capacity()) * sizeof(uint32_t) +
+           types.capacity();
+}
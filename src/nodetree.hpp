@@ -0,0 +1,127 @@
+/*
+  nodetree.hpp - compact in-memory tree of the entries of a bom file
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+typedef enum {
+    kNullNode,
+    kFileNode,
+    kDirectoryNode,
+    kSymbolicLinkNode,
+    kRootNode } node_enum_t;
+
+/* the attributes of one entry of a file list */
+struct Node {
+    node_enum_t       type;
+    uint32_t          mode;
+    uint32_t          uid;
+    uint32_t          gid;
+    uint32_t          size;
+    uint32_t          checksum;
+    uint32_t          linkNameLength;
+    std::string       linkName;
+    
+    Node()
+        : type(kNullNode)
+        , mode(0)
+        , uid(0)
+        , gid(0)
+        , size(0)
+        , checksum(0)
+        , linkNameLength(0) {}
+};
+
+/* All entries of a file list, stored as one array per attribute. Names and link targets are
+   interned in a single character arena. Entries are added in any order below an already added
+   parent; finish() then arranges them in the order they are written to the bom file: breadth
+   first, the children of each directory sorted by name. Afterwards entry i has the bom id i + 1
+   and the children of every entry form a contiguous range of entries. */
+class NodeTree {
+    public:
+        static const uint32_t kRoot   = UINT32_MAX; // parent of the top level entries
+        static const uint32_t kNoLink = UINT32_MAX;
+
+    private:
+        std::vector<char>     arena;         // NUL terminated strings
+        std::vector<uint32_t> string_table;  // open addressing hash table of arena offset + 1
+        uint32_t              num_strings;
+
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> names;
+        std::vector<uint8_t>  types;
+        std::vector<uint32_t> modes;
+        std::vector<uint32_t> uids;
+        std::vector<uint32_t> gids;
+        std::vector<uint32_t> sizes;
+        std::vector<uint32_t> checksums;
+        std::vector<uint32_t> link_names;
+        std::vector<uint32_t> child_begin;   // after finish(): children of entry i are child_begin[i + 1] .. child_begin[i + 2]
+
+        uint32_t intern(const char* s, std::size_t length);
+        void     grow_string_table();
+
+        template <typename T>
+        static void permute(std::vector<T>& column, std::vector<uint32_t> const& order);
+
+    public:
+        NodeTree();
+
+        /* number of entries, not counting the root */
+        uint32_t size() const { return parents.size(); }
+
+        /* returns the index of the new entry, parent is kRoot or the index of an earlier entry */
+        uint32_t add(uint32_t parent, const char* name, std::size_t name_length, Node const& n);
+        uint32_t add(uint32_t parent, std::string const& name, Node const& n) {
+            return add(parent, name.data(), name.size(), n);
+        }
+
+        /* replaces the attributes of an entry, its children are kept */
+        void set(uint32_t i, Node const& n);
+
+        /* Sorts the entries into bom order. Of several entries with the same name in one directory
+           only the last one added is kept. Throws std::runtime_error if a dropped duplicate
+           had children. */
+        void finish();
+
+        uint32_t    parent(uint32_t i) const { return parents[i]; }
+        const char* name(uint32_t i) const { return &arena[names[i]]; }
+        node_enum_t type(uint32_t i) const { return (node_enum_t)types[i]; }
+        uint32_t    mode(uint32_t i) const { return modes[i]; }
+        uint32_t    uid(uint32_t i) const { return uids[i]; }
+        uint32_t    gid(uint32_t i) const { return gids[i]; }
+        uint32_t    fileSize(uint32_t i) const { return sizes[i]; }
+        uint32_t    checksum(uint32_t i) const { return checksums[i]; }
+        const char* linkName(uint32_t i) const {
+            return (link_names[i] == kNoLink) ? "" : &arena[link_names[i]];
+        }
+
+        /* only valid after finish(), i may be kRoot */
+        uint32_t firstChild(uint32_t i) const { return child_begin[i + 1]; }
+        uint32_t endChild(uint32_t i) const { return child_begin[i + 2]; }
+
+        /* approximate memory held by the tree in bytes */
+        uint64_t memoryUsage() const;
+};
@@ -0,0 +1,251 @@
+/*
+  pathfilter.cpp - gitignore style rules that exclude paths from the directory walk
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+#include "pathfilter.hpp"
+
+static bool is_special(char c) { return (c == '*') || (c == '?') || (c == '['); }
+
+static bool has_special(std::string const& s, std::size_t begin) {
+    for (std::size_t i = begin; i < s.size(); ++i) {
+        if (s[i] == '\\') {
+            ++i;
+        } else if (is_special(s[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string unescape(std::string const& s, std::size_t begin) {
+    std::string result;
+    for (std::size_t i = begin; i < s.size(); ++i) {
+        if ((s[i] == '\\') && (i + 1 < s.size())) {
+            ++i;
+        }
+        result += s[i];
+    }
+    return result;
+}
+
+/* matches a bracket expression starting at p, advances p behind it; returns false in ok if
+   the expression is not terminated, in which case '[' is an ordinary character */
+static bool match_class(const char*& p, const char* pend, char c, bool& ok) {
+    const char* q      = p + 1;
+    bool        negate = false;
+    bool        found  = false;
+    if ((q != pend) && ((*q == '!') || (*q == '^'))) {
+        negate = true;
+        ++q;
+    }
+    for (bool first = true; q != pend && (first || *q != ']'); first = false) {
+        char lo = *q++;
+        if ((lo == '\\') && (q != pend)) {
+            lo = *q++;
+        }
+        char hi = lo;
+        if (((q + 1) < pend) && (*q == '-') && (q[1] != ']')) {
+            hi = q[1];
+            q += 2;
+        }
+        if (((unsigned char)c >= (unsigned char)lo) && ((unsigned char)c <= (unsigned char)hi)) {
+            found = true;
+        }
+    }
+    ok = (q != pend);
+    if (ok) {
+        p = q + 1;
+    }
+    return (found != negate) && (c != '/');
+}
+
+static bool match_glob(const char* p, const char* pend, const char* s, const char* send) {
+    while (p != pend) {
+        if (*p == '*') {
+            if (((p + 1) != pend) && (p[1] == '*')) {
+                const char* q = p + 2;
+                if ((q != pend) && (*q == '/')) {
+                    /* "**" followed by a slash matches zero or more directories */
+                    ++q;
+                    for (const char* t = s;;) {
+                        if (match_glob(q, pend, t, send)) {
+                            return true;
+                        }
+                        t = (const char*)std::memchr(t, '/', send - t);
+                        if (t == nullptr) {
+                            return false;
+                        }
+                        ++t;
+                    }
+                }
+                /* anywhere else "**" matches everything, slashes included */
+                for (const char* t = s; t <= send; ++t) {
+                    if (match_glob(q, pend, t, send)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            ++p;
+            for (const char* t = s;; ++t) {
+                if (match_glob(p, pend, t, send)) {
+                    return true;
+                }
+                if ((t == send) || (*t == '/')) {
+                    return false;
+                }
+            }
+        }
+        if (s == send) {
+            return false;
+        }
+        if (*p == '?') {
+            if (*s == '/') {
+                return false;
+            }
+        } else if (*p == '[') {
+            bool ok;
+            bool matched = match_class(p, pend, *s, ok);
+            if (ok) {
+                if (matched == false) {
+                    return false;
+                }
+                ++s;
+                continue;
+            }
+            if (*s != '[') {
+                return false;
+            }
+        } else {
+            if ((*p == '\\') && ((p + 1) != pend)) {
+                ++p;
+            }
+            if (*p != *s) {
+                return false;
+            }
+        }
+        ++p;
+        ++s;
+    }
+    return s == send;
+}
+
+void PathFilter::add(std::string const& line) {
+    std::string pattern(line);
+    if ((pattern.size() != 0) && (pattern[pattern.size() - 1] == '\r')) {
+        pattern.erase(pattern.size() - 1);
+    }
+    /* trailing spaces are ignored unless they are escaped */
+    while ((pattern.size() != 0) && (pattern[pattern.size() - 1] == ' ') &&
+           ((pattern.size() < 2) || (pattern[pattern.size() - 2] != '\\'))) {
+        pattern.erase(pattern.size() - 1);
+    }
+    if ((pattern.size() == 0) || (pattern[0] == '#')) {
+        return;
+    }
+
+    Rule r;
+    r.negated = (pattern[0] == '!');
+    if (r.negated) {
+        pattern.erase(0, 1);
+    }
+    r.directoryOnly = (pattern.size() != 0) && (pattern[pattern.size() - 1] == '/');
+    if (r.directoryOnly) {
+        pattern.erase(pattern.size() - 1);
+    }
+    r.matchName = (pattern.find('/') == std::string::npos);
+    if ((r.matchName == false) && (pattern[0] == '/')) {
+        pattern.erase(0, 1);
+    }
+    if (pattern.size() == 0) {
+        return;
+    }
+
+    if (has_special(pattern, 0) == false) {
+        r.kind = kLiteralRule;
+        r.text = unescape(pattern, 0);
+    } else if (r.matchName && (pattern[0] == '*') && (pattern.size() > 1) && (pattern[1] != '*') &&
+               (has_special(pattern, 1) == false)) {
+        r.kind = kSuffixRule;
+        r.text = unescape(pattern, 1);
+    } else {
+        r.kind = kGlobRule;
+        r.text = pattern;
+    }
+    rules.push_back(r);
+}
+
+void PathFilter::load(std::string const& path) {
+    std::ifstream file(path.c_str());
+    if (file.fail()) {
+        throw std::runtime_error("unable to open " + path);
+    }
+    for (std::string line; std::getline(file, line);) {
+        add(line);
+    }
+}
+
+std::string PathFilter::signature() const {
+    std::string result;
+    for (std::vector<Rule>::const_iterator it = rules.begin(); it != rules.end(); ++it) {
+        result += (char)('0' + it->kind);
+        result += it->negated ? '!' : ' ';
+        result += it->directoryOnly ? '/' : ' ';
+        result += it->matchName ? 'n' : 'p';
+        result += it->text;
+        result += '\n';
+    }
+    return result;
+}
+
+bool PathFilter::excluded(std::string const& path, bool is_directory) const {
+    std::size_t slash    = path.rfind('/');
+    const char* name     = path.c_str() + ((slash == std::string::npos) ? 0 : slash + 1);
+    std::size_t name_len = path.size() - (name - path.c_str());
+    for (std::vector<Rule>::const_reverse_iterator it = rules.rbegin(); it != rules.rend(); ++it) {
+        if (it->directoryOnly && (is_directory == false)) {
+            continue;
+        }
+        const char* s   = it->matchName ? name : path.c_str();
+        std::size_t len = it->matchName ? name_len : path.size();
+        bool        matched;
+        switch (it->kind) {
+            case kLiteralRule:
+                matched = (len == it->text.size()) && (std::memcmp(s, it->text.data(), len) == 0);
+                break;
+            case kSuffixRule:
+                matched = (len >= it->text.size()) &&
+                          (std::memcmp(s + len - it->text.size(), it->text.data(), it->text.size()) == 0);
+                break;
+            default:
+                matched = match_glob(it->text.data(), it->text.data() + it->text.size(), s, s + len);
+                break;
+        }
+        if (matched) {
+            return it->negated == false;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+/*
+  pathfilter.hpp - gitignore style rules that exclude paths from the directory walk
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* A list of gitignore style patterns, compiled once and matched against every entry of a
+   directory walk. The last matching pattern decides: an entry is excluded if it matches a
+   pattern, and included again if it then matches a pattern starting with '!'. Patterns
+   without a slash match the name at any level, others the whole path relative to the root
+   of the walk; a trailing slash restricts a pattern to directories. '*', '?', '[...]' and
+   '**' work as in gitignore. Since excluded directories are not descended into, nothing
+   below them can be included again. */
+class PathFilter {
+    private:
+        typedef enum {
+            kLiteralRule, // the name or path equals text
+            kSuffixRule,  // "*.ext": the name ends with text
+            kGlobRule     // anything else
+        } rule_kind_t;
+
+        struct Rule {
+            rule_kind_t kind;
+            std::string text;
+            bool        negated;
+            bool        directoryOnly;
+            bool        matchName; // matched against the name instead of the whole path
+        };
+
+        std::vector<Rule> rules;
+
+    public:
+        /* adds one line of a pattern file, blank lines and comments are ignored */
+        void add(std::string const& line);
+
+        /* adds every line of a pattern file, throws std::runtime_error if it cannot be read */
+        void load(std::string const& path);
+
+        bool empty() const { return rules.empty(); }
+
+        /* the compiled rules as a string, equal for filters that exclude the same paths */
+        std::string signature() const;
+
+        /* path is relative to the root of the walk, without a leading "./" */
+        bool excluded(std::string const& path, bool is_directory) const;
+};
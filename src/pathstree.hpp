@@ -0,0 +1,268 @@
+/*
+  pathstree.hpp - writes the variables of a bom file to any block storage
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#if defined(WINDOWS)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "bom.h"
+#include "nodetree.hpp"
+#include "stats.hpp"
+#include "writebom.hpp"
+
+/* The functions below work on BOMStorage, which keeps the whole file in memory, and on
+   BOMStreamWriter, which writes the blocks out as they are added. A Storage provides
+       uint32_t addBlock(const void* data, uint32_t length);
+       void     addVar(const char* name, const void* data, uint32_t length);
+       void     patchBlock(uint32_t id, uint32_t offset, const void* data, uint32_t length); */
+
+/* offset of BOMInfo::numberOfPaths, for storages that patch it once the tree is complete */
+#define BOM_INFO_NUMBER_OF_PATHS_OFFSET offsetof(BOMInfo, numberOfPaths)
+
+template <typename Storage>
+void add_bom_info(Storage& bom, uint32_t num) {
+    unsigned int bom_info_size = (sizeof(uint32_t) * 3) + (((num != 0) ? 1 : 0) * sizeof(BOMInfoEntry));
+    BOMInfo* info = (BOMInfo*)std::malloc(bom_info_size);
+    std::memset(info, 0, bom_info_size);
+    info->version             = htonl(1);
+    info->numberOfPaths       = htonl(num + 1);
+    info->numberOfInfoEntries = htonl((num != 0) ? 1 : 0);
+    if (num != 0) {
+        // info->entries[0].unknown2 = htonl( 57826303 ); /* ???? */
+        info->entries[0].unknown2 = htonl(0); /* ???? */
+    }
+    bom.addVar("BomInfo", info, bom_info_size);
+    std::free(info);
+}
+
+/* Writes the Paths tree one entry at a time. The entries are added in breadth first order,
+   the entry added n-th gets the id n. finish() writes the last leaf, the root branch and the
+   Paths variable. */
+template <typename Storage>
+class PathsTreeWriter {
+    private:
+        Storage&         bom;
+        BOMLayout const& layout;
+
+        std::vector<BOMPathIndices> branch;   // index0: leaf id, index1: BOMFile id of its last entry
+        std::vector<char>           leaf_buffer;
+        std::vector<char>           info2_buffer;
+        std::vector<char>           file_buffer;
+        unsigned int                k;
+        unsigned int                last_paths_id;
+        unsigned int                last_file_info;
+        uint32_t                    num;
+        bool                        has_leaf;
+
+        /* block ids in the order a reader visits them: each leaf followed by the
+           BOMFile, BOMPathInfo1 and BOMPathInfo2 blocks of its entries */
+        std::vector<uint32_t> cluster_order;
+        std::vector<uint32_t> leaf_blocks;
+
+        BOMPaths* leaf() { return (BOMPaths*)leaf_buffer.data(); }
+
+        /* adds the current leaf, which holds count entries, and links it to the previous one */
+        uint32_t addLeaf(unsigned int count) {
+            leaf()->count = htons(count);
+            uint32_t id   = bom.addBlock(leaf(), (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (count * sizeof(BOMPathIndices)));
+            if (layout.clustered) {
+                cluster_order.push_back(id);
+                cluster_order.insert(cluster_order.end(), leaf_blocks.begin(), leaf_blocks.end());
+                leaf_blocks.clear();
+            }
+            if (last_paths_id != 0) {
+                uint32_t forward = htonl(id);
+                bom.patchBlock(last_paths_id, offsetof(BOMPaths, forward), &forward, sizeof(uint32_t));
+            }
+            BOMPathIndices indices;
+            indices.index0 = htonl(id);
+            indices.index1 = last_file_info;
+            branch.push_back(indices);
+            return id;
+        }
+
+    public:
+        PathsTreeWriter(Storage& s, BOMLayout const& l)
+            : bom(s)
+            , layout(l)
+            , leaf_buffer((sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (l.pathsPerLeaf * sizeof(BOMPathIndices)))
+            , k(0)
+            , last_paths_id(0)
+            , last_file_info(0)
+            , num(0)
+            , has_leaf(false) {}
+
+        /* parent is the id of the parent directory, 0 for a top level entry */
+        void add(uint32_t parent, const char* name, node_enum_t type, uint32_t mode, uint32_t uid,
+                 uint32_t gid, uint32_t size, uint32_t checksum, const char* link_name) {
+            if (k == 0) {
+                unsigned int new_paths_id = 0;
+                if (has_leaf) {
+                    if (branch.size() + 1 >= BOM_MAX_PATHS_PER_LEAF) {
+                        std::stringstream ss;
+                        ss << "Too many paths for a leaf size of " << layout.pathsPerLeaf << ", use a larger fanout";
+                        throw std::runtime_error(ss.str());
+                    }
+                    new_paths_id = addLeaf(layout.pathsPerLeaf);
+                }
+                leaf()->isLeaf   = htons(1);
+                leaf()->forward  = 0;
+                leaf()->backward = htonl(new_paths_id);
+                last_paths_id    = new_paths_id;
+                has_leaf         = true;
+            }
+            num++;
+
+            unsigned int link_name_length    = (type == kSymbolicLinkNode) ? std::strlen(link_name) + 1 : 0;
+            unsigned int bom_path_info2_size = sizeof(BOMPathInfo2) + link_name_length;
+            info2_buffer.resize(bom_path_info2_size);
+            BOMPathInfo2* info2 = (BOMPathInfo2*)info2_buffer.data();
+            if (type == kDirectoryNode) {
+                info2->type = TYPE_DIR;
+                stats_count(kCounterDirs);
+            } else if (type == kFileNode) {
+                info2->type = TYPE_FILE;
+                stats_count(kCounterFiles);
+            } else {
+                info2->type = TYPE_LINK;
+                stats_count(kCounterLinks);
+            }
+            info2->unknown0       = 1;
+            info2->architecture   = htons(3); /* ?? */
+            info2->mode           = htons(mode);
+            info2->user           = htonl(uid);
+            info2->group          = htonl(gid);
+            info2->modtime        = 0;
+            info2->size           = htonl(size);
+            info2->unknown1       = 1;
+            info2->checksum       = htonl(checksum);
+            info2->linkNameLength = htonl(link_name_length);
+            std::memcpy(info2->linkName, link_name, link_name_length);
+
+            BOMPathInfo1 info1;
+            info1.id                   = htonl(num);
+            info1.index                = htonl(bom.addBlock(info2, bom_path_info2_size));
+            leaf()->indices[k].index0 = htonl(bom.addBlock(&info1, sizeof(BOMPathInfo1)));
+
+            unsigned int bom_file_size = sizeof(uint32_t) + 1 + std::strlen(name);
+            file_buffer.resize(bom_file_size);
+            BOMFile* f = (BOMFile*)file_buffer.data();
+            f->parent  = htonl(parent);
+            std::strcpy(f->name, name);
+            leaf()->indices[k].index1 = last_file_info = htonl(bom.addBlock(f, bom_file_size));
+
+            if (layout.clustered) {
+                leaf_blocks.push_back(ntohl(leaf()->indices[k].index1));
+                leaf_blocks.push_back(ntohl(leaf()->indices[k].index0));
+                leaf_blocks.push_back(ntohl(info1.index));
+            }
+
+            k = (k + 1) % layout.pathsPerLeaf;
+        }
+
+        /* the number of entries added so far */
+        uint32_t size() const { return num; }
+
+        /* adds the last leaf, the root branch if there is more than one leaf, and the Paths variable */
+        void finish() {
+            BOMTree tree;
+            std::memcpy(tree.tree, "tree", 4);
+            tree.version   = htonl(1);
+            tree.blockSize = htonl(layout.blockSize);
+            tree.pathCount = htonl(num);
+            tree.unknown3  = 0; /* ?? */
+
+            if (has_leaf == false) {
+                /* an empty tree points to an empty block */
+                tree.child = htonl(bom.addBlock(nullptr, 0));
+            } else {
+                uint32_t last_leaf_id = addLeaf((k == 0) ? layout.pathsPerLeaf : k);
+                if (branch.size() > 1) {
+                    unsigned int path_size  = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) + (branch.size() * sizeof(BOMPathIndices));
+                    BOMPaths*    root_paths = (BOMPaths*)std::malloc(path_size);
+                    root_paths->isLeaf      = htons(0);
+                    root_paths->count       = htons(branch.size());
+                    root_paths->forward     = 0;
+                    root_paths->backward    = 0;
+                    std::memcpy(root_paths->indices, branch.data(), branch.size() * sizeof(BOMPathIndices));
+                    tree.child = htonl(bom.addBlock(root_paths, path_size));
+                    std::free((void*)root_paths);
+                    if (layout.clustered) {
+                        cluster_order.insert(cluster_order.begin(), ntohl(tree.child));
+                    }
+                } else {
+                    tree.child = htonl(last_leaf_id);
+                }
+            }
+            bom.addVar("Paths", &tree, sizeof(BOMTree));
+        }
+
+        /* the order of the blocks for BOMLayout::clustered, complete after finish() */
+        std::vector<uint32_t> const& clusterOrder() const { return cluster_order; }
+};
+
+/* adds the empty HLIndex, VIndex and Size64 trees */
+template <typename Storage>
+void add_index_trees(Storage& bom, BOMLayout const& layout) {
+    unsigned int path_size  = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2);
+    BOMPaths*    empty_path = (BOMPaths*)std::malloc(path_size);
+    empty_path->isLeaf      = htons(1);
+    empty_path->count       = htons(0);
+    empty_path->forward     = htonl(0);
+    empty_path->backward    = htonl(0);
+
+    BOMTree tree;
+    std::memcpy(tree.tree, "tree", 4);
+    tree.version   = htonl(1);
+    tree.blockSize = htonl(layout.blockSize);
+    tree.pathCount = htonl(0);
+    tree.unknown3  = 0;
+
+    tree.child = htonl(bom.addBlock(empty_path, path_size));
+    bom.addVar("HLIndex", &tree, sizeof(BOMTree));
+
+    BOMVIndex vindex;
+    vindex.unknown0     = htonl(1);
+    tree.child          = htonl(bom.addBlock(empty_path, path_size));
+    tree.blockSize      = htonl(128);
+    vindex.indexToVTree = htonl(bom.addBlock(&tree, sizeof(BOMTree)));
+    vindex.unknown2     = htonl(0);
+    vindex.unknown3     = 0;
+    bom.addVar("VIndex", &vindex, sizeof(BOMVIndex));
+
+    tree.blockSize = htonl(layout.blockSize);
+    tree.child     = htonl(bom.addBlock(empty_path, path_size));
+    bom.addVar("Size64", &tree, sizeof(BOMTree));
+
+    std::free((void*)empty_path);
+}
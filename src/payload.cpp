@@ -0,0 +1,217 @@
+/*
+  payload.cpp - write the cpio Payload of an installer package while the bom is built
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+#include "payload.hpp"
+#include "trace.hpp"
+
+/* the archive is handed to the compressor in chunks of this size,
+   at most QUEUE_DEPTH chunks wait for it */
+#define CHUNK_SIZE  (256 * 1024)
+#define QUEUE_DEPTH 8
+
+/* the largest values the octal fields of an odc header can hold */
+#define ODC_MAX_6  0777777ULL
+#define ODC_MAX_11 077777777777ULL
+
+#define ODC_HEADER_SIZE 76
+#define ODC_TRAILER     "TRAILER!!!"
+
+/* writes value as width octal digits with leading zeros, returns the end */
+static char* octal(char* out, uint64_t value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = '0' + (value & 7);
+        value >>= 3;
+    }
+    return out + width;
+}
+
+PayloadWriter::PayloadWriter(std::string const& output_path, int l)
+    : output(output_path.c_str(), std::ios::binary | std::ios::out | std::ios::trunc)
+    , level(l)
+    , chunks(QUEUE_DEPTH)
+    , remaining(0)
+    , inode(0)
+    , finished(false) {
+    if (output.fail()) {
+        throw std::runtime_error("Unable to open payload file: " + output_path);
+    }
+    chunk.reserve(CHUNK_SIZE);
+    compressor = std::thread([this]() {
+        trace_thread_name("payload compressor");
+        compress();
+    });
+}
+
+PayloadWriter::~PayloadWriter() {
+    if (finished == false) {
+        /* left by an exception, the output is incomplete anyway */
+        chunks.close();
+        compressor.join();
+    }
+}
+
+/* runs on the compressor thread; after an error it keeps taking the chunks, so that the walk
+   does not block on a full queue */
+void PayloadWriter::compress() {
+    z_stream          z;
+    std::vector<char> in;
+    std::vector<char> out(CHUNK_SIZE);
+    bool              deflating = false;
+    try {
+        std::memset(&z, 0, sizeof(z));
+        if (level != 0) {
+            /* 16 + 15: a gzip header and trailer around a deflate stream with a 32k window */
+            if (::deflateInit2(&z, level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("Unable to initialize the payload compression");
+            }
+            deflating = true;
+        }
+        bool more = true;
+        while (more) {
+            more = chunks.pop(in);
+            if (error) {
+                continue;
+            }
+            if (deflating == false) {
+                output.write(in.data(), in.size());
+            } else {
+                z.next_in  = (Bytef*)in.data();
+                z.avail_in = in.size();
+                int flush  = more ? Z_NO_FLUSH : Z_FINISH;
+                do {
+                    z.next_out  = (Bytef*)out.data();
+                    z.avail_out = out.size();
+                    if (::deflate(&z, flush) == Z_STREAM_ERROR) {
+                        throw std::runtime_error("Payload compression failed");
+                    }
+                    output.write(out.data(), out.size() - z.avail_out);
+                } while (z.avail_out == 0);
+            }
+            if (output.fail()) {
+                throw std::runtime_error("Unable to write the payload file");
+            }
+            in.clear();
+        }
+        output.close();
+        if (output.fail()) {
+            throw std::runtime_error("Unable to write the payload file");
+        }
+    } catch (...) {
+        error = std::current_exception();
+        std::vector<char> ignore;
+        while (chunks.pop(ignore)) {}
+    }
+    if (deflating) {
+        ::deflateEnd(&z);
+    }
+}
+
+void PayloadWriter::append(const char* data, std::size_t length) {
+    while (length) {
+        std::size_t n = std::min(length, CHUNK_SIZE - chunk.size());
+        chunk.insert(chunk.end(), data, data + n);
+        data += n;
+        length -= n;
+        if (chunk.size() == CHUNK_SIZE) {
+            chunks.push(std::move(chunk));
+            chunk = std::vector<char>();
+            chunk.reserve(CHUNK_SIZE);
+        }
+    }
+}
+
+void PayloadWriter::header(std::string const& name, uint32_t mode, uint32_t uid, uint32_t gid, int64_t mtime,
+                           uint64_t size, uint64_t rdev) {
+    if ((uid > ODC_MAX_6) || (gid > ODC_MAX_6)) {
+        throw std::runtime_error("The owner of \"" + name + "\" does not fit into a cpio header");
+    }
+    if (rdev > ODC_MAX_6) {
+        throw std::runtime_error("The device number of \"" + name + "\" does not fit into a cpio header");
+    }
+    if (size > ODC_MAX_11) {
+        throw std::runtime_error("\"" + name + "\" is too large for a cpio archive");
+    }
+    if (name.size() + 1 > ODC_MAX_6) {
+        throw std::runtime_error("The path \"" + name + "\" is too long for a cpio archive");
+    }
+    uint64_t time = (mtime < 0) ? 0 : std::min<uint64_t>(mtime, ODC_MAX_11);
+    char     h[ODC_HEADER_SIZE];
+    char*    p = h;
+    std::memcpy(p, "070707", 6);
+    p = octal(p + 6, 0, 6); // dev
+    /* the inode numbers only have to differ, hard links are stored as separate files */
+    p = octal(p, inode++ & ODC_MAX_6, 6);
+    p = octal(p, mode & ODC_MAX_6, 6);
+    p = octal(p, uid, 6);
+    p = octal(p, gid, 6);
+    p = octal(p, 1, 6); // nlink
+    p = octal(p, rdev, 6);
+    p = octal(p, time, 11);
+    p = octal(p, name.size() + 1, 6);
+    octal(p, size, 11);
+    append(h, ODC_HEADER_SIZE);
+    append(name.c_str(), name.size() + 1);
+}
+
+void PayloadWriter::beginEntry(std::string const& p, uint32_t mode, uint32_t uid, uint32_t gid, int64_t mtime,
+                               uint64_t size, uint64_t rdev) {
+    if (remaining != 0) {
+        throw std::runtime_error("Contents of \"" + path + "\" are incomplete");
+    }
+    path      = p;
+    remaining = size;
+    header(path, mode, uid, gid, mtime, size, rdev);
+}
+
+void PayloadWriter::write(const uint8_t* data, std::size_t length) {
+    if (length > remaining) {
+        throw std::runtime_error("\"" + path + "\" grew while it was read");
+    }
+    remaining -= length;
+    append((const char*)data, length);
+}
+
+void PayloadWriter::endEntry() {
+    if (remaining != 0) {
+        throw std::runtime_error("\"" + path + "\" shrank while it was read");
+    }
+}
+
+void PayloadWriter::finish() {
+    endEntry();
+    header(ODC_TRAILER, 0, 0, 0, 0, 0, 0);
+    if (chunk.size()) {
+        chunks.push(std::move(chunk));
+        chunk = std::vector<char>();
+    }
+    finished = true;
+    chunks.close();
+    compressor.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+  payload.hpp - write the cpio Payload of an installer package while the bom is built
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include "boundedqueue.hpp"
+#include "crc32.hpp"
+
+#define PAYLOAD_DEFAULT_LEVEL (-1) // the default compression level of zlib
+
+/* Writes a Payload: a cpio archive in the portable "odc" format, gzip compressed unless the
+   level is 0. An entry is announced with beginEntry, the contents of a file are passed to
+   write(), usually by calc_crc32 while it checksums them, and endEntry() checks that the
+   announced number of bytes arrived. The archive is assembled in the calling thread and handed
+   over in chunks to a second thread, which compresses and writes it. All methods throw
+   std::runtime_error; errors of the second thread are thrown by finish(). */
+class PayloadWriter : public ByteSink {
+    private:
+        std::ofstream                   output;
+        int                             level;
+        BoundedQueue<std::vector<char>> chunks;
+        std::vector<char>               chunk;
+        std::thread                     compressor;
+        std::exception_ptr              error;     // set by the compressor thread
+        std::string                     path;      // of the current entry
+        uint64_t                        remaining; // bytes of the current entry still to come
+        uint32_t                        inode;
+        bool                            finished;
+
+        PayloadWriter(PayloadWriter const&);
+        PayloadWriter& operator=(PayloadWriter const&);
+
+        void append(const char* data, std::size_t length);
+        void header(std::string const& name, uint32_t mode, uint32_t uid, uint32_t gid, int64_t mtime,
+                    uint64_t size, uint64_t rdev);
+        void compress();
+
+    public:
+        explicit PayloadWriter(std::string const& output_path, int level = PAYLOAD_DEFAULT_LEVEL);
+        ~PayloadWriter();
+
+        /* path is the path in the file list, "." or "./...", size the number of bytes that follow,
+           rdev the device number of a device node in the encoding of the host */
+        void beginEntry(std::string const& path, uint32_t mode, uint32_t uid, uint32_t gid, int64_t mtime,
+                        uint64_t size, uint64_t rdev = 0);
+        void write(const uint8_t* data, std::size_t length);
+        void endEntry();
+
+        /* writes the trailer and waits until everything is written */
+        void finish();
+};
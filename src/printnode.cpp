@@ -24,89 +24,888 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <libgen.h>
+#include <map>
+#include <unordered_map>
 #include <sstream>
-#include <iomanip>
+#include <unordered_set>
 #include <stdexcept>
+#include <vector>
 
 #include "printnode.hpp"
+#include "archivereader.hpp"
+#include "buildcache.hpp"
+#include "manifestwriter.hpp"
+#include "binmanifest.hpp"
 #include "crc32.hpp"
+#include "pathfilter.hpp"
+#include "payload.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+/* directory descriptors kept open by the walk, and the buffer size of one getdents64 call */
+#define MAX_OPEN_DIRECTORIES 64
+#define DIRENT_BUFFER_SIZE   (256 * 1024)
+
+/* the buffer the contents of archive members are checksummed from, and the mode of the
+   directories print_archive adds for the parents missing from an archive */
+#define ARCHIVE_BUFFER_SIZE   (512 * 1024)
+#define ARCHIVE_PARENT_MODE   (S_IFDIR | 0755)
+
+/* writes the entries in the text format */
+class TextEmitter {
+    private:
+        ManifestWriter output;
+
+    public:
+        explicit TextEmitter(std::ostream& o)
+            : output(o) {}
+
+        bool checksums() const { return true; }
+
+        uint32_t entry(uint32_t, std::string const& path, std::string const&, uint32_t mode, uint32_t uid,
+                       uint32_t gid, bool has_size, uint64_t size, uint32_t checksum, const char* link_name) {
+            output.string(path).put('\t').octal(mode).put('\t').decimal(uid).put('/').decimal(gid);
+            if (has_size) {
+                output.put('\t').decimal(size).put('\t').decimal(checksum);
+            }
+            if (link_name) {
+                output.put('\t').string(link_name);
+            }
+            output.put('\n');
+            return 0;
+        }
+};
+
+/* writes the entries in the binary format, see binmanifest.hpp */
+class BinaryEmitter {
+    private:
+        BinaryManifestWriter output;
+
+    public:
+        explicit BinaryEmitter(std::ostream& o)
+            : output(o) {}
+
+        void finish() { output.finish(); }
+
+        bool checksums() const { return true; }
+
+        uint32_t entry(uint32_t parent, std::string const&, std::string const& name, uint32_t mode, uint32_t uid,
+                       uint32_t gid, bool, uint64_t size, uint32_t checksum, const char* link_name) {
+            return output.add(parent, name, mode, uid, gid, size, checksum, link_name);
+        }
+};
+
+/* adds the entries to a fingerprint instead of writing them; the files are not read, a digest
+   of their modification and change times and inode number stands in for the checksum */
+class FingerprintEmitter {
+    private:
+        Fingerprint& output;
+
+    public:
+        explicit FingerprintEmitter(Fingerprint& f)
+            : output(f) {}
+
+        bool checksums() const { return false; }
+
+        uint32_t entry(uint32_t, std::string const& path, std::string const&, uint32_t mode, uint32_t uid,
+                       uint32_t gid, bool has_size, uint64_t size, uint32_t checksum, const char* link_name) {
+            output.add(path);
+            output.add(((uint64_t)mode << 32) | (has_size ? 1 : 0));
+            output.add(((uint64_t)uid << 32) | gid);
+            output.add(size);
+            output.add((uint64_t)checksum);
+            output.add(std::string(link_name ? link_name : ""));
+            return 0;
+        }
+};
+
+/* counts the entries and the bytes their checksums would read, without reading anything */
+class MeasureEmitter {
+    public:
+        uint64_t numEntries;
+        uint64_t numBytes;
+
+        MeasureEmitter()
+            : numEntries(0)
+            , numBytes(0) {}
 
-/* on unix system_path = path; on windows system_path is the windows native path format of path */
-void print_node(std::ostream& output, std::string const& base, std::string const& system_path, std::string const& path,
-                uint32_t uid, uint32_t gid) {
+        bool checksums() const { return false; }
+
+        uint32_t entry(uint32_t, std::string const&, std::string const&, uint32_t mode, uint32_t, uint32_t, bool,
+                       uint64_t size, uint32_t, const char*) {
+            numEntries++;
+            if (S_ISREG(mode)) {
+                numBytes += size;
+            }
+            return 0;
+        }
+};
+
+/* keeps the entries in a ResidentTree; the walk looks the checksum of a file up by its
+   identity, so only files that are new or changed are read */
+class ResidentEmitter {
+    private:
+        ResidentTree::entries_t& output;
+
+    public:
+        explicit ResidentEmitter(ResidentTree::entries_t& o)
+            : output(o) {}
+
+        bool checksums() const { return true; }
+
+        uint32_t entry(uint32_t, std::string const& path, std::string const&, uint32_t mode, uint32_t uid,
+                       uint32_t gid, bool, uint64_t size, uint32_t checksum, const char* link_name) {
+            ResidentTree::Entry e;
+            e.node.mode = mode;
+            e.node.uid  = uid;
+            e.node.gid  = gid;
+            if (S_ISDIR(mode)) {
+                e.node.type = kDirectoryNode;
+            } else if (S_ISREG(mode)) {
+                e.node.type     = kFileNode;
+                e.node.size     = size;
+                e.node.checksum = checksum;
+            } else if (S_ISLNK(mode)) {
+                e.node.type           = kSymbolicLinkNode;
+                e.node.size           = size;
+                e.node.checksum       = checksum;
+                e.node.linkName       = link_name;
+                e.node.linkNameLength = e.node.linkName.size() + 1;
+            } else {
+                throw std::runtime_error("Node type not supported");
+            }
+            output[path] = std::move(e);
+            return 0;
+        }
+};
+
+/* what FingerprintEmitter gets instead of the checksum of a file */
+static uint32_t metadata_digest(int64_t mtime, int64_t mtime_nsec, int64_t ctime, int64_t ctime_nsec, uint64_t ino) {
+    uint64_t values[5] = { (uint64_t)mtime, (uint64_t)mtime_nsec, (uint64_t)ctime, (uint64_t)ctime_nsec, ino };
+    return crc32_update(0, (const uint8_t*)values, sizeof(values));
+}
+
+#if defined(WINDOWS)
+/* system_path is the windows native path format of path.
+   parent is the value the emitter returned for the parent directory.
+   Unless payload is null, every entry is also archived to it. */
+template <typename Emitter>
+void print_node(Emitter& output, std::string const& base, std::string const& system_path, std::string const& path,
+                std::string const& name, uint32_t parent, uint32_t uid, uint32_t gid, PathFilter const* filter,
+                PayloadWriter* payload) {
     struct stat s;
     std::string      fullpath(base);
-#if defined(WINDOWS)
+    int              stat_ret;
     if (system_path.size() != 0) {
         fullpath += std::string("\\") + system_path;
     }
-    int stat_ret = ::stat(fullpath.c_str(), &s);
-#else
-    fullpath += std::string("/") + system_path;
-    int stat_ret = ::lstat(fullpath.c_str(), &s);
-#endif
+    {
+        TraceSpan span("stat", fullpath);
+        stat_ret = ::stat(fullpath.c_str(), &s);
+        span.setSize(stat_ret == 0 ? s.st_size : -1);
+    }
     if (stat_ret != 0) {
-        std::cerr << "Unable to find path: " << fullpath << std::endl;
-        std::exit(1);
+        throw std::runtime_error(std::string("Unable to find path: ") + fullpath);
     }
-    output << path << "\t" << std::setbase(8) << s.st_mode << "\t" << std::setbase(10);
-    output << (uid == UINT_MAX ? s.st_uid : uid) << "/" << (gid == UINT_MAX ? s.st_gid : gid);
+    /* every path but the root starts with "./" */
+    if (filter && (path.size() > 2) && filter->excluded(path.substr(2), S_ISDIR(s.st_mode))) {
+        stats_count(kCounterExcluded);
+        return;
+    }
+    uint32_t id;
+    uint32_t owner = (uid == UINT_MAX ? s.st_uid : uid);
+    uint32_t group = (gid == UINT_MAX ? s.st_gid : gid);
     if (S_ISREG(s.st_mode)) {
-        output << "\t" << s.st_size << "\t" << calc_crc32(fullpath.c_str());
+        uint32_t checksum;
+        if (output.checksums() == false) {
+            checksum = metadata_digest(s.st_mtime, 0, s.st_ctime, 0, s.st_ino);
+        } else {
+            if (payload) {
+                payload->beginEntry(path, s.st_mode, owner, group, s.st_mtime, s.st_size);
+            }
+            {
+                TraceSpan span("calc_crc32", fullpath);
+                span.setSize(s.st_size);
+                checksum = calc_crc32(fullpath.c_str(), payload);
+            }
+            if (payload) {
+                payload->endEntry();
+            }
+        }
+        id = output.entry(parent, path, name, s.st_mode, owner, group, true, s.st_size, checksum, nullptr);
+    } else {
+        if (payload) {
+            payload->beginEntry(path, s.st_mode, owner, group, s.st_mtime, 0, s.st_rdev);
+        }
+        id = output.entry(parent, path, name, s.st_mode, owner, group, false, 0, 0, nullptr);
     }
-#if !defined(WINDOWS)
-    if (S_ISLNK(s.st_mode)) {
-        char    buffer[PATH_MAX + 1];
-        ssize_t num_bytes = ::readlink(fullpath.c_str(), buffer, PATH_MAX);
-        if (num_bytes < 0) {
-            std::cerr << "Unable to read symbolic link: " << fullpath.c_str() << std::endl;
-            std::exit(1);
+    if (S_ISDIR(s.st_mode)) {
+        DIR* d;
+        {
+            TraceSpan span("opendir", fullpath);
+            d = ::opendir(fullpath.c_str());
+        }
+        /* read the whole directory before descending, so only one directory is open at a time */
+        std::vector<std::string> names;
+        {
+            TraceSpan      span("readdir", fullpath);
+            struct dirent* dir;
+            while ((dir = ::readdir(d)) != nullptr) {
+                if (dir->d_name[0] != '.') {
+                    names.push_back(dir->d_name);
+                }
+            }
+            ::closedir(d);
+            span.setCount(names.size());
+        }
+        std::sort(names.begin(), names.end());
+        for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+            std::string new_path(path);
+            new_path += std::string("/") + *it;
+            std::string new_system_path(system_path);
+            new_system_path += std::string("\\") + *it;
+            print_node(output, base, new_system_path, new_path, *it, id, uid, gid, filter, payload);
+        }
+    }
+}
+#else
+/* the attributes of an entry that end up in the file list */
+struct EntryStat {
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size;
+    int64_t  mtime;
+    int64_t  mtimeNsec;
+    int64_t  ctime; // ctime, ino and dev identify the contents of a file without reading it
+    int64_t  ctimeNsec;
+    uint64_t ino;
+    uint64_t dev;
+    uint64_t rdev; // the device number of a device node
+};
+
+/* stats name relative to the directory dir_fd. statx is asked for the fields of EntryStat only,
+   so file systems can skip computing the rest; kernels without statx fall back to fstatat. */
+static bool stat_at(int dir_fd, const char* name, bool follow, EntryStat& st) {
+#if defined(STATX_TYPE)
+    static std::atomic<bool> has_statx(true); // walks may run on several threads
+    if (has_statx) {
+        struct statx sx;
+        int flags = AT_NO_AUTOMOUNT | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+        if (::statx(dir_fd, name, flags, STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE | STATX_MTIME |
+                        STATX_CTIME | STATX_INO, &sx) == 0) {
+            st.mode  = sx.stx_mode;
+            st.uid   = sx.stx_uid;
+            st.gid   = sx.stx_gid;
+            st.size  = sx.stx_size;
+            st.mtime     = sx.stx_mtime.tv_sec;
+            st.mtimeNsec = sx.stx_mtime.tv_nsec;
+            st.ctime     = sx.stx_ctime.tv_sec;
+            st.ctimeNsec = sx.stx_ctime.tv_nsec;
+            st.ino       = sx.stx_ino;
+            st.dev       = ((uint64_t)sx.stx_dev_major << 32) | sx.stx_dev_minor;
+            st.rdev      = makedev(sx.stx_rdev_major, sx.stx_rdev_minor);
+            return true;
+        }
+        if (errno != ENOSYS) {
+            return false;
         }
-        buffer[num_bytes] = '\0';
-        output << "\t" << s.st_size << "\t" << calc_str_crc32(buffer) << "\t" << buffer;
+        has_statx = false;
     }
 #endif
-    output << std::endl;
-    if (S_ISDIR(s.st_mode)) {
-        DIR*           d = ::opendir(fullpath.c_str());
-        struct dirent* dir;
-        while ((dir = ::readdir(d)) != nullptr) {
-            if (dir->d_name[0] != '.') {
-                std::string new_path(path);
-                new_path += std::string("/") + std::string(dir->d_name);
-#if defined(WINDOWS)
-                std::string new_system_path(system_path);
-                new_system_path += std::string("\\") + std::string(dir->d_name);
+    struct stat s;
+    if (::fstatat(dir_fd, name, &s, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    st.mode  = s.st_mode;
+    st.uid   = s.st_uid;
+    st.gid   = s.st_gid;
+    st.size  = s.st_size;
+    st.mtime = s.st_mtime;
+#if defined(__APPLE__)
+    st.mtimeNsec = s.st_mtimespec.tv_nsec;
+    st.ctimeNsec = s.st_ctimespec.tv_nsec;
+#else
+    st.mtimeNsec = s.st_mtim.tv_nsec;
+    st.ctimeNsec = s.st_ctim.tv_nsec;
+#endif
+    st.ctime = s.st_ctime;
+    st.ino   = s.st_ino;
+    st.dev   = s.st_dev;
+    st.rdev  = s.st_rdev;
+    return true;
+}
+
+#if defined(__linux__)
+/* the record layout of the getdents64 system call */
+struct LinuxDirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[1];
+};
+#endif
+
+/* Walks the tree iteratively, depth first, through directory file descriptors: every entry is
+   looked up by its name in the already open parent directory instead of by its full path.
+   Only the descriptors of the deepest MAX_OPEN_DIRECTORIES directories stay open. When the
+   walk returns to a directory whose descriptor was closed, it is opened again as ".." of the
+   child it returns from, which works at any depth, unlike a lookup by the full path.
+   Unless payload is null, every entry is also archived to it, files from the same read that
+   computes their checksum. Otherwise, unless shared is null, checksums are looked up in and
+   added to it. */
+template <typename Emitter>
+class DirectoryWalker {
+    private:
+        struct Frame {
+            int                      fd;
+            std::string              path;  // path in the file list, "." or "./..."
+            uint32_t                 id;    // the value the emitter returned for the directory
+            std::vector<std::string> names; // the sorted entries of the directory
+            std::size_t              next;
+        };
+
+        Emitter&           output;
+        std::string const& base;
+        uint32_t           uid;
+        uint32_t           gid;
+        PathFilter const*  filter;
+        PayloadWriter*     payload;
+        ChecksumCache*     shared;
+        std::vector<Frame> frames;
+        unsigned int       num_open;
+        std::vector<char>  dirent_buffer;
+
+        std::string systemPath(std::string const& path) const { return base + "/" + path; }
+
+        /* closes the descriptors of the directories closest to the root */
+        void limitOpen() {
+            for (std::size_t i = 0; (num_open > MAX_OPEN_DIRECTORIES) && (i + 1 < frames.size()); ++i) {
+                if (frames[i].fd >= 0) {
+                    ::close(frames[i].fd);
+                    frames[i].fd = -1;
+                    num_open--;
+                }
+            }
+        }
+
+        /* reads the names of all entries except those starting with a dot, in sorted order */
+        bool readNames(int fd, std::vector<std::string>& names) {
+#if defined(__linux__)
+            while (true) {
+                long n = ::syscall(SYS_getdents64, fd, dirent_buffer.data(), dirent_buffer.size());
+                if (n < 0) {
+                    return false;
+                }
+                if (n == 0) {
+                    break;
+                }
+                for (long pos = 0; pos < n;) {
+                    LinuxDirent64 const* d = (LinuxDirent64 const*)&dirent_buffer[pos];
+                    if (d->d_name[0] != '.') {
+                        names.push_back(d->d_name);
+                    }
+                    pos += d->d_reclen;
+                }
+            }
 #else
-                std::string new_system_path(new_path);
+            int copy = ::dup(fd);
+            DIR* d   = (copy < 0) ? nullptr : ::fdopendir(copy);
+            if (d == nullptr) {
+                if (copy >= 0) {
+                    ::close(copy);
+                }
+                return false;
+            }
+            struct dirent* dir;
+            while ((dir = ::readdir(d)) != nullptr) {
+                if (dir->d_name[0] != '.') {
+                    names.push_back(dir->d_name);
+                }
+            }
+            ::closedir(d);
 #endif
-                print_node(output, base, new_system_path, new_path, uid, gid);
+            std::sort(names.begin(), names.end());
+            return true;
+        }
+
+        void visit(int dir_fd, const char* name, std::string const& path, uint32_t parent, bool follow) {
+            EntryStat st;
+            bool      found;
+            {
+                TraceSpan span("statx", path);
+                found = stat_at(dir_fd, name, follow, st);
+                span.setSize(found ? (int64_t)st.size : -1);
+            }
+            if (found == false) {
+                throw std::runtime_error(std::string("Unable to find path: ") + systemPath(path));
+            }
+            /* every path but the root starts with "./" */
+            if (filter && (path.size() > 2) && filter->excluded(path.substr(2), S_ISDIR(st.mode))) {
+                stats_count(kCounterExcluded);
+                return;
+            }
+            const char* entry_name = (path.size() > 2) ? name : ".";
+            uint32_t    id;
+            uint32_t    owner = (uid == UINT_MAX ? st.uid : uid);
+            uint32_t    group = (gid == UINT_MAX ? st.gid : gid);
+            if (S_ISREG(st.mode)) {
+                uint32_t checksum;
+                if (output.checksums() == false) {
+                    checksum = metadata_digest(st.mtime, st.mtimeNsec, st.ctime, st.ctimeNsec, st.ino);
+                } else {
+                    if (payload) {
+                        payload->beginEntry(path, st.mode, owner, group, st.mtime, st.size);
+                    }
+                    if (shared && (payload == nullptr)) {
+                        FileIdentity id = { st.dev, st.ino, st.size, st.mtime, st.mtimeNsec, st.ctime, st.ctimeNsec };
+                        checksum        = shared->checksum(id, [&]() {
+                            TraceSpan span("calc_crc32", path);
+                            span.setSize(st.size);
+                            return calc_crc32_at(dir_fd, name, systemPath(path).c_str(), nullptr);
+                        });
+                    } else {
+                        TraceSpan span("calc_crc32", path);
+                        span.setSize(st.size);
+                        checksum = calc_crc32_at(dir_fd, name, systemPath(path).c_str(), payload);
+                    }
+                    if (payload) {
+                        payload->endEntry();
+                    }
+                }
+                id = output.entry(parent, path, entry_name, st.mode, owner, group, true, st.size, checksum, nullptr);
+            } else if (S_ISLNK(st.mode)) {
+                char    buffer[PATH_MAX + 1];
+                ssize_t num_bytes = ::readlinkat(dir_fd, name, buffer, PATH_MAX);
+                if (num_bytes < 0) {
+                    throw std::runtime_error(std::string("Unable to read symbolic link: ") + systemPath(path));
+                }
+                buffer[num_bytes] = '\0';
+                if (payload) {
+                    /* the contents of a symbolic link in a cpio archive are its target */
+                    payload->beginEntry(path, st.mode, owner, group, st.mtime, num_bytes);
+                    payload->write((const uint8_t*)buffer, num_bytes);
+                    payload->endEntry();
+                }
+                id = output.entry(parent, path, entry_name, st.mode, owner, group, true, st.size, calc_str_crc32(buffer), buffer);
+            } else {
+                if (payload) {
+                    payload->beginEntry(path, st.mode, owner, group, st.mtime, 0, st.rdev);
+                }
+                id = output.entry(parent, path, entry_name, st.mode, owner, group, false, 0, 0, nullptr);
+            }
+            if (S_ISDIR(st.mode)) {
+                Frame f;
+                {
+                    TraceSpan span("openat", path);
+                    f.fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW));
+                }
+                if (f.fd < 0) {
+                    throw std::runtime_error(std::string("Unable to open directory: ") + systemPath(path));
+                }
+                {
+                    TraceSpan span("getdents64", path);
+                    if (readNames(f.fd, f.names) == false) {
+                        throw std::runtime_error(std::string("Unable to read directory: ") + systemPath(path));
+                    }
+                    span.setCount(f.names.size());
+                }
+                f.path = path;
+                f.id   = id;
+                f.next = 0;
+                frames.push_back(std::move(f));
+                num_open++;
+                limitOpen();
             }
         }
-        ::closedir(d);
-    }
-}
 
-void print_node(std::ostream& output, std::string directory, uint32_t uid, uint32_t gid) {
+    public:
+        DirectoryWalker(Emitter& o, std::string const& b, uint32_t u, uint32_t g, PathFilter const* pf,
+                        PayloadWriter* p, ChecksumCache* c = nullptr)
+            : output(o)
+            , base(b)
+            , uid(u)
+            , gid(g)
+            , filter(pf)
+            , payload(p)
+            , shared(c)
+            , num_open(0)
+            , dirent_buffer(DIRENT_BUFFER_SIZE) {}
+
+        /* only closes anything if the walk was left by an exception */
+        ~DirectoryWalker() {
+            for (std::size_t i = 0; i < frames.size(); ++i) {
+                if (frames[i].fd >= 0) {
+                    ::close(frames[i].fd);
+                }
+            }
+        }
+
+        /* walks the whole tree, or only path and the entries below it */
+        void walk(std::string const& path = ".") {
+            if (path == ".") {
+                visit(AT_FDCWD, base.c_str(), ".", 0, true);
+            } else {
+                visit(AT_FDCWD, systemPath(path).c_str(), path, 0, false);
+            }
+            while (frames.empty() == false) {
+                Frame& top = frames.back();
+                if (top.next == top.names.size()) {
+                    if ((frames.size() > 1) && (frames[frames.size() - 2].fd < 0)) {
+                        Frame& parent = frames[frames.size() - 2];
+                        parent.fd     = ::openat(top.fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                        if (parent.fd < 0) {
+                            throw std::runtime_error(std::string("Unable to open directory: ") + systemPath(parent.path));
+                        }
+                        num_open++;
+                    }
+                    ::close(top.fd);
+                    num_open--;
+                    frames.pop_back();
+                    continue;
+                }
+                std::string name = std::move(top.names[top.next++]);
+                std::string path = top.path + "/" + name;
+                uint32_t    id   = top.id;
+                visit(top.fd, name.c_str(), path, id, false);
+            }
+        }
+};
+#endif
+
+/* checks that directory is one and removes a trailing slash */
+static std::string walk_root(std::string directory) {
     if (directory.size() < 1) {
-        std::cerr << "Invalid path" << std::endl;
-        std::exit(1);
+        throw std::runtime_error("Invalid path");
     }
     if (directory[directory.size() - 1] == '/') {
         directory = directory.substr(0, directory.size() - 1);
     }
     struct stat s;
     if (::stat(directory.c_str(), &s) != 0) {
-        std::cerr << "Unable to find path: " << directory << std::endl;
-        std::exit(1);
+        throw std::runtime_error(std::string("Unable to find path: ") + directory);
     }
     if (S_ISDIR(s.st_mode) == false) {
-        std::cout << std::endl << "Argument must be a directory" << std::endl;
-        std::exit(1);
+        throw std::runtime_error("Argument must be a directory");
+    }
+    return directory;
+}
+
+void fingerprint_node(Fingerprint& fingerprint, std::string directory, uint32_t uid, uint32_t gid,
+                      PathFilter const* filter) {
+    directory = walk_root(directory);
+    StatsPhase         phase(kPhaseWalk);
+    FingerprintEmitter emitter(fingerprint);
+#if defined(WINDOWS)
+    print_node(emitter, directory, "", ".", ".", 0, uid, gid, filter, nullptr);
+#else
+    DirectoryWalker<FingerprintEmitter>(emitter, directory, uid, gid, filter, nullptr).walk();
+#endif
+}
+
+void measure_node(std::string directory, PathFilter const* filter, uint64_t& num_entries, uint64_t& num_bytes) {
+    directory = walk_root(directory);
+    StatsPhase     phase(kPhaseWalk);
+    MeasureEmitter emitter;
+#if defined(WINDOWS)
+    print_node(emitter, directory, "", ".", ".", 0, UINT_MAX, UINT_MAX, filter, nullptr);
+#else
+    DirectoryWalker<MeasureEmitter>(emitter, directory, UINT_MAX, UINT_MAX, filter, nullptr).walk();
+#endif
+    num_entries = emitter.numEntries;
+    num_bytes   = emitter.numBytes;
+}
+
+void print_node(std::ostream& output, std::string directory, uint32_t uid, uint32_t gid, manifest_format_t format,
+                PathFilter const* filter, PayloadWriter* payload, ChecksumCache* checksums) {
+    directory = walk_root(directory);
+    StatsPhase phase(kPhaseWalk);
+    if (format == kBinaryManifest) {
+        BinaryEmitter emitter(output);
+#if defined(WINDOWS)
+        print_node(emitter, directory, "", ".", ".", 0, uid, gid, filter, payload);
+#else
+        DirectoryWalker<BinaryEmitter>(emitter, directory, uid, gid, filter, payload, checksums).walk();
+#endif
+        emitter.finish();
+    } else {
+        TextEmitter emitter(output);
+#if defined(WINDOWS)
+        print_node(emitter, directory, "", ".", ".", 0, uid, gid, filter, payload);
+#else
+        DirectoryWalker<TextEmitter>(emitter, directory, uid, gid, filter, payload, checksums).walk();
+#endif
+    }
+}
+
+bool WalkOrder::operator()(std::string const& a, std::string const& b) const {
+    std::size_t n = std::min(a.size(), b.size());
+    for (std::size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            /* a slash sorts before every other character, so a directory is followed by its entries */
+            if (a[i] == '/') {
+                return true;
+            }
+            if (b[i] == '/') {
+                return false;
+            }
+            return (unsigned char)a[i] < (unsigned char)b[i];
+        }
+    }
+    return a.size() < b.size();
+}
+
+/* whether path is below or equal to top, both "." or "./..." */
+static bool in_subtree(std::string const& path, std::string const& top) {
+    if (top == ".") {
+        return true;
+    }
+    return (path.compare(0, top.size(), top) == 0) && ((path.size() == top.size()) || (path[top.size()] == '/'));
+}
+
+static bool same_node(Node const& a, Node const& b) {
+    return (a.type == b.type) && (a.mode == b.mode) && (a.uid == b.uid) && (a.gid == b.gid) && (a.size == b.size) &&
+           (a.checksum == b.checksum) && (a.linkName == b.linkName);
+}
+
+ResidentTree::ResidentTree(std::string directory, uint32_t u, uint32_t g, PathFilter const* pf)
+    : base(walk_root(directory))
+    , uid(u)
+    , gid(g)
+    , filter(pf)
+    , checksums(new ChecksumCache()) {}
+
+ResidentTree::~ResidentTree() {}
+
+bool ResidentTree::update(std::string const& path) {
+    if (path != ".") {
+        std::size_t         slash  = path.rfind('/');
+        entries_t::iterator parent = entries_.find(path.substr(0, slash));
+        /* the walk leaves out names starting with a dot */
+        if ((parent == entries_.end()) || (parent->second.node.type != kDirectoryNode) || (path[slash + 1] == '.')) {
+            return false;
+        }
+    }
+    std::vector<std::pair<std::string, Entry>> previous;
+    entries_t::iterator                        first = entries_.lower_bound(path);
+    entries_t::iterator                        last  = first;
+    for (; (last != entries_.end()) && in_subtree(last->first, path); ++last) {
+        previous.push_back(*last);
+    }
+    entries_.erase(first, last);
+
+    bool exists = true;
+    if (path != ".") {
+        struct stat s;
+        std::string system_path = base + "/" + path.substr(2);
+#if defined(WINDOWS)
+        exists = (::stat(system_path.c_str(), &s) == 0);
+#else
+        exists = (::lstat(system_path.c_str(), &s) == 0);
+#endif
+    }
+    if (exists) {
+        StatsPhase      phase(kPhaseWalk);
+        ResidentEmitter emitter(entries_);
+#if defined(WINDOWS)
+        std::string system_path = (path == ".") ? std::string() : path.substr(2);
+        std::replace(system_path.begin(), system_path.end(), '/', '\\');
+        print_node(emitter, base, system_path, path, path.substr(path.rfind('/') + 1), 0, uid, gid, filter, nullptr);
+#else
+        DirectoryWalker<ResidentEmitter>(emitter, base, uid, gid, filter, nullptr, checksums.get()).walk(path);
+#endif
+    }
+
+    /* once the checksums of files that are gone outnumber the current ones, start over: the
+       files of later walks are read once more */
+    if (checksums->size() > 2 * entries_.size() + 1024) {
+        checksums.reset(new ChecksumCache());
+    }
+
+    std::size_t i = 0;
+    for (entries_t::const_iterator it = entries_.lower_bound(path); (it != entries_.end()) && in_subtree(it->first, path);
+         ++it, ++i) {
+        if ((i == previous.size()) || (it->first != previous[i].first) || !same_node(it->second.node, previous[i].second.node)) {
+            return true;
+        }
+    }
+    return i != previous.size();
+}
+
+void ResidentTree::directories(std::string const& path, std::vector<std::string>& result) const {
+    for (entries_t::const_iterator it = entries_.lower_bound(path); (it != entries_.end()) && in_subtree(it->first, path);
+         ++it) {
+        if (it->second.node.type == kDirectoryNode) {
+            result.push_back(it->first);
+        }
+    }
+}
+
+/* the path of an archive member in the file list: "." or "./..." */
+static std::string archive_list_path(std::string const& name) {
+    std::string result(".");
+    std::size_t pos = 0;
+    while (pos <= name.size()) {
+        std::size_t slash     = std::min(name.find('/', pos), name.size());
+        std::string component = name.substr(pos, slash - pos);
+        pos                   = slash + 1;
+        if (component.empty() || (component == ".")) {
+            continue;
+        }
+        if (component == "..") {
+            throw std::runtime_error("Archive member \"" + name + "\" lies outside of the archive");
+        }
+        result += "/" + component;
+    }
+    return result;
+}
+
+/* whether one of the parents of path is in excluded */
+static bool in_excluded_directory(std::string const& path, std::unordered_set<std::string> const& excluded) {
+    for (std::size_t slash = path.find('/', 2); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (excluded.count(path.substr(0, slash))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* an entry of the file list of an archive */
+struct ArchiveEntry {
+    uint32_t    mode;
+    uint32_t    uid;
+    uint32_t    gid;
+    uint64_t    size;
+    uint32_t    checksum;
+    std::string linkName;
+    uint64_t    dev; // with ino the identity of a cpio member with several links, otherwise 0
+    uint64_t    ino;
+};
+
+void print_archive(std::ostream& output, std::istream& archive, uint32_t uid, uint32_t gid, PathFilter const* filter) {
+    StatsPhase    phase(kPhaseWalk);
+    ArchiveReader reader(archive);
+    ArchiveMember m;
+
+    /* sorted by path, so every directory comes before its contents; a later member of the
+       same path replaces an earlier one, like it does when the archive is extracted */
+    std::map<std::string, ArchiveEntry> entries;
+    std::map<std::pair<uint64_t, uint64_t>, std::pair<uint64_t, uint32_t>> link_contents; // size and checksum by dev and ino
+    std::vector<uint8_t> buffer(ARCHIVE_BUFFER_SIZE);
+    while (reader.next(m)) {
+        std::string  path = archive_list_path(m.path);
+        ArchiveEntry e;
+        e.mode     = m.mode;
+        e.uid      = (uid == UINT_MAX ? m.uid : uid);
+        e.gid      = (gid == UINT_MAX ? m.gid : gid);
+        e.size     = 0;
+        e.checksum = 0;
+        e.dev      = 0;
+        e.ino      = 0;
+        if (m.hardLink) {
+            std::map<std::string, ArchiveEntry>::const_iterator target = entries.find(archive_list_path(m.linkName));
+            if ((target == entries.end()) || (S_ISREG(target->second.mode) == false)) {
+                throw std::runtime_error("The target of the hard link \"" + m.path + "\" is not a file of the archive");
+            }
+            e.size     = target->second.size;
+            e.checksum = target->second.checksum;
+            e.dev      = target->second.dev;
+            e.ino      = target->second.ino;
+        } else if (S_ISREG(m.mode)) {
+            TraceSpan span("calc_crc32", path);
+            span.setSize(m.size);
+            uint32_t crc = 0;
+            for (std::size_t n; (n = reader.read(buffer.data(), buffer.size())) != 0;) {
+                crc = crc32_update(crc, buffer.data(), n);
+            }
+            e.size     = m.size;
+            e.checksum = crc32_finish(crc, m.size);
+            stats_count(kCounterBytesHashed, m.size);
+            if (m.nlink > 1) {
+                /* newc archives only store the contents with the last link of a file */
+                e.dev = m.dev;
+                e.ino = m.ino;
+                if (m.size) {
+                    link_contents[std::make_pair(m.dev, m.ino)] = std::make_pair(e.size, e.checksum);
+                }
+            }
+        } else if (S_ISLNK(m.mode)) {
+            e.linkName = m.linkName;
+            e.size     = m.linkName.size();
+            e.checksum = calc_str_crc32(m.linkName.c_str());
+        }
+        entries[path] = e;
+    }
+
+    ArchiveEntry parent;
+    parent.mode     = ARCHIVE_PARENT_MODE;
+    parent.uid      = (uid == UINT_MAX ? 0 : uid);
+    parent.gid      = (gid == UINT_MAX ? 0 : gid);
+    parent.size     = 0;
+    parent.checksum = 0;
+    parent.dev      = 0;
+    parent.ino      = 0;
+    entries.insert(std::make_pair(std::string("."), parent));
+    /* add the parents an archive may leave out */
+    std::vector<std::string> missing;
+    for (std::map<std::string, ArchiveEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        std::string const& path = it->first;
+        for (std::size_t slash = path.find('/', 2); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            if (entries.count(path.substr(0, slash)) == 0) {
+                missing.push_back(path.substr(0, slash));
+            }
+        }
+    }
+    for (std::size_t i = 0; i < missing.size(); ++i) {
+        entries.insert(std::make_pair(missing[i], parent));
+    }
+
+    std::unordered_set<std::string> excluded; // directories excluded by filter
+    TextEmitter                     emitter(output);
+    for (std::map<std::string, ArchiveEntry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        std::string const& path = it->first;
+        ArchiveEntry&      e    = it->second;
+        /* like the walk, leave out names starting with a dot and everything below them; such
+           members were still read above, since a hard link elsewhere may point to one */
+        if (path.find("/.") != std::string::npos) {
+            continue;
+        }
+        if (filter && (path.size() > 2)) {
+            if (in_excluded_directory(path, excluded) || filter->excluded(path.substr(2), S_ISDIR(e.mode))) {
+                if (S_ISDIR(e.mode)) {
+                    excluded.insert(path);
+                }
+                stats_count(kCounterExcluded);
+                continue;
+            }
+        }
+        std::string name = path.substr(path.rfind('/') + 1);
+        if (S_ISREG(e.mode)) {
+            std::map<std::pair<uint64_t, uint64_t>, std::pair<uint64_t, uint32_t>>::const_iterator contents =
+                link_contents.find(std::make_pair(e.dev, e.ino));
+            if ((e.size == 0) && (e.ino != 0) && (contents != link_contents.end())) {
+                e.size     = contents->second.first;
+                e.checksum = contents->second.second;
+            }
+            emitter.entry(0, path, name, e.mode, e.uid, e.gid, true, e.size, e.checksum, nullptr);
+        } else if (S_ISLNK(e.mode)) {
+            emitter.entry(0, path, name, e.mode, e.uid, e.gid, true, e.size, e.checksum, e.linkName.c_str());
+        } else {
+            emitter.entry(0, path, name, e.mode, e.uid, e.gid, false, 0, 0, nullptr);
+        }
     }
-    print_node(output, directory, "", ".", uid, gid);
 }
@@ -23,8 +23,91 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <climits>
 #include <cstdint>
 
-void print_node(std::ostream& output, std::string directory, uint32_t uid, uint32_t gid);
+#include "nodetree.hpp"
+
+class PathFilter;
+class PayloadWriter;
+class Fingerprint;
+class ChecksumCache;
+
+typedef enum {
+    kTextManifest,   // the tab separated format also printed by lsbom
+    kBinaryManifest, // see binmanifest.hpp
+} manifest_format_t;
+
+/* prints the file list of directory, uid and gid replace the owner of every entry unless they are UINT_MAX.
+   Entries excluded by filter are left out, excluded directories are not read at all.
+   Unless payload is null, the entries are also archived to it; the caller finishes the payload.
+   Otherwise, unless checksums is null, the walk shares the checksums of files with the other walks
+   using it; this is ignored on Windows, whose files have no inode numbers. */
+void print_node(std::ostream& output, std::string directory, uint32_t uid, uint32_t gid,
+                manifest_format_t format = kTextManifest, PathFilter const* filter = nullptr,
+                PayloadWriter* payload = nullptr, ChecksumCache* checksums = nullptr);
+
+/* counts the entries print_node would list and the sizes of their files, without reading any file */
+void measure_node(std::string directory, PathFilter const* filter, uint64_t& num_entries, uint64_t& num_bytes);
+
+/* Adds what print_node would list to fingerprint without reading any file: the checksum of a
+   file is replaced by its modification and change times and inode number, so a changed file
+   changes the fingerprint as long as the file system updates its change time. */
+void fingerprint_node(Fingerprint& fingerprint, std::string directory, uint32_t uid, uint32_t gid,
+                      PathFilter const* filter = nullptr);
+
+/* prints the file list of a tar or cpio archive, optionally gzip compressed, as if it had been
+   extracted to a directory: parents missing from the archive are listed as directories owned
+   by root, or by uid and gid, which replace the owner of every entry unless they are UINT_MAX.
+   The contents are checksummed as they stream by, the archive is read only once. As in a
+   directory walk, names starting with a dot are left out. */
+void print_archive(std::ostream& output, std::istream& archive, uint32_t uid, uint32_t gid,
+                   PathFilter const* filter = nullptr);
+
+/* orders paths of the file list the way the walk lists them: depth first, the entries of each
+   directory sorted by name, so the entries below a directory follow it without a gap */
+struct WalkOrder {
+    bool operator()(std::string const& a, std::string const& b) const;
+};
+
+/* The file list of a directory kept in memory between walks, for mkbom --watch. Walking a path
+   again only reads the files whose device, inode number, size or times changed since they were
+   last checksummed; the others keep their checksum. */
+class ResidentTree {
+    public:
+        struct Entry {
+            Node node;
+        };
+        typedef std::map<std::string, Entry, WalkOrder> entries_t;
+
+    private:
+        std::string                            base;
+        uint32_t                               uid;
+        uint32_t                               gid;
+        PathFilter const*                      filter;
+        entries_t                              entries_;
+        std::unique_ptr<ChecksumCache>         checksums; // by the identity of every file walked
+
+        ResidentTree(ResidentTree const&);
+        ResidentTree& operator=(ResidentTree const&);
+
+    public:
+        /* throws if directory is not one; the tree stays empty until the first update(".") */
+        ResidentTree(std::string directory, uint32_t uid, uint32_t gid, PathFilter const* filter = nullptr);
+        ~ResidentTree();
+
+        /* Walks path, "." or "./...", and the entries below it again, or removes them if path no
+           longer exists. Paths whose parent is not in the tree, e.g. below an excluded directory,
+           are ignored. Returns whether the file list changed. */
+        bool update(std::string const& path);
+
+        /* the directories of the tree at or below path */
+        void directories(std::string const& path, std::vector<std::string>& result) const;
+
+        entries_t const& entries() const { return entries_; }
+};
@@ -0,0 +1,99 @@
+/*
+  stats.cpp - phase timings and counters reported by the --stats option
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <fstream>
+#include <iomanip>
+#if !defined(WINDOWS)
+#include <sys/resource.h>
+#endif
+
+#include "stats.hpp"
+
+bool                  stats_enabled = false;
+std::atomic<uint64_t> stats_phase_ns[kNumPhases];
+std::atomic<uint64_t> stats_counters[kNumCounters];
+
+static const char* phase_names[kNumPhases] = { "walk", "checksum", "parse", "tree", "emit", "write" };
+
+static const char* counter_names[kNumCounters] = { "files",        "dirs",   "links",
+                                                   "bytes_hashed", "blocks", "reallocs",
+                                                   "excluded" };
+
+uint64_t stats_peak_rss_kb() {
+#if defined(WINDOWS)
+    return 0;
+#else
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; /* bytes on Mac OS X */
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void stats_report(std::ostream& output, const char* tool) {
+    output << tool << " statistics:" << std::endl;
+    for (unsigned int i = 0; i < kNumPhases; ++i) {
+        output << "  " << std::left << std::setw(14) << phase_names[i] << std::right << std::fixed
+               << std::setprecision(6) << (stats_phase_ns[i].load() / 1e9) << " s" << std::endl;
+    }
+    for (unsigned int i = 0; i < kNumCounters; ++i) {
+        output << "  " << std::left << std::setw(14) << counter_names[i] << std::right
+               << stats_counters[i].load() << std::endl;
+    }
+    output << "  " << std::left << std::setw(14) << "peak_rss" << std::right << stats_peak_rss_kb()
+           << " KB" << std::endl;
+}
+
+bool stats_write_json(const char* path, const char* tool) {
+    std::ofstream output(path, std::ios::out | std::ios::trunc);
+    if (output.fail()) {
+        return false;
+    }
+    output << "{\"tool\":\"" << tool << "\",\"phases_s\":{";
+    for (unsigned int i = 0; i < kNumPhases; ++i) {
+        output << (i ? "," : "") << "\"" << phase_names[i] << "\":" << std::fixed << std::setprecision(9)
+               << (stats_phase_ns[i].load() / 1e9);
+    }
+    output << "},\"counters\":{";
+    for (unsigned int i = 0; i < kNumCounters; ++i) {
+        output << (i ? "," : "") << "\"" << counter_names[i] << "\":" << stats_counters[i].load();
+    }
+    output << "},\"peak_rss_kb\":" << stats_peak_rss_kb() << "}" << std::endl;
+    return output.good();
+}
+
+bool stats_output(std::string const& path, const char* tool) {
+    if (path.empty()) {
+        stats_report(std::cerr, tool);
+        return true;
+    }
+    if (stats_write_json(path.c_str(), tool) == false) {
+        std::cerr << std::endl << "Unable to write statistics to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+/*
+  stats.hpp - phase timings and counters reported by the --stats option
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+typedef enum {
+    kPhaseWalk,     // directory walk, includes the checksum phase
+    kPhaseChecksum, // calc_crc32 and calc_str_crc32
+    kPhaseParse,    // parsing the file list
+    kPhaseTree,     // arranging the entries in a tree
+    kPhaseEmit,     // creating the bom blocks
+    kPhaseWrite,    // writing the bom file
+    kNumPhases } stats_phase_t;
+
+typedef enum {
+    kCounterFiles, // entries written to the Paths tree of a bom, summed over every bom written
+    kCounterDirs,
+    kCounterLinks,
+    kCounterBytesHashed,
+    kCounterBlocks,
+    kCounterReallocs,
+    kCounterExcluded, // entries skipped by the exclusion rules of the walk
+    kNumCounters } stats_counter_t;
+
+/* Everything below is a no-op unless stats_enabled is set, so the instrumentation can stay in
+   the hot paths. The values are atomic because the tools may collect them from several threads. */
+extern bool                  stats_enabled;
+extern std::atomic<uint64_t> stats_phase_ns[kNumPhases];
+extern std::atomic<uint64_t> stats_counters[kNumCounters];
+
+inline void stats_count(stats_counter_t counter, uint64_t n = 1) {
+    if (stats_enabled) {
+        stats_counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+inline void stats_set(stats_counter_t counter, uint64_t value) {
+    if (stats_enabled) {
+        stats_counters[counter].store(value, std::memory_order_relaxed);
+    }
+}
+
+/* adds the time between construction and destruction to a phase */
+class StatsPhase {
+    private:
+        stats_phase_t                         phase;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit StatsPhase(stats_phase_t p)
+            : phase(p) {
+            if (stats_enabled) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~StatsPhase() {
+            if (stats_enabled) {
+                std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - start;
+                stats_phase_ns[phase].fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(),
+                    std::memory_order_relaxed);
+            }
+        }
+};
+
+/* peak resident set size of this process in kilobytes, 0 if unknown */
+uint64_t stats_peak_rss_kb();
+
+/* prints a human readable summary */
+void stats_report(std::ostream& output, const char* tool);
+
+/* writes the statistics as a JSON object, returns false if the file cannot be written */
+bool stats_write_json(const char* path, const char* tool);
+
+/* reports the statistics of a --stats[=file] option: as JSON to path, or to stderr if path is empty */
+bool stats_output(std::string const& path, const char* tool);
@@ -0,0 +1,165 @@
+/*
+  streampipe.hpp - a file list passed from a producing to a consuming thread
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include "boundedqueue.hpp"
+#include "trace.hpp"
+
+/* the size of the chunks a StreamPipe passes on, and how many of them it holds at most */
+#define STREAM_PIPE_CHUNK_SIZE (256 * 1024)
+#define STREAM_PIPE_DEPTH      16
+
+/* A stream written on one thread and read on another, holding at most STREAM_PIPE_DEPTH chunks,
+   so a file list can be consumed while it is generated instead of being buffered as a whole. */
+class StreamPipe {
+    private:
+        class OutputBuffer : public std::streambuf {
+            private:
+                StreamPipe& pipe;
+                std::string chunk;
+
+                void reset() {
+                    chunk.resize(STREAM_PIPE_CHUNK_SIZE);
+                    setp(&chunk[0], &chunk[0] + chunk.size());
+                }
+
+            public:
+                explicit OutputBuffer(StreamPipe& p)
+                    : pipe(p) {
+                    reset();
+                }
+
+                /* hands the written bytes to the reader, they are dropped once the reader is gone */
+                void pass() {
+                    std::size_t n = pptr() - pbase();
+                    if (n && (pipe.cancelled == false)) {
+                        chunk.resize(n);
+                        pipe.chunks.push(std::move(chunk));
+                        chunk = std::string();
+                    }
+                    reset();
+                }
+
+            protected:
+                int_type overflow(int_type c) {
+                    pass();
+                    if (traits_type::eq_int_type(c, traits_type::eof()) == false) {
+                        *pptr() = traits_type::to_char_type(c);
+                        pbump(1);
+                    }
+                    return traits_type::not_eof(c);
+                }
+
+                int sync() {
+                    pass();
+                    return 0;
+                }
+        };
+
+        class InputBuffer : public std::streambuf {
+            private:
+                StreamPipe& pipe;
+                std::string chunk;
+
+            public:
+                explicit InputBuffer(StreamPipe& p)
+                    : pipe(p) {}
+
+            protected:
+                /* the error of the writer is thrown to the reader instead of a premature end of file */
+                int_type underflow() {
+                    while (gptr() == egptr()) {
+                        if (pipe.chunks.pop(chunk) == false) {
+                            if (pipe.error) {
+                                std::rethrow_exception(pipe.error);
+                            }
+                            return traits_type::eof();
+                        }
+                        setg(&chunk[0], &chunk[0], &chunk[0] + chunk.size());
+                    }
+                    return traits_type::to_int_type(*gptr());
+                }
+        };
+
+        BoundedQueue<std::string> chunks;
+        std::exception_ptr        error;     // of the writer, set before chunks is closed
+        std::atomic<bool>         cancelled; // the reader stopped early
+        OutputBuffer              outputBuffer;
+        InputBuffer               inputBuffer;
+
+        StreamPipe(StreamPipe const&);
+        StreamPipe& operator=(StreamPipe const&);
+
+    public:
+        StreamPipe()
+            : chunks(STREAM_PIPE_DEPTH)
+            , cancelled(false)
+            , outputBuffer(*this)
+            , inputBuffer(*this) {}
+
+        /* Runs produce(std::ostream&) on a new thread and consume(std::istream&) on the calling
+           one. Reads of consume throw the exception of produce, the input stream has badbit set
+           in its exceptions() for that. Afterwards the exception of produce, or else that of
+           consume, is thrown. If consume fails, the rest of the output of produce is dropped. */
+        template <typename Producer, typename Consumer>
+        static void run(Producer produce, Consumer consume) {
+            StreamPipe  pipe;
+            std::thread producer([&pipe, &produce]() {
+                trace_thread_name("stream producer");
+                std::ostream output(&pipe.outputBuffer);
+                try {
+                    produce(output);
+                    output.flush();
+                } catch (...) {
+                    pipe.error = std::current_exception();
+                }
+                pipe.outputBuffer.pass();
+                pipe.chunks.close();
+            });
+            std::exception_ptr consume_error;
+            try {
+                std::istream input(&pipe.inputBuffer);
+                input.exceptions(std::ios::badbit);
+                consume(input);
+            } catch (...) {
+                consume_error = std::current_exception();
+            }
+            pipe.cancelled = true;
+            for (std::string chunk; pipe.chunks.pop(chunk);) {}
+            producer.join();
+            if (pipe.error) {
+                std::rethrow_exception(pipe.error);
+            }
+            if (consume_error) {
+                std::rethrow_exception(consume_error);
+            }
+        }
+};
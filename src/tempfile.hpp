@@ -0,0 +1,77 @@
+/*
+  tempfile.hpp - uniquely named temporary files that are removed again
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#if defined(WINDOWS)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/* Creates an empty file with a unique name in dir and removes it when destroyed */
+class TempFile {
+    private:
+        std::string file_path;
+
+        TempFile(TempFile const&);
+        TempFile& operator=(TempFile const&);
+
+    public:
+        TempFile(std::string const& dir, const char* prefix) {
+            std::string       pattern = dir + "/" + prefix + "-XXXXXX";
+            std::vector<char> name(pattern.begin(), pattern.end());
+            name.push_back('\0');
+#if defined(WINDOWS)
+            if (::_mktemp_s(name.data(), name.size()) != 0) {
+                throw std::runtime_error("unable to create a temporary file in " + dir);
+            }
+            std::FILE* f = std::fopen(name.data(), "wb");
+            if (f == nullptr) {
+                throw std::runtime_error("unable to create a temporary file in " + dir);
+            }
+            std::fclose(f);
+#else
+            int fd = ::mkstemp(name.data());
+            if (fd < 0) {
+                throw std::runtime_error("unable to create a temporary file in " + dir);
+            }
+            ::close(fd);
+#endif
+            file_path = name.data();
+        }
+
+        ~TempFile() { std::remove(file_path.c_str()); }
+
+        std::string const& path() const { return file_path; }
+};
+
+/* the directory for temporary files: $TMPDIR if set, /tmp otherwise */
+inline std::string default_temp_dir() {
+    const char* dir = std::getenv("TMPDIR");
+    return (dir && *dir) ? std::string(dir) : std::string("/tmp");
+}
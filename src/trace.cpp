@@ -0,0 +1,139 @@
+/*
+  trace.cpp - per-call spans written as a Chrome trace by the --trace option
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <vector>
+#if !defined(WINDOWS)
+#include <unistd.h>
+#endif
+
+#include "trace.hpp"
+
+bool trace_enabled = false;
+
+struct TraceEvent {
+    const char* name;
+    std::string path;
+    int64_t     size;
+    int64_t     count;
+    int64_t     begin_ns;
+    int64_t     duration_ns;
+};
+
+struct TraceThread {
+    unsigned int            id;
+    std::string             name;
+    std::vector<TraceEvent> events;
+};
+
+static std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+static std::mutex                            trace_mutex;
+/* a list so that the buffers stay where they are when threads register */
+static std::list<TraceThread> trace_threads;
+
+static TraceThread& current_thread() {
+    static thread_local TraceThread* thread = nullptr;
+    if (thread == nullptr) {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        trace_threads.push_back(TraceThread());
+        thread     = &trace_threads.back();
+        thread->id = trace_threads.size();
+    }
+    return *thread;
+}
+
+TraceSpan::~TraceSpan() {
+    if (trace_enabled) {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        TraceEvent                            e;
+        e.name        = name;
+        e.path        = path;
+        e.size        = size;
+        e.count       = count;
+        e.begin_ns    = std::chrono::duration_cast<std::chrono::nanoseconds>(start - trace_start).count();
+        e.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        current_thread().events.push_back(e);
+    }
+}
+
+void trace_thread_name(const char* name) {
+    if (trace_enabled) {
+        current_thread().name = name;
+    }
+}
+
+static void write_json_string(std::ostream& output, std::string const& s) {
+    output << '"';
+    for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+        unsigned char c = *it;
+        if ((c == '"') || (c == '\\')) {
+            output << '\\' << c;
+        } else if (c < 0x20) {
+            output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (unsigned int)c
+                   << std::dec << std::setfill(' ');
+        } else {
+            output << c;
+        }
+    }
+    output << '"';
+}
+
+bool trace_write(std::string const& path) {
+    std::ofstream output(path.c_str(), std::ios::out | std::ios::trunc);
+    if (output.fail()) {
+        return false;
+    }
+#if defined(WINDOWS)
+    unsigned int pid = 1;
+#else
+    unsigned int pid = ::getpid();
+#endif
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    bool                        first = true;
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (std::list<TraceThread>::const_iterator it = trace_threads.begin(); it != trace_threads.end(); ++it) {
+        output << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+               << ",\"tid\":" << it->id << ",\"args\":{\"name\":";
+        write_json_string(output, it->name.empty() ? "worker" : it->name);
+        output << "}}";
+        first = false;
+        for (std::vector<TraceEvent>::const_iterator jt = it->events.begin(); jt != it->events.end(); ++jt) {
+            /* timestamps and durations are in microseconds */
+            output << ",\n{\"name\":\"" << jt->name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << it->id
+                   << std::fixed << std::setprecision(3) << ",\"ts\":" << (jt->begin_ns / 1e3)
+                   << ",\"dur\":" << (jt->duration_ns / 1e3) << ",\"args\":{\"path\":";
+            write_json_string(output, jt->path);
+            if (jt->size >= 0) {
+                output << ",\"size\":" << jt->size;
+            }
+            if (jt->count >= 0) {
+                output << ",\"entries\":" << jt->count;
+            }
+            output << "}}";
+        }
+    }
+    output << "\n]}" << std::endl;
+    return output.good();
+}
@@ -0,0 +1,68 @@
+/*
+  trace.hpp - per-call spans written as a Chrome trace by the --trace option
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+/* Spans are only recorded if trace_enabled is set, a disabled TraceSpan costs one branch. Every
+   thread records into its own buffer and shows up as its own track in the trace viewer. */
+extern bool trace_enabled;
+
+/* records one complete event with the name of the call and the path it worked on */
+class TraceSpan {
+    private:
+        const char*                           name;
+        std::string const&                    path;
+        int64_t                               size;
+        int64_t                               count;
+        std::chrono::steady_clock::time_point start;
+
+        TraceSpan(TraceSpan const&);
+        TraceSpan& operator=(TraceSpan const&);
+
+    public:
+        TraceSpan(const char* span_name, std::string const& span_path)
+            : name(span_name)
+            , path(span_path)
+            , size(-1)
+            , count(-1) {
+            if (trace_enabled) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~TraceSpan();
+
+        /* attached to the event as the size and entries arguments */
+        void setSize(int64_t s) { size = s; }
+        void setCount(int64_t c) { count = c; }
+};
+
+/* names the track of the calling thread; the tools call it on their main thread and every thread
+   they start calls it first, so the tracks tell the stages apart */
+void trace_thread_name(const char* name);
+
+/* writes all recorded spans in the trace event format, returns false if the file cannot be written */
+bool trace_write(std::string const& path);
@@ -0,0 +1,283 @@
+/*
+  watch.cpp - rewriting the bom of a directory whenever the directory changes
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(__linux__)
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#endif
+
+#include "watch.hpp"
+#include "bomutils.hpp"
+#include "printnode.hpp"
+
+#if defined(__linux__)
+/* the events that can change the file list; IN_MODIFY repeats while a file is written, the
+   debounce time folds them into one update */
+#define WATCH_EVENTS        (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | \
+                             IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_DONT_FOLLOW | IN_ONLYDIR)
+#define INOTIFY_BUFFER_SIZE (64 * 1024)
+
+typedef std::set<std::string, WalkOrder> path_set_t;
+
+/* whether path is below or equal to top, both "." or "./..." */
+static bool in_subtree(std::string const& path, std::string const& top) {
+    if (top == ".") {
+        return true;
+    }
+    return (path.compare(0, top.size(), top) == 0) && ((path.size() == top.size()) || (path[top.size()] == '/'));
+}
+
+/* one inotify watch for every directory of a ResidentTree */
+class TreeWatcher {
+    private:
+        int                                   fd;
+        std::string                           base;
+        std::unordered_map<int, std::string>  paths;   // path by watch descriptor
+        std::map<std::string, int, WalkOrder> watches; // watch descriptor by path
+        std::vector<char>                     buffer;
+
+        TreeWatcher(TreeWatcher const&);
+        TreeWatcher& operator=(TreeWatcher const&);
+
+    public:
+        explicit TreeWatcher(std::string const& b)
+            : fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+            , base(b)
+            , buffer(INOTIFY_BUFFER_SIZE) {
+            if (fd < 0) {
+                throw std::runtime_error(std::string("Unable to watch the directory: ") + std::strerror(errno));
+            }
+            while ((base.size() > 1) && (base[base.size() - 1] == '/')) {
+                base.erase(base.size() - 1);
+            }
+        }
+
+        ~TreeWatcher() { ::close(fd); }
+
+        int descriptor() const { return fd; }
+
+        /* watches the directories of tree at or below path */
+        void add(ResidentTree const& tree, std::string const& path) {
+            std::vector<std::string> directories;
+            tree.directories(path, directories);
+            for (std::size_t i = 0; i < directories.size(); ++i) {
+                std::string system_path = (directories[i] == ".") ? base : base + "/" + directories[i].substr(2);
+                int         wd          = ::inotify_add_watch(fd, system_path.c_str(), WATCH_EVENTS);
+                if (wd < 0) {
+                    if ((errno == ENOENT) || (errno == ENOTDIR)) {
+                        continue; // already gone again, its parent reports that
+                    }
+                    if (errno == ENOSPC) {
+                        throw std::runtime_error("Unable to watch " + system_path +
+                                                 ", raise fs.inotify.max_user_watches");
+                    }
+                    throw std::runtime_error("Unable to watch " + system_path + ": " + std::strerror(errno));
+                }
+                paths[wd]               = directories[i];
+                watches[directories[i]] = wd;
+            }
+        }
+
+        /* stops watching the directories at or below path */
+        void remove(std::string const& path) {
+            std::map<std::string, int, WalkOrder>::iterator first = watches.lower_bound(path);
+            std::map<std::string, int, WalkOrder>::iterator last  = first;
+            for (; (last != watches.end()) && in_subtree(last->first, path); ++last) {
+                ::inotify_rm_watch(fd, last->second);
+                paths.erase(last->second);
+            }
+            watches.erase(first, last);
+        }
+
+        /* adds the paths the pending events are about to changed */
+        void read(path_set_t& changed) {
+            while (true) {
+                ssize_t n = ::read(fd, buffer.data(), buffer.size());
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN) {
+                        return;
+                    }
+                    throw std::runtime_error(std::string("Unable to read changes: ") + std::strerror(errno));
+                }
+                for (ssize_t pos = 0; pos < n;) {
+                    struct inotify_event const* ev = (struct inotify_event const*)&buffer[pos];
+                    pos += sizeof(struct inotify_event) + ev->len;
+                    if (ev->mask & IN_Q_OVERFLOW) {
+                        /* events were lost, walk everything */
+                        changed.insert(".");
+                        continue;
+                    }
+                    std::unordered_map<int, std::string>::const_iterator it = paths.find(ev->wd);
+                    if ((ev->mask & IN_IGNORED) || (it == paths.end())) {
+                        continue;
+                    }
+                    if (ev->len > 0) {
+                        changed.insert(it->second + "/" + ev->name);
+                    } else if (it->second == ".") {
+                        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                            throw std::runtime_error("The watched directory was removed or moved: " + base);
+                        }
+                        changed.insert(".");
+                    }
+                    /* other directories report changes of their own through their parent */
+                }
+            }
+        }
+};
+
+/* replaces output_path with the bom of the tree, BomWriter renames it into place so readers
+   never see a half written file */
+static void write_resident(ResidentTree const& tree, std::string const& output_path, BOMLayout const& layout) {
+    BomWriter writer(layout);
+    for (ResidentTree::entries_t::const_iterator it = tree.entries().begin(); it != tree.entries().end(); ++it) {
+        writer.add(it->first, it->second.node);
+    }
+    writer.write(output_path);
+}
+
+/* walks the changed paths again and returns whether the file list changed; paths whose walk
+   failed are left in changed for the next update */
+static bool update_tree(ResidentTree& tree, TreeWatcher& watcher, path_set_t& changed) {
+    /* a path below another changed path is walked along with it */
+    std::vector<std::string> tops;
+    for (path_set_t::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+        if (tops.empty() || (in_subtree(*it, tops.back()) == false)) {
+            tops.push_back(*it);
+        }
+    }
+    /* all watches go first: a directory moved within the tree keeps its watch descriptor */
+    for (std::size_t i = 0; i < tops.size(); ++i) {
+        watcher.remove(tops[i]);
+    }
+    bool modified = false;
+    changed.clear();
+    for (std::size_t i = 0; i < tops.size(); ++i) {
+        try {
+            modified |= tree.update(tops[i]);
+            watcher.add(tree, tops[i]);
+        } catch (std::exception const& e) {
+            std::cerr << std::endl << e.what() << std::endl;
+            changed.insert(tops[i]);
+        }
+    }
+    return modified;
+}
+
+void watch_directory(std::string const& directory, std::string const& output_path, uint32_t uid, uint32_t gid,
+                     PathFilter const* filter, BOMLayout const& layout, unsigned int debounce_ms) {
+    ResidentTree tree(directory, uid, gid, filter);
+    TreeWatcher  watcher(directory);
+
+    /* SIGINT and SIGTERM end the loop, so the caller can report statistics and clean up */
+    sigset_t signals;
+    sigset_t previous_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+    int signal_fd = ::signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        ::pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+        throw std::runtime_error(std::string("Unable to watch the directory: ") + std::strerror(errno));
+    }
+
+    try {
+        tree.update(".");
+        watcher.add(tree, ".");
+        write_resident(tree, output_path, layout);
+        std::cout << output_path << ": " << tree.entries().size() << " entries" << std::endl;
+
+        path_set_t changed;
+        bool       pending   = false; // changes reported since the last update
+        bool       unwritten = false; // the file list changed since the bom was written
+        while (true) {
+            struct pollfd fds[2] = { { watcher.descriptor(), POLLIN, 0 }, { signal_fd, POLLIN, 0 } };
+            int           ret    = ::poll(fds, 2, pending ? (int)debounce_ms : -1);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Unable to wait for changes: ") + std::strerror(errno));
+            }
+            if (fds[1].revents) {
+                /* consume the signal, it would be delivered once it is unblocked again otherwise */
+                struct signalfd_siginfo info;
+                if (::read(signal_fd, &info, sizeof(info)) < 0) {
+                    std::cerr << std::endl << "Unable to read signal: " << std::strerror(errno) << std::endl;
+                }
+                break;
+            }
+            if (ret > 0) {
+                watcher.read(changed);
+                pending = (changed.empty() == false);
+                continue;
+            }
+
+            /* quiet for debounce_ms */
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            pending                                     = false;
+            unwritten |= update_tree(tree, watcher, changed);
+            if (unwritten) {
+                try {
+                    write_resident(tree, output_path, layout);
+                } catch (std::exception const& e) {
+                    std::cerr << std::endl << e.what() << std::endl;
+                    /* try again once the delay has passed, even if nothing else changes */
+                    pending = true;
+                    continue;
+                }
+                unwritten = false;
+                std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - start;
+                std::cout << output_path << ": " << tree.entries().size() << " entries, updated in "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(d).count() << " ms" << std::endl;
+            }
+        }
+    } catch (...) {
+        ::close(signal_fd);
+        ::pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+        throw;
+    }
+    ::close(signal_fd);
+    ::pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+}
+#else
+void watch_directory(std::string const&, std::string const&, uint32_t, uint32_t, PathFilter const*, BOMLayout const&,
+                     unsigned int) {
+    throw std::runtime_error("The --watch option needs inotify, which is only available on Linux");
+}
+#endif
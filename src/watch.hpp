@@ -0,0 +1,42 @@
+/*
+  watch.hpp - rewriting the bom of a directory whenever the directory changes
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "writebom.hpp"
+
+class PathFilter;
+
+/* the quiet time mkbom --watch waits for after a change before it writes the bom */
+#define WATCH_DEFAULT_DEBOUNCE_MS 50
+
+/* Writes the bom of directory to output_path like mkbom does, then keeps the file list in memory
+   and watches the tree with inotify. Once no change has been reported for debounce_ms, the
+   changed paths are walked again, only changed files are read, and the bom is replaced unless
+   its contents stay the same. Returns when the process receives SIGINT or SIGTERM. Errors of
+   the first build are thrown; later ones are reported on stderr and the affected paths are
+   walked again with the next change. Throws std::runtime_error on systems without inotify. */
+void watch_directory(std::string const& directory, std::string const& output_path, uint32_t uid, uint32_t gid,
+                     PathFilter const* filter, BOMLayout const& layout, unsigned int debounce_ms);
@@ -0,0 +1,341 @@
+/*
+  writebom.cpp - build a bom file from a file list in the format generated by ls4mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+
+#include "bom.h"
+#include "binmanifest.hpp"
+#include "boundedqueue.hpp"
+#include "bomstorage.hpp"
+#include "pathstree.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "writebom.hpp"
+
+using stringvec_t = std::vector<std::string>;
+
+using line_batch_t = std::vector<std::string>;
+using node_batch_t = std::vector<std::pair<std::string, Node>>;
+
+/* lines are handed between the pipeline stages of read_tree in batches of this size,
+   at most QUEUE_DEPTH batches wait between two stages */
+#define BATCH_SIZE  1024
+#define QUEUE_DEPTH 16
+
+uint32_t dec_octal_to_int(uint32_t dec_rep_octal) {
+    uint32_t retval = 0;
+    for (unsigned int n = 1; dec_rep_octal; n *= 8) {
+        unsigned int digit = dec_rep_octal - ((dec_rep_octal / 10) * 10);
+        if (digit > 7) {
+            throw std::runtime_error("argument not in dec oct rep");
+        }
+        retval += digit * n;
+        dec_rep_octal /= 10;
+    }
+    return retval;
+}
+
+void validate_layout(BOMLayout const& layout) {
+    if ((layout.blockSize < BOM_MIN_BLOCK_SIZE) || (layout.blockSize > BOM_MAX_BLOCK_SIZE) ||
+        ((layout.blockSize & (layout.blockSize - 1)) != 0)) {
+        std::stringstream ss;
+        ss << "block size must be a power of two between " << BOM_MIN_BLOCK_SIZE << " and "
+           << BOM_MAX_BLOCK_SIZE;
+        throw std::runtime_error(ss.str());
+    }
+    if ((layout.pathsPerLeaf < 1) || (layout.pathsPerLeaf > BOM_MAX_PATHS_PER_LEAF)) {
+        std::stringstream ss;
+        ss << "number of paths per leaf must be between 1 and " << BOM_MAX_PATHS_PER_LEAF;
+        throw std::runtime_error(ss.str());
+    }
+    uint64_t leaf_size = (sizeof(uint16_t) * 2) + (sizeof(uint32_t) * 2) +
+                         (static_cast<uint64_t>(layout.pathsPerLeaf) * sizeof(BOMPathIndices));
+    if (leaf_size > layout.blockSize) {
+        std::stringstream ss;
+        ss << layout.pathsPerLeaf << " paths per leaf need " << leaf_size
+           << " bytes which does not fit into a block size of " << layout.blockSize;
+        throw std::runtime_error(ss.str());
+    }
+}
+
+void parse_node(std::string const& line, std::string& name, Node& n) {
+    stringvec_t elements;
+    {
+        std::stringstream ss(line);
+        std::getline(ss, name, '\t');
+        if (ss.good() == false) {
+            throw std::runtime_error("Syntax error in lsbom input");
+        }
+        {
+            std::string rest;
+            std::getline(ss, rest);
+            std::size_t it = rest.find("/");
+            if (it != std::string::npos) {
+                rest[it] = ' ';
+            }
+            std::stringstream item_stream(rest);
+            std::copy(std::istream_iterator<std::string>(item_stream),
+                      std::istream_iterator<std::string>(),
+                      std::back_inserter(elements));
+        }
+    }
+    /* the mode, uid and gid are needed to tell the type of the entry and what else it needs */
+    if (elements.size() < 3) {
+        throw std::runtime_error("Missing fields in lsbom input: " + line);
+    }
+    n.mode           = dec_octal_to_int(std::atol(elements[0].c_str()));
+    n.uid            = std::atol(elements[1].c_str());
+    n.gid            = std::atol(elements[2].c_str());
+    n.size           = 0;
+    n.checksum       = 0;
+    n.linkNameLength = 0;
+    if ((n.mode & 0xF000) == 0x4000) {
+        n.type = kDirectoryNode;
+    } else if ((n.mode & 0xF000) == 0x8000) {
+        if (elements.size() < 5) {
+            throw std::runtime_error("Missing size or checksum in lsbom input: " + line);
+        }
+        n.type     = kFileNode;
+        n.size     = std::atol(elements[3].c_str());
+        n.checksum = std::atol(elements[4].c_str());
+    } else if ((n.mode & 0xF000) == 0xA000) {
+        if (elements.size() < 6) {
+            throw std::runtime_error("Missing size, checksum or link name in lsbom input: " + line);
+        }
+        n.type           = kSymbolicLinkNode;
+        n.size           = std::atol(elements[3].c_str());
+        n.checksum       = std::atol(elements[4].c_str());
+        n.linkNameLength = elements[5].size() + 1;
+        n.linkName       = elements[5];
+    } else {
+        throw std::runtime_error("Node type not supported");
+    }
+}
+
+TreeBuilder::TreeBuilder(NodeTree& t)
+    : tree(t) {}
+
+bool TreeBuilder::addNow(std::string const& name, Node const& n) {
+    std::unordered_map<std::string, uint32_t>::const_iterator it = directories.find(name);
+    if (it != directories.end()) {
+        /* a later line for the same directory replaces the earlier one */
+        tree.set(it->second, n);
+        return true;
+    }
+    std::size_t slash  = name.rfind('/');
+    uint32_t    parent = NodeTree::kRoot;
+    if (slash != std::string::npos) {
+        if ((it = directories.find(name.substr(0, slash))) == directories.end()) {
+            return false;
+        }
+        parent = it->second;
+    }
+    std::size_t begin = (slash == std::string::npos) ? 0 : slash + 1;
+    if (begin == name.size()) {
+        return false;
+    }
+    uint32_t i = tree.add(parent, name.data() + begin, name.size() - begin, n);
+    if (n.type == kDirectoryNode) {
+        directories[name] = i;
+    }
+    return true;
+}
+
+void TreeBuilder::add(std::string&& name, Node&& n) {
+    /* once an entry shows up before its parent, the remaining entries are kept
+       until the end, sorted by path and added then */
+    if (pending.empty() && addNow(name, n)) {
+        return;
+    }
+    pending.emplace_back(std::move(name), std::move(n));
+}
+
+void TreeBuilder::finish() {
+    if (pending.empty()) {
+        return;
+    }
+    StatsPhase phase(kPhaseTree);
+    /* a path sorts after its parent; stable, so that the last of several equal lines wins */
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](node_batch_t::value_type const& a, node_batch_t::value_type const& b) {
+                         return a.first < b.first;
+                     });
+    for (node_batch_t::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+        if (addNow(it->first, it->second) == false) {
+            throw std::runtime_error("Parent directory of file/folder \"" + it->first + "\" does not appear in list");
+        }
+    }
+    pending.clear();
+}
+
+void read_file_list(std::istream& lsbom_file, TreeBuilder& builder) {
+    /* reading, parsing and adding the lines run as a pipeline on three threads */
+    StatsPhase                 phase(kPhaseParse);
+    BoundedQueue<line_batch_t> lines(QUEUE_DEPTH);
+    BoundedQueue<node_batch_t> nodes(QUEUE_DEPTH);
+    /* the stream may throw, e.g. the input of a StreamPipe whose writer failed */
+    std::exception_ptr read_error;
+    std::thread reader([&lsbom_file, &lines, &read_error]() {
+        trace_thread_name("file list reader");
+        line_batch_t batch;
+        std::string  line;
+        try {
+            while (std::getline(lsbom_file, line)) {
+                batch.push_back(std::move(line));
+                if (batch.size() == BATCH_SIZE) {
+                    lines.push(std::move(batch));
+                    batch = line_batch_t();
+                }
+            }
+        } catch (...) {
+            read_error = std::current_exception();
+        }
+        if (batch.size()) {
+            lines.push(std::move(batch));
+        }
+        lines.close();
+    });
+    /* after an error the later stages keep draining their queue, so that no thread blocks
+       on a full queue, and the first error is thrown once the threads are joined */
+    std::exception_ptr parse_error;
+    std::thread parser([&lines, &nodes, &parse_error]() {
+        trace_thread_name("file list parser");
+        line_batch_t batch;
+        while (lines.pop(batch)) {
+            if (parse_error) {
+                continue;
+            }
+            try {
+                node_batch_t parsed(batch.size());
+                for (std::size_t i = 0; i < batch.size(); ++i) {
+                    parse_node(batch[i], parsed[i].first, parsed[i].second);
+                }
+                nodes.push(std::move(parsed));
+            } catch (...) {
+                parse_error = std::current_exception();
+            }
+        }
+        nodes.close();
+    });
+    std::exception_ptr add_error;
+    node_batch_t       batch;
+    while (nodes.pop(batch)) {
+        if (add_error) {
+            continue;
+        }
+        try {
+            for (node_batch_t::iterator it = batch.begin(); it != batch.end(); ++it) {
+                builder.add(std::move(it->first), std::move(it->second));
+            }
+        } catch (...) {
+            add_error = std::current_exception();
+        }
+    }
+    reader.join();
+    parser.join();
+    if (read_error) {
+        std::rethrow_exception(read_error);
+    }
+    if (parse_error) {
+        std::rethrow_exception(parse_error);
+    }
+    if (add_error) {
+        std::rethrow_exception(add_error);
+    }
+}
+
+void read_binary_file_list(const char* buffer, std::size_t length, NodeTree& tree) {
+    StatsPhase           phase(kPhaseParse);
+    BinaryManifestReader reader;
+    try {
+        reader.open(buffer, length);
+        read_binary_tree(reader, tree);
+    } catch (std::exception const& e) {
+        throw std::runtime_error(std::string("Invalid binary file list: ") + e.what());
+    }
+}
+
+unsigned int read_tree(std::istream& lsbom_file, NodeTree& tree) {
+    if (lsbom_file.peek() == (unsigned char)BOM_MANIFEST_MAGIC[0]) {
+        /* a stream has to be copied, BomWriter::addFileList maps a file list given by its path */
+        std::vector<char> buffer((std::istreambuf_iterator<char>(lsbom_file)), std::istreambuf_iterator<char>());
+        read_binary_file_list(buffer.data(), buffer.size(), tree);
+    } else {
+        TreeBuilder builder(tree);
+        read_file_list(lsbom_file, builder);
+        builder.finish();
+    }
+    StatsPhase phase(kPhaseTree);
+    tree.finish();
+    return tree.size();
+}
+
+void add_tree(BOMStorage& bom, NodeTree const& nodes, BOMLayout const& layout) {
+    StatsPhase         phase(kPhaseEmit);
+    unsigned int const num = nodes.size();
+    add_bom_info(bom, num);
+    
+    PathsTreeWriter<BOMStorage> paths(bom, layout);
+    for (unsigned int j = 0; j < num; ++j) {
+        uint32_t parent = (nodes.parent(j) == NodeTree::kRoot) ? 0 : nodes.parent(j) + 1;
+        paths.add(parent, nodes.name(j), nodes.type(j), nodes.mode(j), nodes.uid(j), nodes.gid(j),
+                  nodes.fileSize(j), nodes.checksum(j), nodes.linkName(j));
+    }
+    paths.finish();
+    if (layout.clustered) {
+        /* the Paths variable was added last, so it stays behind the reordered blocks */
+        bom.reorderBlocks(paths.clusterOrder());
+    }
+    
+    add_index_trees(bom, layout);
+}
+
+void write_bom(std::istream& lsbom_file, std::string const& output_path, BOMLayout const& layout) {
+    validate_layout(layout);
+    NodeTree tree;
+    read_tree(lsbom_file, tree);
+    
+    BOMStorage bom;
+    add_tree(bom, tree, layout);
+    
+    StatsPhase    phase(kPhaseWrite);
+    std::ofstream o_file(output_path.c_str(), std::ios::binary | std::ios::out);
+    if (o_file.fail()) {
+        throw std::runtime_error("Unable to open output file: " + output_path);
+    }
+    bom.write(o_file);
+}
+
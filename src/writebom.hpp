@@ -0,0 +1,102 @@
+/*
+  writebom.hpp - build a bom file from a file list in the format generated by ls4mkbom
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+#include "nodetree.hpp"
+
+/* Limits imposed by the on-disk format: BOMPaths->count is 16 bits wide and every
+   leaf (a 12 byte BOMPaths header plus 8 bytes per entry) must fit into one tree block */
+#define BOM_MAX_PATHS_PER_LEAF 65535
+#define BOM_MIN_BLOCK_SIZE     128
+#define BOM_MAX_BLOCK_SIZE     (1024 * 1024)
+
+class BOMStorage;
+
+struct BOMLayout {
+    uint32_t pathsPerLeaf; // Number of entries in each leaf of the Paths tree
+    uint32_t blockSize;    // Tree block size recorded in the BOMTree headers
+    bool     clustered;    // Store each leaf next to the blocks of its entries
+
+    BOMLayout()
+        : pathsPerLeaf(256)
+        , blockSize(4096)
+        , clustered(false) {}
+};
+
+/* throws std::runtime_error if the layout cannot be represented in a bom file */
+void validate_layout(BOMLayout const& layout);
+
+uint32_t dec_octal_to_int(uint32_t dec_rep_octal);
+
+/* parses one line of a file list, throws std::runtime_error if the line is malformed */
+void parse_node(std::string const& line, std::string& name, Node& n);
+
+/* Adds entries to a tree by their path in the file list, such as "." or "./usr/bin". Entries are
+   added right away as long as every entry follows its parent directory, which holds for the walk
+   order of ls4mkbom, the breadth first order of lsbom and for sorted lists. Once an entry shows up
+   before its parent, the remaining entries are kept until finish(). A later entry for the same
+   directory replaces the earlier one. */
+class TreeBuilder {
+    private:
+        NodeTree&                                 tree;
+        std::unordered_map<std::string, uint32_t> directories;
+        std::vector<std::pair<std::string, Node>> pending;
+
+        /* returns false if the parent directory of the entry has not been added yet */
+        bool addNow(std::string const& name, Node const& n);
+
+    public:
+        explicit TreeBuilder(NodeTree& t);
+
+        void add(std::string&& name, Node&& n);
+        void add(std::string const& name, Node const& n) { add(std::string(name), Node(n)); }
+
+        /* adds the kept entries, throws std::runtime_error if the parent directory of one is missing */
+        void finish();
+};
+
+/* reads a file list in the text format into builder, throws std::runtime_error on malformed lines */
+void read_file_list(std::istream& lsbom_file, TreeBuilder& builder);
+
+/* adds a whole binary file list, e.g. a mapped file, to tree, which still has to be finished.
+   Throws std::runtime_error if the list is malformed. */
+void read_binary_file_list(const char* buffer, std::size_t length, NodeTree& tree);
+
+/* reads a whole file list, in text or binary format, into tree and finishes it, returns the number of entries.
+   Throws std::runtime_error if the list is malformed. */
+unsigned int read_tree(std::istream& lsbom_file, NodeTree& tree);
+
+/* adds the BomInfo, Paths, HLIndex, VIndex and Size64 variables describing the tree to bom */
+void add_tree(BOMStorage& bom, NodeTree const& nodes, BOMLayout const& layout);
+
+/* throws std::runtime_error if the file list is malformed or the output cannot be written */
+void write_bom(std::istream& lsbom_file, std::string const& output_path,
+               BOMLayout const& layout = BOMLayout());
@@ -0,0 +1,261 @@
+/*
+  xar.cpp - find the files of a xar archive, the format of flat installer packages
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+#include "xar.hpp"
+
+#define XAR_MAGIC       "xar!"
+#define XAR_HEADER_SIZE 28         // magic, header size, version, toc lengths and checksum algorithm
+#define XAR_MAX_TOC     (1 << 30)  // a larger table of contents is taken for a damaged archive
+
+/* header fields are big endian */
+static uint64_t read_be(const unsigned char* p, unsigned int length) {
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < length; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+bool is_xar_file(const char* path) {
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    char          magic[4];
+    return f.read(magic, sizeof(magic)) && (std::memcmp(magic, XAR_MAGIC, sizeof(magic)) == 0);
+}
+
+/* replaces the predefined entities and character references of xml text */
+static std::string xml_unescape(std::string const& text) {
+    std::string result;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t amp = text.find('&', pos);
+        std::size_t end = (amp == std::string::npos) ? std::string::npos : text.find(';', amp);
+        if (end == std::string::npos) {
+            result.append(text, pos, std::string::npos);
+            break;
+        }
+        result.append(text, pos, amp - pos);
+        std::string entity = text.substr(amp + 1, end - amp - 1);
+        if (entity == "amp") {
+            result += '&';
+        } else if (entity == "lt") {
+            result += '<';
+        } else if (entity == "gt") {
+            result += '>';
+        } else if (entity == "quot") {
+            result += '"';
+        } else if (entity == "apos") {
+            result += '\'';
+        } else if ((entity.size() > 1) && (entity[0] == '#')) {
+            unsigned long c = (entity[1] == 'x') ? std::strtoul(entity.c_str() + 2, nullptr, 16)
+                                                 : std::strtoul(entity.c_str() + 1, nullptr, 10);
+            /* encoded as UTF-8 */
+            if (c < 0x80) {
+                result += (char)c;
+            } else if (c < 0x800) {
+                result += (char)(0xc0 | (c >> 6));
+                result += (char)(0x80 | (c & 0x3f));
+            } else if (c < 0x10000) {
+                result += (char)(0xe0 | (c >> 12));
+                result += (char)(0x80 | ((c >> 6) & 0x3f));
+                result += (char)(0x80 | (c & 0x3f));
+            } else {
+                result += (char)(0xf0 | (c >> 18));
+                result += (char)(0x80 | ((c >> 12) & 0x3f));
+                result += (char)(0x80 | ((c >> 6) & 0x3f));
+                result += (char)(0x80 | (c & 0x3f));
+            }
+        } else {
+            result.append(text, amp, end + 1 - amp);
+        }
+        pos = end + 1;
+    }
+    return result;
+}
+
+/* the value of attribute name in the text of a start tag, "" if it is missing */
+static std::string xml_attribute(std::string const& tag, const char* name) {
+    std::string key = std::string(name) + "=";
+    for (std::size_t pos = tag.find(key); pos != std::string::npos; pos = tag.find(key, pos + 1)) {
+        if ((pos > 0) && (std::isspace((unsigned char)tag[pos - 1]) == 0)) {
+            continue;
+        }
+        std::size_t open  = pos + key.size();
+        std::size_t close = (open < tag.size()) ? tag.find(tag[open], open + 1) : std::string::npos;
+        if (close != std::string::npos) {
+            return xml_unescape(tag.substr(open + 1, close - open - 1));
+        }
+    }
+    return "";
+}
+
+/* the part of the table of contents that is needed to find the files */
+struct XarTocEntry {
+    std::string name;
+    std::string type;
+    XarFile     file;
+    bool        hasData;
+};
+
+/* Scans the xml of the table of contents. It is only as much of an xml parser as the files
+   written by xar and pkgbuild need: elements, attributes, text, comments and processing
+   instructions, without DTDs or CDATA sections. */
+static std::vector<XarFile> parse_toc(std::string const& xml, uint64_t heap_offset) {
+    std::vector<XarFile>     files;
+    std::vector<std::string> elements; // the open elements
+    std::vector<XarTocEntry> entries;  // the open <file> elements
+    std::string              text;
+    std::size_t              pos = 0;
+    while (true) {
+        std::size_t lt = xml.find('<', pos);
+        if (lt == std::string::npos) {
+            break;
+        }
+        text.append(xml, pos, lt - pos);
+        if (xml.compare(lt, 4, "<!--") == 0) {
+            std::size_t end = xml.find("-->", lt);
+            pos             = (end == std::string::npos) ? xml.size() : end + 3;
+            continue;
+        }
+        std::size_t gt = xml.find('>', lt);
+        if (gt == std::string::npos) {
+            throw std::runtime_error("Invalid xar table of contents");
+        }
+        pos             = gt + 1;
+        std::string tag = xml.substr(lt + 1, gt - lt - 1);
+        if (tag.empty() || (tag[0] == '?') || (tag[0] == '!')) {
+            continue;
+        }
+        std::string const parent = elements.empty() ? "" : elements.back();
+        if (tag[0] == '/') {
+            std::string name = tag.substr(1, tag.find_first_of(" \t\r\n", 1) - 1);
+            if (elements.empty() || (elements.back() != name)) {
+                throw std::runtime_error("Invalid xar table of contents");
+            }
+            elements.pop_back();
+            std::string const outer = elements.empty() ? "" : elements.back();
+            std::string const value = xml_unescape(text);
+            text.clear();
+            if (entries.empty()) {
+                continue;
+            }
+            XarTocEntry& e = entries.back();
+            if (name == "file") {
+                if ((e.type == "file") && e.hasData) {
+                    std::string path;
+                    for (std::size_t i = 0; i < entries.size(); ++i) {
+                        path += (i ? "/" : "") + entries[i].name;
+                    }
+                    e.file.path = path;
+                    e.file.offset += heap_offset;
+                    files.push_back(e.file);
+                }
+                entries.pop_back();
+            } else if (outer == "file") {
+                if (name == "name") {
+                    e.name = value;
+                } else if (name == "type") {
+                    e.type = value;
+                }
+            } else if ((outer == "data") && (elements.size() >= 2) && (elements[elements.size() - 2] == "file")) {
+                if (name == "offset") {
+                    e.file.offset = std::strtoull(value.c_str(), nullptr, 10);
+                    e.hasData     = true;
+                } else if (name == "length") {
+                    e.file.length = std::strtoull(value.c_str(), nullptr, 10);
+                } else if (name == "size") {
+                    e.file.size = std::strtoull(value.c_str(), nullptr, 10);
+                }
+            }
+            continue;
+        }
+        bool        empty = (tag[tag.size() - 1] == '/');
+        std::string name  = tag.substr(0, tag.find_first_of(" \t\r\n/"));
+        text.clear();
+        if (name == "file") {
+            XarTocEntry e;
+            e.file.offset   = 0;
+            e.file.length   = 0;
+            e.file.size     = 0;
+            e.file.encoding = XAR_UNCOMPRESSED;
+            e.hasData       = false;
+            entries.push_back(e);
+            if (empty) {
+                entries.pop_back();
+            }
+        } else if ((name == "encoding") && (parent == "data") && (entries.empty() == false)) {
+            entries.back().file.encoding = xml_attribute(tag, "style");
+        }
+        if (empty == false) {
+            elements.push_back(name);
+        }
+    }
+    return files;
+}
+
+std::vector<XarFile> read_xar_files(const char* path) {
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    if (!f.is_open()) {
+        throw std::runtime_error(std::string("Unable to open file: \"") + path + "\"");
+    }
+    unsigned char header[XAR_HEADER_SIZE];
+    if (!f.read((char*)header, sizeof(header)) || (std::memcmp(header, XAR_MAGIC, 4) != 0)) {
+        throw std::runtime_error(std::string("Not a xar archive: ") + path);
+    }
+    uint64_t header_size    = read_be(header + 4, 2);
+    uint64_t toc_compressed = read_be(header + 8, 8);
+    uint64_t toc_size       = read_be(header + 16, 8);
+    if ((header_size < XAR_HEADER_SIZE) || (toc_compressed > XAR_MAX_TOC) || (toc_size > XAR_MAX_TOC)) {
+        throw std::runtime_error(std::string("Invalid xar header: ") + path);
+    }
+    std::string compressed(toc_compressed, '\0');
+    f.seekg(header_size);
+    if (!f.read(&compressed[0], compressed.size())) {
+        throw std::runtime_error(std::string("Truncated xar archive: ") + path);
+    }
+    std::string xml(toc_size, '\0');
+    uLongf      xml_length = xml.size();
+    if ((::uncompress((Bytef*)&xml[0], &xml_length, (const Bytef*)compressed.data(), compressed.size()) != Z_OK) ||
+        (xml_length != xml.size())) {
+        throw std::runtime_error(std::string("Invalid xar table of contents: ") + path);
+    }
+    /* the offsets of the files are relative to the heap, which follows the table of contents */
+    return parse_toc(xml, header_size + toc_compressed);
+}
+
+std::vector<XarFile> find_package_boms(const char* path) {
+    std::vector<XarFile> files = read_xar_files(path);
+    std::vector<XarFile> boms;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        std::string const& p = files[i].path;
+        if ((p == "Bom") || ((p.size() > 4) && (p.compare(p.size() - 4, 4, "/Bom") == 0))) {
+            boms.push_back(files[i]);
+        }
+    }
+    return boms;
+}
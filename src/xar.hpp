@@ -0,0 +1,51 @@
+/*
+  xar.hpp - find the files of a xar archive, the format of flat installer packages
+
+  Copyright (C) 2013 Fabian Renn - fabian.renn (at) gmail.com
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA.
+
+  Initial work done by Joseph Coffland and Julian Devlin.
+  Numerous further improvements by Baron Roberts.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* a file stored in a xar archive */
+struct XarFile {
+    std::string path;     // path within the archive, e.g. "Bom" or "core.pkg/Bom"
+    uint64_t    offset;   // of the stored data from the start of the archive
+    uint64_t    length;   // of the stored data
+    uint64_t    size;     // of the extracted data
+    std::string encoding; // "application/octet-stream" if stored uncompressed
+};
+
+#define XAR_UNCOMPRESSED "application/octet-stream"
+#define XAR_ZLIB         "application/x-gzip" // a zlib stream, despite the name
+
+/* whether the file at path starts with the magic of a xar archive */
+bool is_xar_file(const char* path);
+
+/* Reads the table of contents of the xar archive at path and returns its regular files in the
+   order they are listed. Only the header and the table of contents are read. Throws
+   std::runtime_error if path is not a xar archive or the table of contents is malformed. */
+std::vector<XarFile> read_xar_files(const char* path);
+
+/* the bill-of-materials files of a flat package: "Bom" in a component package, "name.pkg/Bom"
+   for each component of a product archive */
+std::vector<XarFile> find_package_boms(const char* path);